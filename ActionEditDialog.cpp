@@ -43,6 +43,8 @@ void ActionEditDialog::setupUi() {
     m_runModeCombo->addItem("adb", "adb");
     m_runModeCombo->addItem("shell", "shell");
     m_runModeCombo->addItem("root", "root");
+    m_runModeCombo->addItem("capture", "capture");
+    m_runModeCombo->addItem("query", "query");
     int idx = m_runModeCombo->findData(m_action.runMode.toLower());
     if (idx != -1) m_runModeCombo->setCurrentIndex(idx);
     else m_runModeCombo->setCurrentIndex(1);
@@ -118,9 +118,7 @@ SwipeBuilderWidget::SwipeBuilderWidget(CommandExecutor *executor, VideoClient *v
     mainSplitter->setStretchFactor(0, 3);
     mainSplitter->setStretchFactor(1, 1);
     mainLayout->addWidget(mainSplitter);
-    m_resolutionProcess = new QProcess(this);
-    connect(m_resolutionProcess,
-            QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+    connect(m_executor, &CommandExecutor::queryFinished,
             this, &SwipeBuilderWidget::onResolutionReady);
     connect(m_model, &SwipeModel::modelChanged, this,
             &SwipeBuilderWidget::updateList);
@@ -161,18 +159,14 @@ SwipeBuilderWidget::SwipeBuilderWidget(CommandExecutor *executor, VideoClient *v
             });
     connect(m_keyboardWidget, &KeyboardWidget::adbCommandGenerated, this,
             &SwipeBuilderWidget::onKeyboardCommandGenerated);
-    connect(m_executor,
-            QOverload<int, QProcess::ExitStatus>::of(&CommandExecutor::finished),
+    connect(m_executor, &CommandExecutor::commandFinished,
             this, &SwipeBuilderWidget::onAdbCommandFinished);
     QTimer::singleShot(500, this,
                        &SwipeBuilderWidget::fetchDeviceResolution);}
 
 SwipeBuilderWidget::~SwipeBuilderWidget() {
     if (m_videoClient) {
-        m_videoClient->stopStream();}
-    if (m_resolutionProcess) {
-        m_resolutionProcess->kill();
-        m_resolutionProcess->waitForFinished(500);}}
+        m_videoClient->stopStream();}}
 
 void SwipeBuilderWidget::setCanvasStatus(const QString &message, bool isError) {m_canvas->setStatus(message, isError);}
 
@@ -265,8 +259,8 @@ void SwipeBuilderWidget::runSelectedAction() {
     if (fullCommand.isEmpty()) {
         emit adbStatus("Empty action or command.", true);
         return;}
-    if (m_executor->isRunning()) {
-        emit adbStatus("ADB is busy running another command...", true);
+    if (m_runRequest && m_executor->isActive(m_runRequest)) {
+        emit adbStatus("Previous action is still running...", true);
         return;}
     QStringList args;
     QStringList parsed = ArgsParser::parse(fullCommand);
@@ -283,11 +277,13 @@ void SwipeBuilderWidget::runSelectedAction() {
                        .arg(runMode.toUpper())
                        .arg(logCmd),
                      false);
-    m_executor->runAdbCommand(args);
+    m_runRequest = m_executor->runAdbCommand(args);
     QListWidgetItem *item = m_list->item(row);
     if (item) item->setBackground(QBrush(QColor("#FFC107")));}
 
-void SwipeBuilderWidget::onAdbCommandFinished(int exitCode, QProcess::ExitStatus) {
+void SwipeBuilderWidget::onAdbCommandFinished(quint64 id, int exitCode, QProcess::ExitStatus) {
+    if (id != m_runRequest) return;
+    m_runRequest = 0;
     int finishedRow = -1;
     for (int i = 0; i < m_list->count(); ++i) {
         QListWidgetItem *item = m_list->item(i);
@@ -462,19 +458,16 @@ void SwipeBuilderWidget::dropEvent(QDropEvent *event) {
     event->acceptProposedAction();}
 
 void SwipeBuilderWidget::fetchDeviceResolution() {
-    if (!m_resolutionProcess) return;
-    if (m_resolutionProcess->state() != QProcess::NotRunning) return;
-    QString targetSerial = m_executor->targetDevice();
-    if (targetSerial.isEmpty()) return;
-    QStringList args;
-    args << "-s" << targetSerial << "shell" << "wm" << "size";
-    m_resolutionProcess->setProgram(m_adbPath);
-    m_resolutionProcess->setArguments(args);
-    m_resolutionProcess->start();}
-
-void SwipeBuilderWidget::onResolutionReady(int exitCode, QProcess::ExitStatus) {
+    if (!m_executor || m_resolutionQuery) return;
+    if (m_executor->targetDevice().isEmpty()) return;
+    // Rozdzielczość nie zmienia się do restartu - kolejne wywołania trafiają w cache executora.
+    m_resolutionQuery = m_executor->query("wm size");}
+
+void SwipeBuilderWidget::onResolutionReady(quint64 id, const QByteArray &data, int exitCode, bool) {
+    if (id != m_resolutionQuery) return;
+    m_resolutionQuery = 0;
     if (exitCode == 0) {
-        QString output = m_resProcess->readAllStandardOutput();
+        QString output = QString::fromUtf8(data);
         QRegularExpression re("(\\d+)x(\\d+)");
         auto match = re.match(output);
         if (match.hasMatch()) {
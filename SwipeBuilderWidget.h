@@ -52,10 +52,10 @@ private slots:
     void editSelected();
     void moveSelectedUp();
     void moveSelectedDown();
-    void onAdbCommandFinished(int exitCode, QProcess::ExitStatus);
+    void onAdbCommandFinished(quint64 id, int exitCode, QProcess::ExitStatus);
     void addActionFromDialog();
     void onRawToggleChanged(int state);
-    void onResolutionReady(int exitCode, QProcess::ExitStatus);
+    void onResolutionReady(quint64 id, const QByteArray &output, int exitCode, bool fromCache);
     void fetchDeviceResolution();
     void handleCanvasScreenshotReady(const QImage &image);
 
@@ -70,11 +70,11 @@ private:
     KeyboardWidget  *m_keyboardWidget = nullptr;
     QListWidget     *m_list = nullptr;
 
-    QProcess        *m_resolutionProcess = nullptr;
     QProcess::ProcessError m_lastError = QProcess::UnknownError;
-    QProcess *m_resProcess = nullptr;
 
     CommandExecutor *m_executor = nullptr;
+    quint64          m_runRequest = 0;
+    quint64          m_resolutionQuery = 0;
     VideoClient     *m_videoClient = nullptr;
 
     QPushButton     *m_runButton = nullptr;
@@ -0,0 +1,69 @@
+#include "adb_buffer.h"
+#include <cstring>
+
+QByteArray AdbSlice::toByteArray() const {
+    if (m_offset == 0 && m_length == m_chunk.size()) return m_chunk;
+    return QByteArray(constData(), m_length);}
+
+void AdbChunkBuffer::append(const QByteArray &chunk) {
+    if (chunk.isEmpty()) return;
+    m_chunks.push_back(chunk);
+    m_size += chunk.size();}
+
+void AdbChunkBuffer::clear() {
+    m_chunks.clear();
+    m_head = 0;
+    m_size = 0;}
+
+bool AdbChunkBuffer::peek(char *dst, qsizetype n) const {
+    if (n > m_size) return false;
+    qsizetype offset = m_head;
+    for (const QByteArray &chunk : m_chunks) {
+        const qsizetype part = qMin(n, chunk.size() - offset);
+        memcpy(dst, chunk.constData() + offset, static_cast<size_t>(part));
+        dst += part;
+        n -= part;
+        offset = 0;
+        if (n == 0) break;}
+    return true;}
+
+QByteArray AdbChunkBuffer::peek(qsizetype n) const {
+    n = qMin(n, m_size);
+    QByteArray out(n, Qt::Uninitialized);
+    peek(out.data(), n);
+    return out;}
+
+bool AdbChunkBuffer::startsWith(const char *prefix, qsizetype n) const {
+    char head[16];
+    if (n > static_cast<qsizetype>(sizeof(head)) || !peek(head, n)) return false;
+    return memcmp(head, prefix, static_cast<size_t>(n)) == 0;}
+
+void AdbChunkBuffer::skip(qsizetype n) {
+    n = qMin(n, m_size);
+    m_size -= n;
+    while (n > 0) {
+        const qsizetype left = m_chunks.front().size() - m_head;
+        if (n < left) {
+            m_head += n;
+            return;}
+        n -= left;
+        m_chunks.pop_front();
+        m_head = 0;}}
+
+AdbSlice AdbChunkBuffer::take(qsizetype n) {
+    n = qMin(n, m_size);
+    if (n == 0) return AdbSlice();
+    const QByteArray &front = m_chunks.front();
+    if (front.size() - m_head >= n) {
+        AdbSlice slice(front, m_head, n);
+        skip(n);
+        return slice;}
+    // Ramka na granicy kawałków - jedyny przypadek, w którym sklejamy dane.
+    QByteArray joined(n, Qt::Uninitialized);
+    peek(joined.data(), n);
+    skip(n);
+    return AdbSlice(joined);}
+
+AdbSlice AdbChunkBuffer::takeFront() {
+    if (m_chunks.empty()) return AdbSlice();
+    return take(m_chunks.front().size() - m_head);}
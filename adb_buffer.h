@@ -0,0 +1,54 @@
+#pragma once
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QMetaType>
+#include <deque>
+
+// Wycinek bufora współdzielący pamięć z kawałkiem odebranym z gniazda (QByteArray
+// jest liczony referencjami). toByteArray() kopiuje tylko wtedy, gdy wycinek
+// nie obejmuje całego kawałka.
+class AdbSlice {
+public:
+    AdbSlice() = default;
+    AdbSlice(const QByteArray &chunk, qsizetype offset, qsizetype length)
+        : m_chunk(chunk), m_offset(offset), m_length(length) {}
+    explicit AdbSlice(const QByteArray &whole)
+        : m_chunk(whole), m_offset(0), m_length(whole.size()) {}
+
+    const char *constData() const { return m_chunk.constData() + m_offset; }
+    qsizetype size() const { return m_length; }
+    bool isEmpty() const { return m_length == 0; }
+    QByteArrayView view() const { return QByteArrayView(constData(), m_length); }
+    QByteArray toByteArray() const;
+
+private:
+    QByteArray m_chunk;
+    qsizetype m_offset = 0;
+    qsizetype m_length = 0;
+};
+Q_DECLARE_METATYPE(AdbSlice)
+
+// Lista kawałków z kursorem odczytu. append() nie kopiuje danych, a zdjęcie
+// nagłówka czy ramki przesuwa kursor zamiast robić memmove całego bufora.
+class AdbChunkBuffer {
+public:
+    void append(const QByteArray &chunk);
+    qsizetype size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    void clear();
+
+    // Kopiuje n pierwszych bajtów (nagłówki 4-8 B) bez zdejmowania ich z bufora.
+    bool peek(char *dst, qsizetype n) const;
+    QByteArray peek(qsizetype n) const;
+    bool startsWith(const char *prefix, qsizetype n) const;
+    void skip(qsizetype n);
+    // Wycinek n bajtów - bez kopii, gdy mieści się w jednym kawałku.
+    AdbSlice take(qsizetype n);
+    // Kolejny ciągły fragment z czoła bufora (cały pozostały kawałek).
+    AdbSlice takeFront();
+
+private:
+    std::deque<QByteArray> m_chunks;
+    qsizetype m_head = 0;
+    qsizetype m_size = 0;
+};
@@ -0,0 +1,162 @@
+#include "adb_capture.h"
+#include <QDebug>
+#include <QMetaObject>
+#ifdef Q_OS_UNIX
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+static const qint64 CAPTURE_FLUSH_BYTES = 1024 * 1024;
+#ifdef Q_OS_UNIX
+#ifdef IOV_MAX
+static const int CAPTURE_IOV_MAX = IOV_MAX;
+#else
+static const int CAPTURE_IOV_MAX = 1024;
+#endif
+#endif
+
+AdbCapture::AdbCapture(AdbClient *client, QObject *parent) : QObject(parent), m_client(client) {
+    connect(m_client, &AdbClient::requestSlice, this, &AdbCapture::onRequestSlice);
+    connect(m_client, &AdbClient::requestFinished, this, &AdbCapture::onRequestFinished);
+    connect(m_client, &AdbClient::requestFailed, this, &AdbCapture::onRequestFailed);}
+
+AdbCapture::~AdbCapture() {
+    const QList<quint64> ops = m_ops.keys();
+    for (quint64 id : ops) cancel(id);}
+
+quint64 AdbCapture::capture(const QString &serial, const QString &command, const QString &localPath) {
+    Op *op = new Op;
+    op->file = new QFile(localPath);
+    // Unbuffered: bufor QFile tylko by dokładał kopię - zapisy i tak idą po ~1 MiB.
+    if (!op->file->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        op->error = QString("Nie można zapisać %1: %2").arg(localPath, op->file->errorString());
+    } else {
+        op->fd = op->file->handle();}
+    return startOp(op, serial, command);}
+
+quint64 AdbCapture::capture(const QString &serial, const QString &command, int fd) {
+    Op *op = new Op;
+    op->fd = fd;
+    if (fd < 0) op->error = "Niepoprawny deskryptor pliku.";
+    return startOp(op, serial, command);}
+
+quint64 AdbCapture::startOp(Op *op, const QString &serial, const QString &command) {
+    op->id = m_nextOp++;
+    op->timer.start();
+    m_ops.insert(op->id, op);
+    if (op->error.isEmpty()) {
+        // exec: zamiast shell: - bez PTY, więc bajty binarne (PNG, tar) nie są przepisywane.
+        op->request = m_client->sendDeviceCommand(serial, QString("exec:%1").arg(command));
+        if (op->request == 0) op->error = "Nie można otworzyć usługi exec:";}
+    if (!op->error.isEmpty()) {
+        const quint64 id = op->id;
+        const QString message = op->error;
+        QMetaObject::invokeMethod(this, [this, id, message]() {
+            if (Op *o = m_ops.value(id, nullptr)) completeOp(o, false, message);
+        }, Qt::QueuedConnection);
+        return id;}
+    m_byRequest.insert(op->request, op);
+    return op->id;}
+
+void AdbCapture::cancel(quint64 opId) {
+    Op *op = m_ops.value(opId, nullptr);
+    if (!op) return;
+    if (op->request) {
+        m_byRequest.remove(op->request);
+        m_client->cancel(op->request);
+        op->request = 0;}
+    completeOp(op, false, "Anulowano.");}
+
+void AdbCapture::onRequestSlice(quint64 id, const AdbSlice &data) {
+    Op *op = m_byRequest.value(id, nullptr);
+    if (!op || data.isEmpty()) return;
+    op->pending.append(data);
+    op->pendingBytes += data.size();
+    if (op->pendingBytes >= CAPTURE_FLUSH_BYTES && !flush(op)) {
+        m_byRequest.remove(op->request);
+        m_client->cancel(op->request);
+        op->request = 0;
+        completeOp(op, false, op->error);
+        return;}
+    reportProgress(op, false);}
+
+bool AdbCapture::flush(Op *op) {
+    if (op->pending.isEmpty()) return true;
+#ifdef Q_OS_UNIX
+    int first = 0;
+    qsizetype firstOffset = 0;
+    while (first < op->pending.size()) {
+        struct iovec iov[CAPTURE_IOV_MAX];
+        int count = 0;
+        for (int i = first; i < op->pending.size() && count < CAPTURE_IOV_MAX; ++i, ++count) {
+            const AdbSlice &s = op->pending.at(i);
+            const qsizetype skip = (i == first) ? firstOffset : 0;
+            iov[count].iov_base = const_cast<char*>(s.constData() + skip);
+            iov[count].iov_len = static_cast<size_t>(s.size() - skip);}
+        const ssize_t n = ::writev(op->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            op->error = QString("Błąd zapisu: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+            return false;}
+        op->written += n;
+        // Częściowy zapis: przesuwamy się po wycinkach o tyle, ile przyjął kernel.
+        qsizetype left = n;
+        while (first < op->pending.size() && left > 0) {
+            const qsizetype remaining = op->pending.at(first).size() - firstOffset;
+            if (left < remaining) {
+                firstOffset += left;
+                left = 0;
+            } else {
+                left -= remaining;
+                firstOffset = 0;
+                first++;}}}
+#else
+    for (const AdbSlice &s : std::as_const(op->pending)) {
+        if (!op->file || op->file->write(s.constData(), s.size()) != s.size()) {
+            op->error = op->file ? QString("Błąd zapisu: %1").arg(op->file->errorString()) : "Zapis do deskryptora wymaga systemu POSIX.";
+            return false;}
+        op->written += s.size();}
+#endif
+    op->pending.clear();
+    op->pendingBytes = 0;
+    return true;}
+
+void AdbCapture::reportProgress(Op *op, bool force) {
+    const qint64 elapsed = op->timer.elapsed();
+    if (!force && elapsed - op->lastProgressMs < m_progressIntervalMs) return;
+    op->lastProgressMs = elapsed;
+    const qint64 bytes = op->written + op->pendingBytes;
+    emit progress(op->id, bytes, elapsed > 0 ? bytes * 1000.0 / elapsed : 0.0);}
+
+void AdbCapture::onRequestFinished(quint64 id) {
+    Op *op = m_byRequest.take(id);
+    if (!op) return;
+    op->request = 0;
+    if (!flush(op)) {
+        completeOp(op, false, op->error);
+        return;}
+    reportProgress(op, true);
+    const qint64 ms = qMax<qint64>(1, op->timer.elapsed());
+    completeOp(op, true, QString("Zapisano %1 B w %2 ms (%3 MB/s)")
+                             .arg(op->written).arg(ms).arg(op->written / 1000.0 / ms, 0, 'f', 1));}
+
+void AdbCapture::onRequestFailed(quint64 id, const QString &message) {
+    Op *op = m_byRequest.take(id);
+    if (!op) return;
+    op->request = 0;
+    flush(op);
+    completeOp(op, false, message);}
+
+void AdbCapture::completeOp(Op *op, bool ok, const QString &message) {
+    const quint64 id = op->id;
+    const qint64 bytes = op->written;
+    m_ops.remove(id);
+    if (op->request) m_byRequest.remove(op->request);
+    if (op->file) {
+        op->file->close();
+        delete op->file;}
+    delete op;
+    emit finished(id, ok, bytes, message);}
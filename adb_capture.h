@@ -0,0 +1,58 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QFile>
+#include <QElapsedTimer>
+#include "adb_client.h"
+
+// Zrzut wyjścia exec:<komenda> prosto do pliku/deskryptora - bez konwersji na tekst.
+// Wycinki z AdbClient (współdzielące pamięć z odczytem gniazda) są zbierane do
+// CAPTURE_FLUSH_BYTES i zapisywane jednym writev(), więc dane nie są kopiowane
+// w przestrzeni użytkownika ani razu.
+class AdbCapture : public QObject {
+    Q_OBJECT
+public:
+    explicit AdbCapture(AdbClient *client, QObject *parent = nullptr);
+    ~AdbCapture() override;
+
+    quint64 capture(const QString &serial, const QString &command, const QString &localPath);
+    // Deskryptor należy do wywołującego - nie jest zamykany po zakończeniu.
+    quint64 capture(const QString &serial, const QString &command, int fd);
+    void cancel(quint64 op);
+    void setProgressIntervalMs(int ms) { m_progressIntervalMs = qMax(0, ms); }
+
+signals:
+    void progress(quint64 op, qint64 bytes, double bytesPerSec);
+    void finished(quint64 op, bool ok, qint64 bytes, const QString &message);
+
+private slots:
+    void onRequestSlice(quint64 id, const AdbSlice &data);
+    void onRequestFinished(quint64 id);
+    void onRequestFailed(quint64 id, const QString &message);
+
+private:
+    struct Op {
+        quint64 id = 0;
+        quint64 request = 0;
+        QFile *file = nullptr;
+        int fd = -1;
+        QVector<AdbSlice> pending;
+        qint64 pendingBytes = 0;
+        qint64 written = 0;
+        qint64 lastProgressMs = 0;
+        QElapsedTimer timer;
+        QString error;
+    };
+
+    AdbClient *m_client;
+    quint64 m_nextOp = 1;
+    int m_progressIntervalMs = 250;
+    QHash<quint64, Op*> m_ops;
+    QHash<quint64, Op*> m_byRequest;
+
+    quint64 startOp(Op *op, const QString &serial, const QString &command);
+    bool flush(Op *op);
+    void reportProgress(Op *op, bool force);
+    void completeOp(Op *op, bool ok, const QString &message);
+};
@@ -1,133 +1,527 @@
 #include "adb_client.h"
 #include <QDebug>
 #include <QHostAddress>
-#include <QElapsedTimer>
+#include <QtEndian>
+#include <QRegularExpression>
+#include <QMetaMethod>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+static const int HANDSHAKE_SWEEP_MS = 250;
 
 AdbClient::AdbClient(QObject *parent)
-    : QObject(parent), m_socket(new QTcpSocket(this)) {
-    connect(m_socket, &QTcpSocket::connected, this, &AdbClient::onConnected);
-    connect(m_socket, &QTcpSocket::disconnected, this, &AdbClient::onDisconnected);
-    connect(m_socket, &QTcpSocket::readyRead, this, &AdbClient::onReadyRead);
-    connect(m_socket, QOverload<QTcpSocket::SocketError>::of(&QTcpSocket::errorOccurred),
-            this, &AdbClient::onErrorOccurred);}
+    : QObject(parent), m_pool(new AdbTransportPool(this)) {
+    m_handshakeTimer.setInterval(HANDSHAKE_SWEEP_MS);
+    connect(&m_handshakeTimer, &QTimer::timeout, this, &AdbClient::onHandshakeSweep);
+    qRegisterMetaType<AdbDevice>("AdbDevice");
+    qRegisterMetaType<AdbSlice>("AdbSlice");
+    connect(this, &AdbClient::requestFinished, this, &AdbClient::onTrackRequestFinished);
+    connect(this, &AdbClient::requestFailed, this, &AdbClient::onTrackRequestFailed);
+    connect(m_pool, &AdbTransportPool::transportError, this, [](const QString &serial, const QString &message) {
+        qWarning() << "AdbClient: nie udało się rozgrzać transportu dla" << serial << ":" << message;});}
+
+AdbClient::~AdbClient() {
+    m_trackingWanted = false;
+    cancelAll();
+    qDeleteAll(m_direct);
+    m_direct.clear();}
 
 void AdbClient::setTargetDevice(const QString &serial) {
+    if (serial != m_targetSerial && !m_targetSerial.isEmpty()) {
+        m_pool->release(m_targetSerial);}
     m_targetSerial = serial;
-    if (m_socket->state() == QAbstractSocket::ConnectedState) {
-        m_socket->disconnectFromHost();}}
-
-void AdbClient::connectToAdbServer(const QString &host, quint16 port) {
-    if (m_socket->state() != QAbstractSocket::UnconnectedState) {
-        m_socket->disconnectFromHost();
-        if (!m_socket->waitForDisconnected(100)) {
-            qWarning() << "AdbClient: Poprzednie połączenie nie zostało rozłączone.";
-        }}
-    m_state = Idle;
-    m_readBuffer.clear();
-    m_socket->connectToHost(QHostAddress(host), port);}
-
-void AdbClient::onConnected() {
-    emit adbConnected();}
-
-void AdbClient::onDisconnected() {
-    emit adbDisconnected();}
-
-void AdbClient::onErrorOccurred(QTcpSocket::SocketError socketError) {
-    if (socketError != QTcpSocket::RemoteHostClosedError) {
-        emit adbError(QString("Błąd połączenia z ADB: %1").arg(m_socket->errorString()));}}
-
-
-void AdbClient::writeAdbHeader(const QString &command) {
-    QByteArray header = QByteArray::number(command.length(), 16).rightJustified(4, '0').toUpper();
-    m_socket->write(header);
-    m_socket->write(command.toUtf8());
-    m_state = WaitingForAdbStatus;}
-
-void AdbClient::sendAdbCommand(const QString &command) {
-    connectToAdbServer(); 
-    if (m_socket->waitForConnected(1000)) {
-        writeAdbHeader(command);
-    } else {
-        emit adbError("Nie można połączyć się z serwerem ADB (5037).");}}
+    m_pool->warm(serial);}
+
+void AdbClient::setDirectTransport(bool enabled) {
+    m_directEnabled = enabled;
+    if (enabled) return;
+    for (AdbdConnection *c : std::as_const(m_direct)) {
+        c->disconnectFromDevice();
+        c->deleteLater();}
+    m_direct.clear();}
+
+bool AdbClient::isDirect(const QString &serial) const {
+    static const QRegularExpression tcpSerial("^(.+):(\\d{1,5})$");
+    return m_directEnabled && tcpSerial.match(serial).hasMatch();}
+
+AdbdConnection *AdbClient::directConnection(const QString &serial) {
+    AdbdConnection *c = m_direct.value(serial, nullptr);
+    if (!c) {
+        const int colon = serial.lastIndexOf(':');
+        c = new AdbdConnection(serial.left(colon), serial.mid(colon + 1).toUShort(), this);
+        if (!m_directKeyPath.isEmpty()) c->setKeyPath(m_directKeyPath);
+        connect(c, &AdbdConnection::connectionError, this, [serial](const QString &message) {
+            qWarning() << "AdbClient: połączenie bezpośrednie z" << serial << ":" << message;});
+        m_direct.insert(serial, c);}
+    return c;}
+
+void AdbClient::setServer(const QString &host, quint16 port) {
+    m_host = host;
+    m_port = port;
+    m_pool->setServer(host, port);}
+
+AdbClient::RequestState AdbClient::requestState(quint64 id) const {
+    const Request *r = m_requests.value(id, nullptr);
+    return r ? r->state : Closed;}
 
-void AdbClient::sendDeviceCommand(const QString &command) {
-    if (m_targetSerial.isEmpty()) {
+quint64 AdbClient::sendAdbCommand(const QString &command) {
+    return startRequest(HostQuery, QString(), command);}
+
+quint64 AdbClient::sendDeviceCommand(const QString &command) {
+    return sendDeviceCommand(m_targetSerial, command);}
+
+quint64 AdbClient::sendDeviceCommand(const QString &serial, const QString &command) {
+    if (serial.isEmpty()) {
+        emit adbError("Nie ustawiono urządzenia docelowego (serial).");
+        return 0;}
+    return startRequest(DeviceStream, serial, command);}
+
+quint64 AdbClient::sendShellV2(const QString &serial, const QString &command, const QByteArray &stdinData) {
+    if (serial.isEmpty()) {
         emit adbError("Nie ustawiono urządzenia docelowego (serial).");
+        return 0;}
+    const quint64 id = startRequest(ShellV2, serial, QString("shell,v2,raw:%1").arg(command));
+    if (Request *r = m_requests.value(id, nullptr)) r->stdinData = stdinData;
+    return id;}
+
+quint64 AdbClient::forward(const QString &serial, const QString &local, const QString &remote, bool noRebind) {
+    const QString service = QString("host-serial:%1:forward:%2%3;%4")
+                                .arg(serial, noRebind ? QStringLiteral("norebind:") : QString(), local, remote);
+    const quint64 id = startRequest(HostStatus, QString(), service);
+    if (Request *r = m_requests.value(id, nullptr)) r->expectPort = (local == QLatin1String("tcp:0"));
+    return id;}
+
+quint64 AdbClient::killForward(const QString &serial, const QString &local) {
+    return startRequest(HostStatus, QString(), QString("host-serial:%1:killforward:%2").arg(serial, local));}
+
+quint64 AdbClient::listForwards() {
+    return startRequest(HostQuery, QString(), "host:list-forward");}
+
+void AdbClient::startDeviceTracking() {
+    m_trackingWanted = true;
+    if (m_trackRequest) return;
+    m_trackRequest = startRequest(TrackDevices, QString(), "host:track-devices-l");}
+
+void AdbClient::stopDeviceTracking() {
+    m_trackingWanted = false;
+    if (m_trackRequest) {
+        const quint64 id = m_trackRequest;
+        m_trackRequest = 0;
+        cancel(id);}
+    clearDevices();}
+
+QList<AdbDevice> AdbClient::devices() const {
+    QList<AdbDevice> list = m_devices.values();
+    std::sort(list.begin(), list.end(), [](const AdbDevice &a, const AdbDevice &b) { return a.serial < b.serial; });
+    return list;}
+
+void AdbClient::applyDeviceList(const QByteArray &payload) {
+    // Serwer wysyła za każdym razem pełną listę - różnicę liczymy sami.
+    QHash<QString, AdbDevice> next;
+    const QList<QByteArray> lines = payload.split('\n');
+    for (const QByteArray &rawLine : lines) {
+        const QString line = QString::fromUtf8(rawLine).trimmed();
+        if (line.isEmpty()) continue;
+        const QStringList parts = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+        if (parts.size() < 2) continue;
+        AdbDevice dev;
+        dev.serial = parts.at(0);
+        QStringList stateParts;
+        for (int i = 1; i < parts.size(); ++i) {
+            const QString &part = parts.at(i);
+            const int colon = part.indexOf(':');
+            if (colon <= 0 || stateParts.isEmpty()) {
+                stateParts << part;
+                continue;}
+            const QString key = part.left(colon);
+            const QString value = part.mid(colon + 1);
+            if (key == "product") dev.product = value;
+            else if (key == "model") dev.model = value;
+            else if (key == "device") dev.device = value;
+            else if (key == "transport_id") dev.transportId = value;}
+        dev.state = stateParts.join(' ');
+        next.insert(dev.serial, dev);}
+    bool changed = false;
+    const QStringList known = m_devices.keys();
+    for (const QString &serial : known) {
+        if (!next.contains(serial)) {
+            m_devices.remove(serial);
+            m_pool->release(serial);
+            changed = true;
+            emit deviceRemoved(serial);}}
+    for (auto it = next.constBegin(); it != next.constEnd(); ++it) {
+        auto existing = m_devices.find(it.key());
+        if (existing == m_devices.end()) {
+            m_devices.insert(it.key(), it.value());
+            changed = true;
+            emit deviceAdded(it.value());
+        } else if (!(existing.value() == it.value())) {
+            const QString oldState = existing.value().state;
+            existing.value() = it.value();
+            changed = true;
+            if (oldState != it.value().state) {
+                if (!it.value().isOnline()) m_pool->release(it.key());
+                emit deviceStateChanged(it.key(), oldState, it.value().state);}}}
+    if (changed) emit devicesChanged();}
+
+void AdbClient::clearDevices() {
+    if (m_devices.isEmpty()) return;
+    const QStringList serials = m_devices.keys();
+    m_devices.clear();
+    for (const QString &serial : serials) {
+        emit deviceRemoved(serial);}
+    emit devicesChanged();}
+
+void AdbClient::onTrackRequestFinished(quint64 id) {
+    if (id != m_trackRequest) return;
+    onTrackRequestFailed(id, "Serwer ADB zamknął subskrypcję track-devices.");}
+
+void AdbClient::onTrackRequestFailed(quint64 id, const QString &message) {
+    if (id != m_trackRequest) return;
+    m_trackRequest = 0;
+    // Restart serwera ADB: urządzenia znikają, a subskrypcję odnawiamy z narastającym opóźnieniem.
+    clearDevices();
+    emit deviceTrackingLost(message);
+    if (!m_trackingWanted) return;
+    m_trackRetryMs = qBound(250, m_trackRetryMs * 2, 5000);
+    QTimer::singleShot(m_trackRetryMs, this, [this]() {
+        if (m_trackingWanted && !m_trackRequest) {
+            m_trackRequest = startRequest(TrackDevices, QString(), "host:track-devices-l");}});}
+
+quint64 AdbClient::startRequest(Kind kind, const QString &serial, const QString &service) {
+    Request *r = new Request;
+    const quint64 id = m_nextId++;
+    r->id = id;
+    r->kind = kind;
+    r->serial = serial;
+    r->service = service;
+    m_requests.insert(id, r);
+    if (!m_handshakeTimer.isActive()) m_handshakeTimer.start();
+    const bool deviceService = (kind == DeviceStream || kind == ShellV2);
+    if (deviceService && isDirect(serial)) {
+        // Strumień na współdzielonym połączeniu z adbd - bez serwera ADB i bez nowego gniazda.
+        AdbdConnection *c = directConnection(serial);
+        attachStream(r, c->openStream(service));
+        setState(r, c->state() == AdbdConnection::Online ? ServiceRequest : Connecting);
+        return id;}
+    // Gniazdo z puli ma już za sobą connect i OKAY na host:transport.
+    QTcpSocket *warm = deviceService ? m_pool->checkout(serial) : nullptr;
+    if (warm) {
+        attachSocket(r, warm);
+        writeAdbHeader(r->socket, r->service);
+        setState(r, ServiceRequest);
+    } else {
+        QTcpSocket *socket = new QTcpSocket(this);
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        attachSocket(r, socket);
+        setState(r, Connecting);
+        socket->connectToHost(QHostAddress(m_host), m_port);}
+    // setState/connectToHost mogą już zakończyć i zwolnić żądanie - r jest wtedy nieważne.
+    return id;}
+
+void AdbClient::attachSocket(Request *r, QTcpSocket *socket) {
+    r->socket = socket;
+    socket->setParent(this);
+    connect(socket, &QTcpSocket::connected, this, [this, r]() { onRequestConnected(r); });
+    connect(socket, &QTcpSocket::readyRead, this, [this, r]() { onRequestReadyRead(r); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, r]() { onRequestDisconnected(r); });
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, r](qint64 bytes) {
+        if (r->state == Payload) emit requestBytesWritten(r->id, bytes);});
+    connect(socket, QOverload<QTcpSocket::SocketError>::of(&QTcpSocket::errorOccurred),
+            this, [this, r](QTcpSocket::SocketError err) { onRequestError(r, err); });}
+
+void AdbClient::attachStream(Request *r, AdbdStream *stream) {
+    r->stream = stream;
+    connect(stream, &AdbdStream::opened, this, [this, r]() {
+        setState(r, Payload);
+        if (m_requests.contains(r->id)) beginPayload(r);});
+    connect(stream, &AdbdStream::dataReceived, this, [this, r](const QByteArray &data) {
+        // WRTE przychodzi już jako osobny QByteArray - trafia do bufora bez kopii.
+        r->buffer.append(data);
+        processPayload(r);});
+    connect(stream, &AdbdStream::bytesWritten, this, [this, r](qint64 bytes) {
+        emit requestBytesWritten(r->id, bytes);});
+    connect(stream, &AdbdStream::closed, this, [this, r](bool rejected, const QString &message) {
+        onStreamClosed(r, rejected, message);});}
+
+void AdbClient::onStreamClosed(Request *r, bool rejected, const QString &message) {
+    r->stream = nullptr;
+    if (rejected) {
+        const quint64 id = r->id;
+        emit serviceRejected(id, r->service, message);
+        if (m_requests.contains(id)) failRequest(r, QString("Błąd ADB: %1").arg(message));
+    } else if (!message.isEmpty()) {
+        failRequest(r, message);
+    } else if (r->state == Payload) {
+        finishRequest(r);
+    } else {
+        failRequest(r, "Błąd adbd: strumień zamknięty przed otwarciem.");}}
+
+void AdbClient::beginPayload(Request *r) {
+    if (r->kind != ShellV2) return;
+    // Bez zamknięcia stdin komendy czytające wejście wisiałyby w nieskończoność.
+    if (!r->stdinData.isEmpty()) writeShellPacket(r, ShellStdin, r->stdinData);
+    writeShellPacket(r, ShellCloseStdin, QByteArray());
+    r->stdinData.clear();}
+
+void AdbClient::writeRaw(Request *r, const QByteArray &data) {
+    if (r->stream) {
+        r->stream->write(data);
+    } else if (r->socket) {
+        r->socket->write(data);}}
+
+void AdbClient::setState(Request *r, RequestState state) {
+    r->state = state;
+    r->phaseTimer.start();
+    emit requestStateChanged(r->id, state);}
+
+void AdbClient::writeShellPacket(Request *r, ShellPacketId packetId, const QByteArray &data) {
+    QByteArray packet(5, Qt::Uninitialized);
+    packet[0] = static_cast<char>(packetId);
+    qToLittleEndian<quint32>(static_cast<quint32>(data.size()), packet.data() + 1);
+    packet.append(data);
+    writeRaw(r, packet);}
+
+void AdbClient::writeAdbHeader(QTcpSocket *socket, const QString &command) {
+    const QByteArray payload = command.toUtf8();
+    socket->write(QByteArray::number(payload.size(), 16).rightJustified(4, '0').toUpper());
+    socket->write(payload);}
+
+void AdbClient::onRequestConnected(Request *r) {
+    if (r->kind == DeviceStream || r->kind == ShellV2) {
+        writeAdbHeader(r->socket, QString("host:transport:%1").arg(r->serial));
+        setState(r, TransportRequest);
+    } else {
+        writeAdbHeader(r->socket, r->service);
+        setState(r, ServiceRequest);}}
+
+void AdbClient::onRequestReadyRead(Request *r) {
+    r->buffer.append(r->socket->readAll());
+    const quint64 id = r->id;
+    while (r->state == TransportRequest || r->state == ServiceRequest) {
+        if (!processStatus(r)) return;}
+    if (m_requests.contains(id) && r->state == Payload) {
+        processPayload(r);}}
+
+bool AdbClient::processStatus(Request *r) {
+    char status[4];
+    if (!r->buffer.peek(status, 4)) return false;
+    if (memcmp(status, "OKAY", 4) == 0) {
+        const quint64 id = r->id;
+        r->buffer.skip(4);
+        if (r->state == TransportRequest) {
+            writeAdbHeader(r->socket, r->service);
+            setState(r, ServiceRequest);
+        } else {
+            setState(r, Payload);
+            if (m_requests.contains(id)) beginPayload(r);}
+        return m_requests.contains(id);}
+    if (memcmp(status, "FAIL", 4) == 0) {
+        QByteArray payload;
+        bool malformed = false;
+        if (!takeLengthPrefixed(r, 4, &payload, &malformed)) {
+            if (malformed) failRequest(r, "Błąd ADB: Niekompletna wiadomość o błędzie.");
+            return false;}
+        const QString message = QString::fromUtf8(payload);
+        if (r->state == TransportRequest) {
+            failRequest(r, QString("Błąd transportu do %1: %2").arg(r->serial, message));
+        } else {
+            const quint64 id = r->id;
+            emit serviceRejected(id, r->service, message);
+            if (m_requests.contains(id)) failRequest(r, QString("Błąd ADB: %1").arg(message));}
+        return false;}
+    failRequest(r, QString("Błąd protokołu ADB: Nieznany status '%1'").arg(QString::fromLatin1(status, 4)));
+    return false;}
+
+bool AdbClient::takeLengthPrefixed(Request *r, int headerOffset, QByteArray *payload, bool *malformed) {
+    // [headerOffset bajtów][4 hex długości][dane] - zdejmowane z bufora dopiero w całości.
+    char header[12];
+    if (!r->buffer.peek(header, headerOffset + 4)) return false;
+    bool ok;
+    const int length = QByteArray(header + headerOffset, 4).toInt(&ok, 16);
+    if (!ok) {
+        *malformed = true;
+        return false;}
+    if (r->buffer.size() < headerOffset + 4 + length) return false;
+    r->buffer.skip(headerOffset + 4);
+    *payload = r->buffer.take(length).toByteArray();
+    return true;}
+
+void AdbClient::emitData(Request *r, const AdbSlice &data, bool shellStdout) {
+    static const QMetaMethod requestDataSignal = QMetaMethod::fromSignal(&AdbClient::requestData);
+    static const QMetaMethod shellStdoutSignal = QMetaMethod::fromSignal(&AdbClient::shellStdout);
+    static const QMetaMethod rawDataSignal = QMetaMethod::fromSignal(&AdbClient::rawDataReady);
+    const quint64 id = r->id;
+    emit requestSlice(id, data);
+    // Kopia (o ile wycinek nie jest całym kawałkiem) tylko dla słuchaczy starego API.
+    const bool wantShell = shellStdout && isSignalConnected(shellStdoutSignal);
+    const bool wantData = isSignalConnected(requestDataSignal);
+    const bool wantRaw = !shellStdout && isSignalConnected(rawDataSignal);
+    if (!wantShell && !wantData && !wantRaw) return;
+    const QByteArray bytes = data.toByteArray();
+    if (wantShell && m_requests.contains(id)) emit this->shellStdout(id, bytes);
+    if (wantData && m_requests.contains(id)) emit requestData(id, bytes);
+    if (wantRaw && m_requests.contains(id)) emit rawDataReady(bytes);}
+
+void AdbClient::processPayload(Request *r) {
+    const quint64 id = r->id;
+    if (r->kind == TrackDevices) {
+        while (!r->buffer.isEmpty()) {
+            QByteArray payload;
+            bool malformed = false;
+            if (!takeLengthPrefixed(r, 0, &payload, &malformed)) {
+                if (malformed) failRequest(r, "Błąd protokołu ADB: niepoprawna długość listy urządzeń.");
+                return;}
+            m_trackRetryMs = 0;
+            applyDeviceList(payload);
+            if (!m_requests.contains(id)) return;}
         return;}
-    connectToAdbServer();
-    if (!m_socket->waitForConnected(1000)) {
-        emit adbError("Nie można połączyć się z serwerem ADB (5037).");
+    if (r->kind == ShellV2) {
+        processShellV2Payload(r);
         return;}
-    QElapsedTimer timer;
-    timer.start();
-    QString transportCommand = QString("host:transport:%1").arg(m_targetSerial);
-    writeAdbHeader(transportCommand);
-    if (!m_socket->waitForReadyRead(500)) {
-        emit adbError("Timeout: Brak odpowiedzi po żądaniu transportu.");
+    if (r->kind == HostStatus) {
+        char status[4];
+        if (!r->buffer.peek(status, 4)) return;
+        QByteArray payload;
+        bool malformed = false;
+        if (memcmp(status, "FAIL", 4) == 0) {
+            if (!takeLengthPrefixed(r, 4, &payload, &malformed) && !malformed) return;
+            failRequest(r, QString("Błąd ADB: %1").arg(QString::fromUtf8(payload)));
+            return;}
+        if (memcmp(status, "OKAY", 4) != 0) {
+            failRequest(r, QString("Błąd protokołu ADB: Nieznany status '%1'").arg(QString::fromLatin1(status, 4)));
+            return;}
+        if (r->expectPort && !takeLengthPrefixed(r, 4, &payload, &malformed) && !malformed) return;
+        r->buffer.clear();
+        if (!payload.isEmpty()) {
+            emit requestSlice(id, AdbSlice(payload));
+            if (m_requests.contains(id)) emit requestData(id, payload);}
+        if (m_requests.contains(id)) finishRequest(r);
         return;}
-    if (m_socket->bytesAvailable() >= 4) {
-        QByteArray status = m_socket->read(4);
-        if (status != "OKAY") {
-            if (status == "FAIL") {
-                if (m_socket->waitForReadyRead(500) && m_socket->bytesAvailable() >= 4) {
-                    QByteArray lengthHex = m_socket->read(4);
-                    bool ok;
-                    int length = lengthHex.toInt(&ok, 16);
-                    if (ok && m_socket->waitForReadyRead(500) && m_socket->bytesAvailable() >= length) {
-                        QByteArray errorMsg = m_socket->read(length);
-                        emit adbError(QString("Błąd transportu do %1: %2").arg(m_targetSerial, QString::fromUtf8(errorMsg)));
-                        return;}}}
-            emit adbError(QString("Błąd transportu: nieznany status %1").arg(QString::fromUtf8(status)));
+    if (r->kind == HostQuery) {
+        QByteArray payload;
+        bool malformed = false;
+        if (!takeLengthPrefixed(r, 0, &payload, &malformed)) {
+            if (malformed) failRequest(r, "Błąd protokołu ADB: niepoprawna długość odpowiedzi.");
             return;}
+        r->buffer.clear();
+        emit requestSlice(id, AdbSlice(payload));
+        if (m_requests.contains(id)) emit requestData(id, payload);
+        emit commandResponseReady(payload);
+        if (m_requests.contains(id)) finishRequest(r);
+        return;}
+    // Strumień: każdy odebrany kawałek idzie dalej w całości, bez sklejania.
+    while (m_requests.contains(id) && !r->buffer.isEmpty()) {
+        emitData(r, r->buffer.takeFront(), false);}}
+
+void AdbClient::processShellV2Payload(Request *r) {
+    const quint64 id = r->id;
+    char header[5];
+    while (r->buffer.peek(header, 5)) {
+        const quint8 packetId = static_cast<quint8>(header[0]);
+        const quint32 length = qFromLittleEndian<quint32>(header + 1);
+        if (static_cast<quint64>(r->buffer.size()) < 5 + static_cast<quint64>(length)) return;
+        r->buffer.skip(5);
+        const AdbSlice data = r->buffer.take(length);
+        switch (packetId) {
+        case ShellStdout:
+            emitData(r, data, true);
+            break;
+        case ShellStderr:
+            emit shellStderr(id, data.toByteArray());
+            break;
+        case ShellExit:
+            r->exitCode = data.isEmpty() ? -1 : static_cast<quint8>(*data.constData());
+            emit shellExited(id, r->exitCode);
+            break;
+        default:
+            break;}
+        if (!m_requests.contains(id)) return;}}
+
+void AdbClient::onRequestDisconnected(Request *r) {
+    const quint64 id = r->id;
+    if (r->socket->bytesAvailable() > 0) {
+        onRequestReadyRead(r);
+        if (!m_requests.contains(id)) return;}
+    if (r->state == Payload && (r->kind == DeviceStream || r->kind == ShellV2 || r->kind == TrackDevices)) {
+        finishRequest(r);
+    } else if (r->state == Payload) {
+        failRequest(r, "Błąd ADB: połączenie zamknięte przed końcem odpowiedzi.");
+    } else {
+        failRequest(r, "Błąd ADB: połączenie zamknięte przed odpowiedzią OKAY/FAIL.");}}
+
+void AdbClient::onRequestError(Request *r, QAbstractSocket::SocketError socketError) {
+    // Zamknięcie po stronie adbd to normalny koniec strumienia - obsługuje je onRequestDisconnected.
+    if (socketError == QTcpSocket::RemoteHostClosedError) return;
+    if (r->state == Connecting) {
+        failRequest(r, QString("Nie można połączyć się z serwerem ADB (%1): %2").arg(m_port).arg(r->socket->errorString()));
     } else {
-        emit adbError("Błąd transportu: Niekompletny status OKAY/FAIL.");
+        failRequest(r, QString("Błąd połączenia z ADB: %1").arg(r->socket->errorString()));}}
+
+void AdbClient::onHandshakeSweep() {
+    if (m_requests.isEmpty()) {
+        m_handshakeTimer.stop();
         return;}
-    writeAdbHeader(command);
-    m_state = WaitingForDeviceData;
-    if (command.startsWith("shell:input")) {
-        m_socket->disconnectFromHost();}
-    qDebug() << "Komenda wykonana w (ms):" << timer.elapsed();}
-
-void AdbClient::onReadyRead() {
-    m_readBuffer.append(m_socket->readAll());
-    if (m_state == WaitingForAdbStatus) {
-        processAdbStatus();
-    } else if (m_state == WaitingForDeviceData) {
-        handleDeviceData();}}
-
-void AdbClient::processAdbStatus() {
-    if (m_readBuffer.size() >= 4) {
-        QByteArray status = m_readBuffer.left(4);
-        m_readBuffer.remove(0, 4);
-        if (status == "OKAY") {
-            m_state = WaitingForDeviceData;
-            if (m_socket->bytesAvailable() == 0 && !m_readBuffer.isEmpty()) {
-                emit commandResponseReady(m_readBuffer);
-                m_readBuffer.clear();
-                m_socket->disconnectFromHost();}
-        } else if (status == "FAIL") {
-            if (m_readBuffer.size() >= 4) {
-                QByteArray lengthHex = m_readBuffer.left(4);
-                m_readBuffer.remove(0, 4);
-                bool ok;
-                int length = lengthHex.toInt(&ok, 16);
-
-                if (ok && m_readBuffer.size() >= length) {
-                    QByteArray errorMsg = m_readBuffer.left(length);
-                    m_readBuffer.remove(0, length);
-                    emit adbError(QString("Błąd ADB: %1").arg(QString::fromUtf8(errorMsg)));
-                } else {
-                    emit adbError("Błąd ADB: Niekompletna wiadomość o błędzie.");}}
-            m_state = Idle;
-            m_socket->disconnectFromHost();
-        } else {
-            emit adbError(QString("Błąd protokołu ADB: Nieznany status '%1'").arg(QString::fromUtf8(status)));
-            m_state = Idle;
-            m_socket->disconnectFromHost();}}}
-
-void AdbClient::handleDeviceData() {
-    if (!m_readBuffer.isEmpty()) {
-        emit rawDataReady(m_readBuffer);
-        m_readBuffer.clear();}
-    if (m_socket->state() == QAbstractSocket::UnconnectedState) {
-        m_state = Idle;}}
+    const QList<quint64> ids = m_requests.keys();
+    for (quint64 id : ids) {
+        Request *r = m_requests.value(id, nullptr);
+        if (!r || r->state == Payload || r->state == Closed) continue;
+        if (r->phaseTimer.elapsed() > m_handshakeTimeoutMs) {
+            failRequest(r, QString("Timeout: brak odpowiedzi w stanie %1.").arg(static_cast<int>(r->state)));}}}
+
+bool AdbClient::write(quint64 id, const QByteArray &data) {
+    Request *r = m_requests.value(id, nullptr);
+    if (!r || r->state != Payload) return false;
+    if (r->stream) return r->stream->write(data);
+    return r->socket->write(data) == data.size();}
+
+qint64 AdbClient::bytesToWrite(quint64 id) const {
+    const Request *r = m_requests.value(id, nullptr);
+    if (!r) return 0;
+    return r->stream ? r->stream->bytesToWrite() : r->socket->bytesToWrite();}
+
+void AdbClient::close(quint64 id) {
+    Request *r = m_requests.value(id, nullptr);
+    if (!r) return;
+    if (r->state == Payload && r->stream) {
+        r->stream->close();
+    } else if (r->state == Payload) {
+        r->socket->disconnectFromHost();
+    } else {
+        destroyRequest(r);}}
+
+void AdbClient::cancel(quint64 id) {
+    Request *r = m_requests.value(id, nullptr);
+    if (r) destroyRequest(r);}
+
+void AdbClient::cancelAll() {
+    const QList<Request*> requests = m_requests.values();
+    for (Request *r : requests) {
+        destroyRequest(r);}}
+
+void AdbClient::finishRequest(Request *r) {
+    const quint64 id = r->id;
+    r->state = Closed;
+    destroyRequest(r);
+    emit requestStateChanged(id, Closed);
+    emit requestFinished(id);}
+
+void AdbClient::failRequest(Request *r, const QString &message) {
+    const quint64 id = r->id;
+    r->state = Closed;
+    destroyRequest(r);
+    emit requestStateChanged(id, Closed);
+    emit requestFailed(id, message);
+    emit adbError(message);}
+
+void AdbClient::destroyRequest(Request *r) {
+    m_requests.remove(r->id);
+    if (r->socket) {
+        r->socket->disconnect(this);
+        r->socket->abort();
+        r->socket->deleteLater();}
+    if (r->stream) {
+        r->stream->disconnect(this);
+        r->stream->abort();}
+    delete r;}
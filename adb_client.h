@@ -1,44 +1,183 @@
 #pragma once
 #include <QObject>
 #include <QTcpSocket>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "adb_transport_pool.h"
+#include "adbd_connection.h"
+#include "adb_buffer.h"
 
+struct AdbDevice {
+    QString serial;
+    QString state;          // device, offline, unauthorized, recovery, ...
+    QString product;
+    QString model;
+    QString device;
+    QString transportId;
+    bool isOnline() const { return state == QLatin1String("device"); }
+    bool operator==(const AdbDevice &o) const {
+        return serial == o.serial && state == o.state && product == o.product &&
+               model == o.model && device == o.device && transportId == o.transportId;}
+};
+Q_DECLARE_METATYPE(AdbDevice)
+
+// Klient "smart socket" serwera ADB. Każde żądanie ma własny identyfikator i własne
+// gniazdo, a całą wymianę (connect, transport, OKAY/FAIL, payload, close) prowadzi
+// maszyna stanów sterowana sygnałami gniazda - nic tu nie czeka na wątku wywołującym.
 class AdbClient : public QObject {
     Q_OBJECT
 public:
+    enum RequestState {
+        Connecting,        // connectToHost w toku
+        TransportRequest,  // wysłano host:transport:<serial>, czekamy na OKAY/FAIL
+        ServiceRequest,    // wysłano usługę, czekamy na OKAY/FAIL
+        Payload,           // usługa zaakceptowana, płyną dane
+        Closed
+    };
+    Q_ENUM(RequestState)
+
     explicit AdbClient(QObject *parent = nullptr);
+    ~AdbClient() override;
+
     void setTargetDevice(const QString &serial);
     QString targetDevice() const { return m_targetSerial; }
-    void connectToAdbServer(const QString &host = "127.0.0.1", quint16 port = 5037);
-    void sendAdbCommand(const QString &command);
-    void sendDeviceCommand(const QString &command);
+    void setServer(const QString &host = "127.0.0.1", quint16 port = 5037);
+    void setHandshakeTimeoutMs(int ms) { m_handshakeTimeoutMs = ms; }
+    AdbTransportPool *transportPool() const { return m_pool; }
+    // Urządzenia TCP ("host:port") obsługiwane bezpośrednio przez adbd, z pominięciem serwera ADB.
+    // Dotyczy usług urządzenia (shell:, shell,v2, sync:, exec:); usługi host:* zawsze idą przez serwer.
+    void setDirectTransport(bool enabled);
+    bool directTransport() const { return m_directEnabled; }
+    void setDirectKeyPath(const QString &path) { m_directKeyPath = path; }
+    bool isDirect(const QString &serial) const;
+
+    // Usługa hosta (host:version, host:devices-l, ...): OKAY + 4-znakowa długość + dane.
+    quint64 sendAdbCommand(const QString &command);
+    // Usługa urządzenia (shell:, exec:, ...) - dane płyną aż do zamknięcia strumienia.
+    quint64 sendDeviceCommand(const QString &command);
+    quint64 sendDeviceCommand(const QString &serial, const QString &command);
+    // shell,v2: ramki [id:1][len:4 LE][dane] - osobne stdout/stderr i prawdziwy kod wyjścia.
+    quint64 sendShellV2(const QString &serial, const QString &command, const QByteArray &stdinData = QByteArray());
+    // Przekierowania portów: OKAY (połączenie) + OKAY/FAIL (status); dla tcp:0 dodatkowo przydzielony port.
+    quint64 forward(const QString &serial, const QString &local, const QString &remote, bool noRebind = false);
+    quint64 killForward(const QString &serial, const QString &local);
+    quint64 listForwards();
+    // Dwukierunkowe usługi (sync:, ...) - zapis w stanie Payload, zamknięcie z opróżnieniem bufora.
+    bool write(quint64 id, const QByteArray &data);
+    qint64 bytesToWrite(quint64 id) const;
+    void close(quint64 id);
+    void cancel(quint64 id);
+    void cancelAll();
+    int pendingCount() const { return m_requests.size(); }
+    RequestState requestState(quint64 id) const;
+
+    // Długo żyjąca subskrypcja host:track-devices-l i rejestr urządzeń (zapytania O(1)).
+    void startDeviceTracking();
+    void stopDeviceTracking();
+    bool isTrackingDevices() const { return m_trackRequest != 0; }
+    bool hasDevice(const QString &serial) const { return m_devices.contains(serial); }
+    AdbDevice device(const QString &serial) const { return m_devices.value(serial); }
+    QList<AdbDevice> devices() const;
 
 signals:
-    void adbConnected();
-    void adbDisconnected();
-    void commandResponseReady(const QByteArray &response); 
+    void requestStateChanged(quint64 id, AdbClient::RequestState state);
+    void requestData(quint64 id, const QByteArray &data);
+    // To samo co requestData (i stdout shell,v2), ale bez kopii - wycinek współdzieli pamięć
+    // z odebranym kawałkiem. requestData/shellStdout są emitowane tylko, gdy ktoś ich słucha.
+    void requestSlice(quint64 id, const AdbSlice &data);
+    void requestBytesWritten(quint64 id, qint64 bytes);
+    void requestFinished(quint64 id);
+    void requestFailed(quint64 id, const QString &message);
+    // FAIL na etapie usługi (np. urządzenie bez shell_v2) - emitowany przed requestFailed.
+    void serviceRejected(quint64 id, const QString &service, const QString &message);
+    void shellStdout(quint64 id, const QByteArray &data);
+    void shellStderr(quint64 id, const QByteArray &data);
+    void shellExited(quint64 id, int exitCode);
+
+    void deviceAdded(const AdbDevice &device);
+    void deviceRemoved(const QString &serial);
+    void deviceStateChanged(const QString &serial, const QString &oldState, const QString &newState);
+    void devicesChanged();
+    void deviceTrackingLost(const QString &message);
+
+    void commandResponseReady(const QByteArray &response);
     void rawDataReady(const QByteArray &data);
     void adbError(const QString &message);
 
 private slots:
-    void onConnected();
-    void onDisconnected();
-    void onReadyRead();
-    void onErrorOccurred(QTcpSocket::SocketError socketError);
+    void onHandshakeSweep();
+    void onTrackRequestFinished(quint64 id);
+    void onTrackRequestFailed(quint64 id, const QString &message);
 
 private:
-    enum State {
-        Idle,
-        WaitingForAdbStatus,
-        WaitingForDeviceData
+    enum Kind {
+        HostQuery,
+        DeviceStream,
+        ShellV2,
+        TrackDevices,
+        HostStatus
     };
-    State m_state = Idle;
-    
-    QTcpSocket *m_socket;
-    QByteArray m_readBuffer;
+    enum ShellPacketId : quint8 {
+        ShellStdin = 0,
+        ShellStdout = 1,
+        ShellStderr = 2,
+        ShellExit = 3,
+        ShellCloseStdin = 4
+    };
+    struct Request {
+        quint64 id = 0;
+        Kind kind = DeviceStream;
+        QString serial;
+        QString service;
+        RequestState state = Connecting;
+        QTcpSocket *socket = nullptr;
+        AdbdStream *stream = nullptr;
+        AdbChunkBuffer buffer;
+        QByteArray stdinData;
+        int exitCode = -1;
+        bool expectPort = false;
+        QElapsedTimer phaseTimer;
+    };
+
     QString m_targetSerial;
+    QString m_host = QStringLiteral("127.0.0.1");
+    quint16 m_port = 5037;
+    int m_handshakeTimeoutMs = 5000;
+    quint64 m_nextId = 1;
+    QHash<quint64, Request*> m_requests;
+    AdbTransportPool *m_pool;
+    QTimer m_handshakeTimer;
+    quint64 m_trackRequest = 0;
+    bool m_trackingWanted = false;
+    int m_trackRetryMs = 0;
+    QHash<QString, AdbDevice> m_devices;
+    bool m_directEnabled = false;
+    QString m_directKeyPath;
+    QHash<QString, AdbdConnection*> m_direct;
 
-    // Funkcje protokołu
-    void writeAdbHeader(const QString &command);
-    void processAdbStatus();
-    void handleDeviceData();
+    quint64 startRequest(Kind kind, const QString &serial, const QString &service);
+    void attachSocket(Request *r, QTcpSocket *socket);
+    void attachStream(Request *r, AdbdStream *stream);
+    AdbdConnection *directConnection(const QString &serial);
+    void beginPayload(Request *r);
+    void writeRaw(Request *r, const QByteArray &data);
+    void onStreamClosed(Request *r, bool rejected, const QString &message);
+    void setState(Request *r, RequestState state);
+    void writeAdbHeader(QTcpSocket *socket, const QString &command);
+    void onRequestConnected(Request *r);
+    void onRequestReadyRead(Request *r);
+    void onRequestDisconnected(Request *r);
+    void onRequestError(Request *r, QAbstractSocket::SocketError socketError);
+    bool processStatus(Request *r);
+    void processPayload(Request *r);
+    void processShellV2Payload(Request *r);
+    bool takeLengthPrefixed(Request *r, int headerOffset, QByteArray *payload, bool *malformed);
+    void emitData(Request *r, const AdbSlice &data, bool shellStdout);
+    void applyDeviceList(const QByteArray &payload);
+    void clearDevices();
+    void writeShellPacket(Request *r, ShellPacketId packetId, const QByteArray &data);
+    void finishRequest(Request *r);
+    void failRequest(Request *r, const QString &message);
+    void destroyRequest(Request *r);
 };
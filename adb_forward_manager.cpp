@@ -0,0 +1,126 @@
+#include "adb_forward_manager.h"
+#include <QDebug>
+#include <QTimer>
+#include <QMetaObject>
+
+AdbForwardManager::AdbForwardManager(AdbClient *client, QObject *parent)
+    : QObject(parent), m_client(client) {
+    connect(m_client, &AdbClient::requestSlice, this, &AdbForwardManager::onRequestData);
+    connect(m_client, &AdbClient::requestFinished, this, &AdbForwardManager::onRequestFinished);
+    connect(m_client, &AdbClient::requestFailed, this, &AdbForwardManager::onRequestFailed);}
+
+AdbForwardManager::~AdbForwardManager() {
+    // Przekierowania czekające na linger usuwamy od razu - po nas nikt ich nie zwolni.
+    if (!m_client) return;
+    for (auto it = m_forwards.constBegin(); it != m_forwards.constEnd(); ++it) {
+        if (!it->adopted && it->refs == 0 && it->state == Active) {
+            m_client->killForward(it->serial, QString("tcp:%1").arg(it->localPort));}}}
+
+void AdbForwardManager::acquire(const QString &serial, quint16 localPort, quint16 remotePort) {
+    auto it = m_forwards.find(localPort);
+    if (it != m_forwards.end() && it->serial == serial && it->remotePort == remotePort && it->state != Removing) {
+        it->refs++;
+        it->generation = ++m_generation;
+        if (it->state == Active) {
+            QMetaObject::invokeMethod(this, [this, serial, localPort]() {
+                emit forwardReady(serial, localPort, true, QStringLiteral("reused"));
+            }, Qt::QueuedConnection);}
+        return;}
+    if (it != m_forwards.end() && it->refs > 0) {
+        qWarning() << "AdbForwardManager: port" << localPort << "przepinany z" << it->serial << "na" << serial;}
+    Forward f;
+    f.serial = serial;
+    f.localPort = localPort;
+    f.remotePort = remotePort;
+    f.refs = 1;
+    f.generation = ++m_generation;
+    m_forwards.insert(localPort, f);
+    install(m_forwards[localPort]);}
+
+void AdbForwardManager::release(const QString &serial, quint16 localPort) {
+    auto it = m_forwards.find(localPort);
+    if (it == m_forwards.end() || it->serial != serial) return;
+    it->refs = qMax(0, it->refs - 1);
+    if (it->refs == 0 && !it->adopted) scheduleRemoval(localPort);}
+
+void AdbForwardManager::refresh() {
+    if (m_listRequest) return;
+    m_listRequest = m_client->listForwards();}
+
+bool AdbForwardManager::isActive(const QString &serial, quint16 localPort) const {
+    auto it = m_forwards.constFind(localPort);
+    return it != m_forwards.constEnd() && it->serial == serial && it->state == Active;}
+
+int AdbForwardManager::refCount(quint16 localPort) const {
+    return m_forwards.value(localPort).refs;}
+
+void AdbForwardManager::install(Forward &f) {
+    f.state = Pending;
+    f.request = m_client->forward(f.serial, QString("tcp:%1").arg(f.localPort), QString("tcp:%1").arg(f.remotePort));
+    m_requests.insert(f.request, f.localPort);}
+
+void AdbForwardManager::scheduleRemoval(quint16 localPort) {
+    const quint64 gen = ++m_generation;
+    m_forwards[localPort].generation = gen;
+    QTimer::singleShot(m_lingerMs, this, [this, localPort, gen]() {
+        auto it = m_forwards.find(localPort);
+        if (it == m_forwards.end() || it->generation != gen || it->refs > 0) return;
+        it->state = Removing;
+        const quint64 id = m_client->killForward(it->serial, QString("tcp:%1").arg(localPort));
+        m_requests.insert(id, localPort);});}
+
+void AdbForwardManager::onRequestData(quint64 id, const AdbSlice &data) {
+    if (id == m_listRequest) parseForwardList(data.toByteArray());}
+
+void AdbForwardManager::onRequestFinished(quint64 id) {
+    if (id == m_listRequest) {
+        m_listRequest = 0;
+        return;}
+    if (!m_requests.contains(id)) return;
+    const quint16 localPort = m_requests.take(id);
+    auto it = m_forwards.find(localPort);
+    if (it == m_forwards.end()) return;
+    if (it->request == id) {
+        it->request = 0;
+        it->state = Active;
+        emit forwardReady(it->serial, localPort, true, QString());
+        return;}
+    if (it->state == Removing) {
+        const QString serial = it->serial;
+        m_forwards.erase(it);
+        emit forwardRemoved(serial, localPort);
+    } else if (it->state == Active) {
+        // Ktoś przejął port w trakcie killforward - zakładamy przekierowanie ponownie.
+        install(*it);}}
+
+void AdbForwardManager::onRequestFailed(quint64 id, const QString &message) {
+    if (id == m_listRequest) {
+        m_listRequest = 0;
+        return;}
+    if (!m_requests.contains(id)) return;
+    const quint16 localPort = m_requests.take(id);
+    auto it = m_forwards.find(localPort);
+    if (it == m_forwards.end()) return;
+    const QString serial = it->serial;
+    const bool wasInstall = (it->request == id);
+    m_forwards.erase(it);
+    if (wasInstall) {
+        emit forwardReady(serial, localPort, false, message);
+    } else {
+        emit forwardRemoved(serial, localPort);}}
+
+void AdbForwardManager::parseForwardList(const QByteArray &payload) {
+    // Format: "<serial> tcp:<local> tcp:<remote>\n" na każde przekierowanie.
+    const QList<QByteArray> lines = payload.split('\n');
+    for (const QByteArray &line : lines) {
+        const QList<QByteArray> parts = line.simplified().split(' ');
+        if (parts.size() < 3 || !parts.at(1).startsWith("tcp:") || !parts.at(2).startsWith("tcp:")) continue;
+        const quint16 localPort = parts.at(1).mid(4).toUShort();
+        if (localPort == 0 || m_forwards.contains(localPort)) continue;
+        Forward f;
+        f.serial = QString::fromUtf8(parts.at(0));
+        f.localPort = localPort;
+        f.remotePort = parts.at(2).mid(4).toUShort();
+        f.state = Active;
+        f.adopted = true;
+        m_forwards.insert(localPort, f);}}
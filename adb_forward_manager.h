@@ -0,0 +1,57 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include "adb_client.h"
+
+// Przekierowania tcp:<local> -> tcp:<remote> liczone referencjami. Port lokalny hosta
+// jest globalny, więc kluczem jest port; ten sam serial/port zdalny jest współdzielony,
+// a killforward idzie dopiero po zwolnieniu ostatniej referencji i upływie lingerMs.
+class AdbForwardManager : public QObject {
+    Q_OBJECT
+public:
+    explicit AdbForwardManager(AdbClient *client, QObject *parent = nullptr);
+    ~AdbForwardManager() override;
+
+    void setLingerMs(int ms) { m_lingerMs = qMax(0, ms); }
+    void acquire(const QString &serial, quint16 localPort, quint16 remotePort);
+    void release(const QString &serial, quint16 localPort);
+    // host:list-forward - przejmuje przekierowania założone wcześniej przez inne procesy.
+    void refresh();
+    bool isActive(const QString &serial, quint16 localPort) const;
+    int refCount(quint16 localPort) const;
+
+signals:
+    void forwardReady(const QString &serial, quint16 localPort, bool ok, const QString &message);
+    void forwardRemoved(const QString &serial, quint16 localPort);
+
+private slots:
+    void onRequestData(quint64 id, const AdbSlice &data);
+    void onRequestFinished(quint64 id);
+    void onRequestFailed(quint64 id, const QString &message);
+
+private:
+    enum State { Pending, Active, Removing };
+    struct Forward {
+        QString serial;
+        quint16 localPort = 0;
+        quint16 remotePort = 0;
+        int refs = 0;
+        State state = Pending;
+        bool adopted = false;
+        quint64 request = 0;
+        quint64 generation = 0;
+    };
+
+    // Klient bywa niszczony wcześniej (kolejność dzieci wspólnego rodzica).
+    QPointer<AdbClient> m_client;
+    int m_lingerMs = 3000;
+    quint64 m_generation = 0;
+    quint64 m_listRequest = 0;
+    QHash<quint16, Forward> m_forwards;
+    QHash<quint64, quint16> m_requests;
+
+    void install(Forward &f);
+    void scheduleRemoval(quint16 localPort);
+    void parseForwardList(const QByteArray &payload);
+};
@@ -0,0 +1,289 @@
+#include "adb_sync.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QMetaObject>
+#include <QtEndian>
+
+static const int SYNC_DATA_MAX = 64 * 1024;
+static const qint64 SYNC_WRITE_HIGH_WATER = 256 * 1024;
+static const quint32 S_IFREG_BITS = 0100000;
+
+static QString shellQuote(const QString &path) {
+    QString quoted = path;
+    quoted.replace("'", "'\\''");
+    return QString("'%1'").arg(quoted);}
+
+AdbSync::AdbSync(AdbClient *client, QObject *parent) : QObject(parent), m_client(client) {
+    connect(m_client, &AdbClient::requestStateChanged, this, &AdbSync::onRequestStateChanged);
+    connect(m_client, &AdbClient::requestSlice, this, &AdbSync::onRequestData);
+    connect(m_client, &AdbClient::requestBytesWritten, this, &AdbSync::onRequestBytesWritten);
+    connect(m_client, &AdbClient::requestFinished, this, &AdbSync::onRequestFinished);
+    connect(m_client, &AdbClient::requestFailed, this, &AdbSync::onRequestFailed);
+    connect(m_client, &AdbClient::shellExited, this, &AdbSync::onShellExited);}
+
+AdbSync::~AdbSync() {
+    const QList<quint64> ops = m_ops.keys();
+    for (quint64 id : ops) cancel(id);}
+
+quint64 AdbSync::stat(const QString &serial, const QString &remotePath) {
+    return startOp(StatOnly, serial, QString(), remotePath, 0);}
+
+quint64 AdbSync::push(const QString &serial, const QString &localPath, const QString &remotePath, quint32 mode) {
+    return startOp(Push, serial, localPath, remotePath, mode);}
+
+quint64 AdbSync::pull(const QString &serial, const QString &remotePath, const QString &localPath) {
+    return startOp(Pull, serial, localPath, remotePath, 0);}
+
+quint64 AdbSync::deploy(const QString &serial, const QString &localPath, const QString &remotePath, quint32 mode) {
+    return startOp(Deploy, serial, localPath, remotePath, mode);}
+
+quint64 AdbSync::startOp(Mode mode, const QString &serial, const QString &localPath, const QString &remotePath, quint32 fileMode) {
+    Op *op = new Op;
+    op->id = m_nextOp++;
+    op->mode = mode;
+    op->serial = serial;
+    op->localPath = localPath;
+    op->remotePath = remotePath;
+    op->fileMode = fileMode;
+    op->timer.start();
+    m_ops.insert(op->id, op);
+    if (mode == Push || mode == Deploy) {
+        QFileInfo info(localPath);
+        if (!info.exists()) {
+            const quint64 id = op->id;
+            QMetaObject::invokeMethod(this, [this, id, localPath]() {
+                if (Op *o = m_ops.value(id, nullptr)) completeOp(o, false, false, QString("Brak pliku lokalnego: %1").arg(localPath));
+            }, Qt::QueuedConnection);
+            return op->id;}
+        op->total = info.size();
+        op->localMtime = static_cast<quint32>(info.lastModified().toSecsSinceEpoch());}
+    op->syncRequest = m_client->sendDeviceCommand(serial, "sync:");
+    if (op->syncRequest == 0) {
+        const quint64 id = op->id;
+        QMetaObject::invokeMethod(this, [this, id]() {
+            if (Op *o = m_ops.value(id, nullptr)) completeOp(o, false, false, "Nie można otworzyć usługi sync:");
+        }, Qt::QueuedConnection);
+        return op->id;}
+    m_byRequest.insert(op->syncRequest, op);
+    return op->id;}
+
+void AdbSync::cancel(quint64 opId) {
+    Op *op = m_ops.value(opId, nullptr);
+    if (!op) return;
+    if (op->syncRequest) m_client->cancel(op->syncRequest);
+    if (op->hashRequest) m_client->cancel(op->hashRequest);
+    completeOp(op, false, false, "Anulowano.");}
+
+void AdbSync::sendSyncHeader(Op *op, const char id[4], quint32 value) {
+    char header[8];
+    memcpy(header, id, 4);
+    qToLittleEndian<quint32>(value, header + 4);
+    m_client->write(op->syncRequest, QByteArray(header, sizeof(header)));}
+
+void AdbSync::sendSyncPacket(Op *op, const char id[4], const QByteArray &payload) {
+    sendSyncHeader(op, id, static_cast<quint32>(payload.size()));
+    if (!payload.isEmpty()) m_client->write(op->syncRequest, payload);}
+
+void AdbSync::onRequestStateChanged(quint64 id, AdbClient::RequestState state) {
+    if (state != AdbClient::Payload) return;
+    Op *op = m_byRequest.value(id, nullptr);
+    if (!op || op->syncRequest != id || op->stage != Opening) return;
+    switch (op->mode) {
+    case StatOnly:
+    case Deploy:
+        beginStat(op);
+        break;
+    case Push:
+        beginSend(op);
+        break;
+    case Pull:
+        beginRecv(op);
+        break;}}
+
+void AdbSync::beginStat(Op *op) {
+    op->stage = WaitStat;
+    sendSyncPacket(op, "STAT", op->remotePath.toUtf8());}
+
+void AdbSync::beginSend(Op *op) {
+    op->file = new QFile(op->localPath);
+    if (!op->file->open(QIODevice::ReadOnly)) {
+        completeOp(op, false, false, QString("Nie można otworzyć %1: %2").arg(op->localPath, op->file->errorString()));
+        return;}
+    op->stage = Sending;
+    op->done = 0;
+    const quint32 mode = S_IFREG_BITS | (op->fileMode & 0777);
+    sendSyncPacket(op, "SEND", QString("%1,%2").arg(op->remotePath).arg(mode).toUtf8());
+    pumpSend(op);}
+
+void AdbSync::beginRecv(Op *op) {
+    op->file = new QFile(op->localPath);
+    if (!op->file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        completeOp(op, false, false, QString("Nie można zapisać %1: %2").arg(op->localPath, op->file->errorString()));
+        return;}
+    op->stage = Receiving;
+    op->done = 0;
+    sendSyncPacket(op, "RECV", op->remotePath.toUtf8());}
+
+void AdbSync::pumpSend(Op *op) {
+    // Dokładamy DATA tylko do progu bufora gniazda - duże pliki nie lądują w całości w pamięci.
+    while (op->stage == Sending && m_client->bytesToWrite(op->syncRequest) < SYNC_WRITE_HIGH_WATER) {
+        if (op->file->atEnd()) {
+            op->file->close();
+            sendSyncHeader(op, "DONE", op->localMtime);
+            op->stage = WaitSendStatus;
+            return;}
+        const QByteArray chunk = op->file->read(SYNC_DATA_MAX);
+        if (chunk.isEmpty()) {
+            completeOp(op, false, false, QString("Błąd odczytu %1").arg(op->localPath));
+            return;}
+        sendSyncPacket(op, "DATA", chunk);
+        op->done += chunk.size();
+        emit transferProgress(op->id, op->done, op->total);}}
+
+void AdbSync::onRequestBytesWritten(quint64 id, qint64) {
+    Op *op = m_byRequest.value(id, nullptr);
+    if (op && op->stage == Sending) pumpSend(op);}
+
+void AdbSync::onRequestData(quint64 id, const AdbSlice &data) {
+    Op *op = m_byRequest.value(id, nullptr);
+    if (op && op->hashRequest == id) {
+        op->hashOutput.append(data.view());
+        return;}
+    if (!op || op->syncRequest != id) return;
+    op->buffer.append(data.toByteArray());
+    processBuffer(op);}
+
+void AdbSync::processBuffer(Op *op) {
+    const quint64 opId = op->id;
+    char header[16];
+    while (m_ops.contains(opId) && op->buffer.peek(header, 8)) {
+        const QByteArray id(header, 4);
+        const quint32 value = qFromLittleEndian<quint32>(header + 4);
+        if (id == "FAIL") {
+            if (static_cast<quint64>(op->buffer.size()) < 8 + static_cast<quint64>(value)) return;
+            op->buffer.skip(8);
+            completeOp(op, false, false, QString("sync FAIL: %1").arg(QString::fromUtf8(op->buffer.take(value).view())));
+            return;}
+        if (op->stage == WaitStat) {
+            if (!op->buffer.peek(header, 16)) return;
+            if (id != "STAT") {
+                completeOp(op, false, false, QString("sync: nieoczekiwana odpowiedź %1").arg(QString::fromLatin1(id)));
+                return;}
+            const quint32 mode = value;
+            const quint32 size = qFromLittleEndian<quint32>(header + 8);
+            const quint32 mtime = qFromLittleEndian<quint32>(header + 12);
+            op->buffer.skip(16);
+            handleStat(op, mode, size, mtime);
+        } else if (op->stage == WaitSendStatus) {
+            if (id != "OKAY") {
+                completeOp(op, false, false, QString("sync: nieoczekiwana odpowiedź %1").arg(QString::fromLatin1(id)));
+                return;}
+            op->buffer.skip(8);
+            m_verified.insert(op->serial + ':' + op->remotePath, localSha256(op->localPath));
+            sendSyncHeader(op, "QUIT", 0);
+            completeOp(op, true, false, QString("Wysłano %1 B w %2 ms").arg(op->done).arg(op->timer.elapsed()));
+        } else if (op->stage == Receiving) {
+            if (id == "DONE") {
+                op->buffer.skip(8);
+                op->file->close();
+                sendSyncHeader(op, "QUIT", 0);
+                completeOp(op, true, false, QString("Pobrano %1 B w %2 ms").arg(op->done).arg(op->timer.elapsed()));
+            } else if (id == "DATA") {
+                if (static_cast<quint64>(op->buffer.size()) < 8 + static_cast<quint64>(value)) return;
+                op->buffer.skip(8);
+                const AdbSlice data = op->buffer.take(value);
+                op->file->write(data.constData(), data.size());
+                op->done += value;
+                emit transferProgress(op->id, op->done, -1);
+            } else {
+                completeOp(op, false, false, QString("sync: nieoczekiwana odpowiedź %1").arg(QString::fromLatin1(id)));
+                return;}
+        } else {
+            return;}}}
+
+void AdbSync::handleStat(Op *op, quint32 mode, quint32 size, quint32 mtime) {
+    emit statReady(op->id, mode, size, mtime);
+    if (op->mode == StatOnly) {
+        sendSyncHeader(op, "QUIT", 0);
+        completeOp(op, mode != 0, false, mode != 0 ? QString() : QString("Brak pliku: %1").arg(op->remotePath));
+        return;}
+    // Deploy: inny rozmiar albo brak pliku -> wysyłka bez liczenia skrótów.
+    if (mode == 0 || static_cast<qint64>(size) != op->total) {
+        beginSend(op);
+        return;}
+    op->localHash = localSha256(op->localPath);
+    const QString key = op->serial + ':' + op->remotePath;
+    if (mtime == op->localMtime && m_verified.value(key) == op->localHash) {
+        sendSyncHeader(op, "QUIT", 0);
+        completeOp(op, true, true, "Plik na urządzeniu aktualny (rozmiar/mtime/SHA-256).");
+        return;}
+    op->stage = WaitHash;
+    op->hashOutput.clear();
+    op->hashRequest = m_client->sendShellV2(op->serial, QString("sha256sum %1").arg(shellQuote(op->remotePath)));
+    if (op->hashRequest == 0) {
+        beginSend(op);
+        return;}
+    m_byRequest.insert(op->hashRequest, op);}
+
+void AdbSync::onShellExited(quint64 id, int exitCode) {
+    Op *op = m_byRequest.value(id, nullptr);
+    if (!op || op->hashRequest != id) return;
+    if (exitCode != 0) op->hashOutput.clear();}
+
+void AdbSync::onRequestFinished(quint64 id) {
+    Op *op = m_byRequest.take(id);
+    if (!op) return;
+    if (op->hashRequest == id) {
+        op->hashRequest = 0;
+        const QByteArray remoteHash = op->hashOutput.trimmed().split(' ').value(0).toLower();
+        if (!remoteHash.isEmpty() && remoteHash == op->localHash.toHex()) {
+            m_verified.insert(op->serial + ':' + op->remotePath, op->localHash);
+            sendSyncHeader(op, "QUIT", 0);
+            completeOp(op, true, true, "Plik na urządzeniu aktualny (SHA-256).");
+        } else {
+            beginSend(op);}
+        return;}
+    op->syncRequest = 0;
+    if (op->stage != Done) completeOp(op, false, false, "sync: połączenie zamknięte przed końcem transferu.");}
+
+void AdbSync::onRequestFailed(quint64 id, const QString &message) {
+    Op *op = m_byRequest.take(id);
+    if (!op) return;
+    if (op->hashRequest == id) {
+        op->hashRequest = 0;
+        beginSend(op);
+        return;}
+    op->syncRequest = 0;
+    completeOp(op, false, false, message);}
+
+QByteArray AdbSync::localSha256(const QString &path) {
+    QFileInfo info(path);
+    LocalHashEntry &entry = m_localHashes[path];
+    const qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    if (!entry.sha256.isEmpty() && entry.size == info.size() && entry.mtime == mtime) {
+        return entry.sha256;}
+    QFile file(path);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (file.open(QIODevice::ReadOnly)) hash.addData(&file);
+    entry.size = info.size();
+    entry.mtime = mtime;
+    entry.sha256 = hash.result();
+    return entry.sha256;}
+
+void AdbSync::completeOp(Op *op, bool ok, bool skipped, const QString &message) {
+    const quint64 id = op->id;
+    op->stage = Done;
+    m_ops.remove(id);
+    if (op->syncRequest) {
+        m_byRequest.remove(op->syncRequest);
+        m_client->close(op->syncRequest);}
+    if (op->hashRequest) {
+        m_byRequest.remove(op->hashRequest);
+        m_client->cancel(op->hashRequest);}
+    if (op->file) {
+        op->file->close();
+        delete op->file;}
+    delete op;
+    emit finished(id, ok, skipped, message);}
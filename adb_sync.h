@@ -0,0 +1,83 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QFile>
+#include <QElapsedTimer>
+#include "adb_client.h"
+
+// Protokół sync: (STAT/SEND/RECV/DATA/DONE/QUIT) na strumieniu AdbClient.
+// deploy() wysyła plik tylko wtedy, gdy rozmiar, mtime albo SHA-256 na urządzeniu
+// różnią się od pliku lokalnego.
+class AdbSync : public QObject {
+    Q_OBJECT
+public:
+    explicit AdbSync(AdbClient *client, QObject *parent = nullptr);
+    ~AdbSync() override;
+
+    quint64 stat(const QString &serial, const QString &remotePath);
+    quint64 push(const QString &serial, const QString &localPath, const QString &remotePath, quint32 mode = 0644);
+    quint64 pull(const QString &serial, const QString &remotePath, const QString &localPath);
+    quint64 deploy(const QString &serial, const QString &localPath, const QString &remotePath, quint32 mode = 0644);
+    void cancel(quint64 op);
+
+signals:
+    void statReady(quint64 op, quint32 mode, quint32 size, quint32 mtime);
+    void transferProgress(quint64 op, qint64 done, qint64 total);
+    void finished(quint64 op, bool ok, bool skipped, const QString &message);
+
+private slots:
+    void onRequestStateChanged(quint64 id, AdbClient::RequestState state);
+    void onRequestData(quint64 id, const AdbSlice &data);
+    void onRequestBytesWritten(quint64 id, qint64 bytes);
+    void onRequestFinished(quint64 id);
+    void onRequestFailed(quint64 id, const QString &message);
+    void onShellExited(quint64 id, int exitCode);
+
+private:
+    enum Mode { StatOnly, Push, Pull, Deploy };
+    enum Stage { Opening, WaitStat, WaitHash, Sending, WaitSendStatus, Receiving, Done };
+    struct Op {
+        quint64 id = 0;
+        Mode mode = StatOnly;
+        Stage stage = Opening;
+        QString serial;
+        QString localPath;
+        QString remotePath;
+        quint32 fileMode = 0644;
+        quint64 syncRequest = 0;
+        quint64 hashRequest = 0;
+        AdbChunkBuffer buffer;
+        QByteArray hashOutput;
+        QByteArray localHash;
+        QFile *file = nullptr;
+        qint64 total = 0;
+        qint64 done = 0;
+        quint32 localMtime = 0;
+        QElapsedTimer timer;
+    };
+    struct LocalHashEntry {
+        qint64 size = 0;
+        qint64 mtime = 0;
+        QByteArray sha256;
+    };
+
+    AdbClient *m_client;
+    quint64 m_nextOp = 1;
+    QHash<quint64, Op*> m_ops;
+    QHash<quint64, Op*> m_byRequest;
+    QHash<QString, LocalHashEntry> m_localHashes;
+    // serial + ścieżka zdalna -> SHA-256 ostatnio zweryfikowanej kopii
+    QHash<QString, QByteArray> m_verified;
+
+    quint64 startOp(Mode mode, const QString &serial, const QString &localPath, const QString &remotePath, quint32 fileMode);
+    void sendSyncPacket(Op *op, const char id[4], const QByteArray &payload);
+    void sendSyncHeader(Op *op, const char id[4], quint32 value);
+    void beginStat(Op *op);
+    void beginSend(Op *op);
+    void beginRecv(Op *op);
+    void pumpSend(Op *op);
+    void handleStat(Op *op, quint32 mode, quint32 size, quint32 mtime);
+    void processBuffer(Op *op);
+    QByteArray localSha256(const QString &path);
+    void completeOp(Op *op, bool ok, bool skipped, const QString &message);
+};
@@ -0,0 +1,168 @@
+#include "adb_transport_pool.h"
+#include <QDebug>
+#include <QHostAddress>
+
+static const int SWEEP_INTERVAL_MS = 1000;
+
+AdbTransportPool::AdbTransportPool(QObject *parent) : QObject(parent) {
+    m_sweepTimer.setInterval(SWEEP_INTERVAL_MS);
+    connect(&m_sweepTimer, &QTimer::timeout, this, &AdbTransportPool::onSweep);}
+
+AdbTransportPool::~AdbTransportPool() {clear();}
+
+void AdbTransportPool::setServer(const QString &host, quint16 port) {
+    if (host == m_host && port == m_port) return;
+    m_host = host;
+    m_port = port;
+    clear();}
+
+void AdbTransportPool::setPoolSize(int size) {
+    m_poolSize = qMax(0, size);
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        while (it.value().size() > m_poolSize) {
+            Entry *e = it.value().takeLast();
+            detach(e);
+            e->socket->abort();
+            e->socket->deleteLater();
+            delete e;}}}
+
+void AdbTransportPool::setIdleTimeoutMs(int ms) {m_idleTimeoutMs = qMax(0, ms);}
+
+QTcpSocket *AdbTransportPool::checkout(const QString &serial) {
+    QList<Entry*> &list = m_entries[serial];
+    for (int i = 0; i < list.size(); ++i) {
+        Entry *e = list.at(i);
+        if (!e->ready || e->socket->state() != QAbstractSocket::ConnectedState) continue;
+        list.removeAt(i);
+        QTcpSocket *socket = e->socket;
+        detach(e);
+        delete e;
+        socket->setParent(nullptr);
+        m_hits++;
+        warm(serial);
+        return socket;}
+    m_misses++;
+    warm(serial);
+    return nullptr;}
+
+void AdbTransportPool::checkin(const QString &serial, QTcpSocket *socket) {
+    if (!socket) return;
+    QList<Entry*> &list = m_entries[serial];
+    if (socket->state() != QAbstractSocket::ConnectedState || list.size() >= m_poolSize) {
+        socket->abort();
+        socket->deleteLater();
+        return;}
+    Entry *e = new Entry;
+    e->socket = socket;
+    e->socket->setParent(this);
+    e->ready = true;
+    e->idle.start();
+    connect(socket, &QTcpSocket::readyRead, this, [this, serial, e]() { onEntryReadyRead(serial, e); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, serial, e]() { dropEntry(serial, e); });
+    list.append(e);
+    if (!m_sweepTimer.isActive()) m_sweepTimer.start();}
+
+void AdbTransportPool::warm(const QString &serial) {
+    if (serial.isEmpty() || m_poolSize == 0) return;
+    int missing = m_poolSize - m_entries.value(serial).size();
+    for (int i = 0; i < missing; ++i) {
+        openEntry(serial);}}
+
+void AdbTransportPool::release(const QString &serial) {
+    const QList<Entry*> list = m_entries.take(serial);
+    for (Entry *e : list) {
+        detach(e);
+        e->socket->abort();
+        e->socket->deleteLater();
+        delete e;}}
+
+void AdbTransportPool::clear() {
+    const QStringList serials = m_entries.keys();
+    for (const QString &serial : serials) {
+        release(serial);}
+    m_sweepTimer.stop();}
+
+int AdbTransportPool::readyCount(const QString &serial) const {
+    int count = 0;
+    for (const Entry *e : m_entries.value(serial)) {
+        if (e->ready) count++;}
+    return count;}
+
+QJsonObject AdbTransportPool::stats() const {
+    QJsonObject json;
+    json["hits"] = static_cast<qint64>(m_hits);
+    json["misses"] = static_cast<qint64>(m_misses);
+    json["reconnectsAvoided"] = static_cast<qint64>(reconnectsAvoided());
+    json["poolSize"] = m_poolSize;
+    json["idleTimeoutMs"] = m_idleTimeoutMs;
+    QJsonObject ready;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        ready[it.key()] = readyCount(it.key());}
+    json["ready"] = ready;
+    return json;}
+
+void AdbTransportPool::openEntry(const QString &serial) {
+    Entry *e = new Entry;
+    e->socket = new QTcpSocket(this);
+    e->socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    m_entries[serial].append(e);
+    connect(e->socket, &QTcpSocket::connected, this, [e, serial]() {
+        const QByteArray request = QString("host:transport:%1").arg(serial).toUtf8();
+        e->socket->write(QByteArray::number(request.size(), 16).rightJustified(4, '0').toUpper());
+        e->socket->write(request);});
+    connect(e->socket, &QTcpSocket::readyRead, this, [this, serial, e]() { onEntryReadyRead(serial, e); });
+    connect(e->socket, &QTcpSocket::disconnected, this, [this, serial, e]() { dropEntry(serial, e); });
+    connect(e->socket, &QTcpSocket::errorOccurred, this, [this, serial, e](QAbstractSocket::SocketError) {
+        if (!e->ready) {
+            emit transportError(serial, QString("Błąd połączenia z ADB: %1").arg(e->socket->errorString()));}
+        dropEntry(serial, e);});
+    e->socket->connectToHost(QHostAddress(m_host), m_port);
+    if (!m_sweepTimer.isActive()) m_sweepTimer.start();}
+
+void AdbTransportPool::onEntryReadyRead(const QString &serial, Entry *entry) {
+    entry->buffer.append(entry->socket->readAll());
+    if (entry->ready) {
+        // Gniazdo w spoczynku nie powinno niczego dostać - transport jest nieużywalny.
+        dropEntry(serial, entry);
+        return;}
+    if (entry->buffer.size() < 4) return;
+    const QByteArray status = entry->buffer.left(4);
+    if (status == "OKAY") {
+        entry->buffer.clear();
+        entry->ready = true;
+        entry->idle.start();
+        emit transportWarmed(serial);
+        return;}
+    if (status == "FAIL") {
+        if (entry->buffer.size() < 8) return;
+        bool ok;
+        int length = entry->buffer.mid(4, 4).toInt(&ok, 16);
+        if (ok && entry->buffer.size() < 8 + length) return;
+        emit transportError(serial, QString("Błąd transportu do %1: %2").arg(serial, QString::fromUtf8(entry->buffer.mid(8, length))));
+    } else {
+        emit transportError(serial, QString("Błąd transportu: nieznany status %1").arg(QString::fromUtf8(status)));}
+    dropEntry(serial, entry);}
+
+void AdbTransportPool::dropEntry(const QString &serial, Entry *entry) {
+    auto it = m_entries.find(serial);
+    if (it == m_entries.end() || !it.value().removeOne(entry)) return;
+    if (it.value().isEmpty()) m_entries.erase(it);
+    detach(entry);
+    entry->socket->abort();
+    entry->socket->deleteLater();
+    delete entry;}
+
+void AdbTransportPool::detach(Entry *entry) {
+    if (entry && entry->socket) {
+        entry->socket->disconnect(this);}}
+
+void AdbTransportPool::onSweep() {
+    if (m_entries.isEmpty()) {
+        m_sweepTimer.stop();
+        return;}
+    const QStringList serials = m_entries.keys();
+    for (const QString &serial : serials) {
+        const QList<Entry*> list = m_entries.value(serial);
+        for (Entry *e : list) {
+            if (e->ready && e->idle.elapsed() > m_idleTimeoutMs) {
+                dropEntry(serial, e);}}}}
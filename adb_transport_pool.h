@@ -0,0 +1,68 @@
+#pragma once
+#include <QObject>
+#include <QTcpSocket>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+// Pula gniazd z wynegocjowanym już "host:transport:<serial>".
+// Gniazdo po wysłaniu usługi (shell:, sync:, ...) należy do tej usługi i nie wraca
+// do puli - dlatego pula po każdym checkout() dogrzewa zamiennik w tle.
+class AdbTransportPool : public QObject {
+    Q_OBJECT
+public:
+    explicit AdbTransportPool(QObject *parent = nullptr);
+    ~AdbTransportPool() override;
+
+    void setServer(const QString &host, quint16 port);
+    void setPoolSize(int size);
+    int poolSize() const { return m_poolSize; }
+    void setIdleTimeoutMs(int ms);
+    int idleTimeoutMs() const { return m_idleTimeoutMs; }
+
+    // Zwraca gotowe gniazdo (po OKAY na transport) albo nullptr (miss).
+    // Własność gniazda przechodzi na wywołującego.
+    QTcpSocket *checkout(const QString &serial);
+    // Zwrot nieużytego gniazda (nie wysłano jeszcze żadnej usługi).
+    void checkin(const QString &serial, QTcpSocket *socket);
+    void warm(const QString &serial);
+    void release(const QString &serial);
+    void clear();
+
+    int readyCount(const QString &serial) const;
+    quint64 hits() const { return m_hits; }
+    quint64 misses() const { return m_misses; }
+    quint64 reconnectsAvoided() const { return m_hits; }
+    QJsonObject stats() const;
+
+signals:
+    void transportWarmed(const QString &serial);
+    void transportError(const QString &serial, const QString &message);
+
+private slots:
+    void onSweep();
+
+private:
+    struct Entry {
+        QTcpSocket *socket = nullptr;
+        QByteArray buffer;
+        QElapsedTimer idle;
+        bool ready = false;
+    };
+
+    QString m_host = QStringLiteral("127.0.0.1");
+    quint16 m_port = 5037;
+    int m_poolSize = 2;
+    int m_idleTimeoutMs = 30000;
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+    QHash<QString, QList<Entry*>> m_entries;
+    QTimer m_sweepTimer;
+
+    void openEntry(const QString &serial);
+    void onEntryReadyRead(const QString &serial, Entry *entry);
+    void dropEntry(const QString &serial, Entry *entry);
+    void detach(Entry *entry);
+};
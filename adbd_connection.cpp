@@ -0,0 +1,303 @@
+#include "adbd_connection.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QtEndian>
+#ifdef ADB_HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#endif
+
+static const quint32 A_CNXN = 0x4e584e43;
+static const quint32 A_AUTH = 0x48545541;
+static const quint32 A_OPEN = 0x4e45504f;
+static const quint32 A_OKAY = 0x59414b4f;
+static const quint32 A_WRTE = 0x45545257;
+static const quint32 A_CLSE = 0x45534c43;
+static const quint32 A_STLS = 0x534c5453;
+static const quint32 A_VERSION = 0x01000001;
+static const quint32 HOST_MAX_PAYLOAD = 256 * 1024;
+static const int HEADER_SIZE = 24;
+
+static const quint32 AUTH_TOKEN = 1;
+static const quint32 AUTH_SIGNATURE = 2;
+static const quint32 AUTH_RSAPUBLICKEY = 3;
+
+AdbdStream::AdbdStream(AdbdConnection *connection, quint32 localId, const QString &service)
+    : QObject(connection), m_connection(connection), m_localId(localId), m_service(service) {}
+
+bool AdbdStream::write(const QByteArray &data) {
+    if (m_state != Open || m_closeRequested) return false;
+    m_pending.append(data);
+    pump();
+    return true;}
+
+void AdbdStream::close() {
+    if (m_state != Open) {
+        abort();
+        return;}
+    m_closeRequested = true;
+    pump();}
+
+void AdbdStream::abort() {
+    if (!m_connection || m_state == Closed) return;
+    if (m_state == Opening || m_state == Open || m_state == Closing) m_connection->sendClose(this);
+    m_connection->dropStream(this, false, QString());}
+
+void AdbdStream::pump() {
+    if (!m_connection || m_state != Open || m_inFlight > 0) return;
+    if (!m_pending.isEmpty()) {
+        // Jeden WRTE w locie na strumień - następny dopiero po OKAY od adbd.
+        const QByteArray chunk = m_pending.left(static_cast<int>(m_connection->maxPayload()));
+        m_pending.remove(0, chunk.size());
+        m_inFlight = chunk.size();
+        m_connection->sendWrite(this, chunk);
+        return;}
+    if (m_closeRequested) {
+        m_state = Closing;
+        m_connection->sendClose(this);
+        m_connection->dropStream(this, false, QString());}}
+
+AdbdConnection::AdbdConnection(const QString &host, quint16 port, QObject *parent)
+    : QObject(parent), m_host(host), m_port(port),
+      m_keyPath(QDir::homePath() + "/.android/adbkey"), m_socket(new QTcpSocket(this)) {
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    connect(m_socket, &QTcpSocket::connected, this, &AdbdConnection::onConnected);
+    connect(m_socket, &QTcpSocket::readyRead, this, &AdbdConnection::onReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &AdbdConnection::onDisconnected);
+    connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
+            this, &AdbdConnection::onSocketError);}
+
+AdbdConnection::~AdbdConnection() {
+    m_socket->disconnect(this);
+    const QList<AdbdStream*> streams = m_streams.values();
+    m_streams.clear();
+    for (AdbdStream *s : streams) {
+        s->m_state = AdbdStream::Closed;}}
+
+void AdbdConnection::connectToDevice() {
+    if (m_state == Connecting || m_state == Authenticating || m_state == Online) return;
+    m_buffer.clear();
+    m_authAttempts = 0;
+    m_publicKeySent = false;
+    m_banner.clear();
+    m_maxPayload = 4096;
+    setState(Connecting);
+    m_socket->abort();
+    m_socket->connectToHost(m_host, m_port);}
+
+void AdbdConnection::disconnectFromDevice() {
+    m_socket->abort();
+    failAll("Połączenie z adbd zamknięte.");
+    setState(Disconnected);}
+
+AdbdStream *AdbdConnection::openStream(const QString &service) {
+    AdbdStream *stream = new AdbdStream(this, m_nextLocalId++, service);
+    m_streams.insert(stream->m_localId, stream);
+    if (m_state == Online) {
+        sendOpen(stream);
+    } else {
+        connectToDevice();}
+    return stream;}
+
+void AdbdConnection::setState(State state) {
+    if (m_state == state) return;
+    m_state = state;
+    emit stateChanged(state);}
+
+void AdbdConnection::sendMessage(quint32 command, quint32 arg0, quint32 arg1, const QByteArray &data) {
+    // data_check jest ignorowany od A_VERSION 0x01000001, ale starsze adbd go sprawdzają.
+    quint32 check = 0;
+    for (char c : data) check += static_cast<quint8>(c);
+    char header[HEADER_SIZE];
+    qToLittleEndian<quint32>(command, header);
+    qToLittleEndian<quint32>(arg0, header + 4);
+    qToLittleEndian<quint32>(arg1, header + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(data.size()), header + 12);
+    qToLittleEndian<quint32>(check, header + 16);
+    qToLittleEndian<quint32>(command ^ 0xffffffff, header + 20);
+    m_socket->write(header, HEADER_SIZE);
+    if (!data.isEmpty()) m_socket->write(data);}
+
+void AdbdConnection::sendOpen(AdbdStream *stream) {
+    stream->m_state = AdbdStream::Opening;
+    sendMessage(A_OPEN, stream->m_localId, 0, stream->m_service.toUtf8() + '\0');}
+
+void AdbdConnection::sendWrite(AdbdStream *stream, const QByteArray &chunk) {
+    sendMessage(A_WRTE, stream->m_localId, stream->m_remoteId, chunk);}
+
+void AdbdConnection::sendClose(AdbdStream *stream) {
+    if (m_state != Online) return;
+    sendMessage(A_CLSE, stream->m_localId, stream->m_remoteId);}
+
+void AdbdConnection::dropStream(AdbdStream *stream, bool rejected, const QString &message) {
+    if (!m_streams.remove(stream->m_localId)) return;
+    stream->m_state = AdbdStream::Closed;
+    emit stream->closed(rejected, message);
+    stream->deleteLater();}
+
+void AdbdConnection::failAll(const QString &message) {
+    const QList<AdbdStream*> streams = m_streams.values();
+    for (AdbdStream *s : streams) {
+        dropStream(s, false, message);}}
+
+void AdbdConnection::onConnected() {
+    // Bez "shell_v2" w cechach hosta adbd odrzuciłby shell,v2: i wrócił do gołego PTY.
+    sendMessage(A_CNXN, A_VERSION, HOST_MAX_PAYLOAD, QByteArray("host::features=shell_v2,cmd,stat_v2") + '\0');}
+
+void AdbdConnection::onReadyRead() {
+    m_buffer.append(m_socket->readAll());
+    while (m_buffer.size() >= HEADER_SIZE) {
+        const char *h = m_buffer.constData();
+        Message msg;
+        msg.command = qFromLittleEndian<quint32>(h);
+        msg.arg0 = qFromLittleEndian<quint32>(h + 4);
+        msg.arg1 = qFromLittleEndian<quint32>(h + 8);
+        const quint32 length = qFromLittleEndian<quint32>(h + 12);
+        const quint32 magic = qFromLittleEndian<quint32>(h + 20);
+        if (magic != (msg.command ^ 0xffffffff) || length > qMax(HOST_MAX_PAYLOAD, m_maxPayload)) {
+            m_socket->abort();
+            failAll("Błąd protokołu adbd: uszkodzony nagłówek.");
+            setState(Failed);
+            emit connectionError("Błąd protokołu adbd: uszkodzony nagłówek.");
+            return;}
+        if (static_cast<quint32>(m_buffer.size()) < HEADER_SIZE + length) return;
+        msg.data = m_buffer.mid(HEADER_SIZE, static_cast<int>(length));
+        m_buffer.remove(0, HEADER_SIZE + static_cast<int>(length));
+        handleMessage(msg);
+        if (m_state == Failed || m_state == Disconnected) return;}}
+
+void AdbdConnection::handleMessage(const Message &msg) {
+    switch (msg.command) {
+    case A_CNXN: {
+        m_maxPayload = qMin(msg.arg1, HOST_MAX_PAYLOAD);
+        m_banner = QString::fromUtf8(msg.data).remove(QChar('\0'));
+        setState(Online);
+        emit online(m_banner);
+        const QList<AdbdStream*> streams = m_streams.values();
+        for (AdbdStream *s : streams) {
+            if (s->m_state == AdbdStream::Pending) sendOpen(s);}
+        break;}
+    case A_AUTH:
+        handleAuth(msg);
+        break;
+    case A_STLS: {
+        // Parowanie "Wireless debugging" (Android 11+) wymaga TLS - tego połączenie nie obsługuje.
+        const QString message = "adbd wymaga TLS (STLS) - użyj serwera ADB dla tego urządzenia.";
+        m_socket->abort();
+        failAll(message);
+        setState(Failed);
+        emit connectionError(message);
+        break;}
+    case A_OKAY: {
+        AdbdStream *s = m_streams.value(msg.arg1, nullptr);
+        if (!s) break;
+        if (s->m_state == AdbdStream::Opening) {
+            s->m_remoteId = msg.arg0;
+            s->m_state = AdbdStream::Open;
+            emit s->opened();
+            if (m_streams.contains(msg.arg1)) s->pump();
+        } else if (s->m_state == AdbdStream::Open) {
+            const qint64 acked = s->m_inFlight;
+            s->m_inFlight = 0;
+            if (acked > 0) emit s->bytesWritten(acked);
+            if (m_streams.contains(msg.arg1)) s->pump();}
+        break;}
+    case A_WRTE: {
+        AdbdStream *s = m_streams.value(msg.arg1, nullptr);
+        if (!s) {
+            // Strumień już zamknięty lokalnie - adbd musi się o tym dowiedzieć.
+            sendMessage(A_CLSE, msg.arg1, msg.arg0);
+            break;}
+        sendMessage(A_OKAY, s->m_localId, msg.arg0);
+        emit s->dataReceived(msg.data);
+        break;}
+    case A_CLSE: {
+        AdbdStream *s = m_streams.value(msg.arg1, nullptr);
+        if (!s) break;
+        const bool rejected = (s->m_state == AdbdStream::Opening);
+        dropStream(s, rejected, rejected ? QString("adbd odrzucił usługę '%1'.").arg(s->m_service) : QString());
+        break;}
+    default:
+        qWarning() << "AdbdConnection: nieznana komenda" << Qt::hex << msg.command;
+        break;}}
+
+void AdbdConnection::handleAuth(const Message &msg) {
+    if (msg.arg0 != AUTH_TOKEN) return;
+    setState(Authenticating);
+    m_authAttempts++;
+    if (m_authAttempts == 1) {
+        QString error;
+        const QByteArray signature = signToken(msg.data, &error);
+        if (!signature.isEmpty()) {
+            sendMessage(A_AUTH, AUTH_SIGNATURE, 0, signature);
+            return;}
+        qWarning() << "AdbdConnection: nie można podpisać tokenu:" << error;}
+    if (!m_publicKeySent) {
+        // Urządzenie nie zna klucza - wyświetli okno "Allow USB debugging?" i odpowie CNXN.
+        const QByteArray key = publicKey();
+        if (!key.isEmpty()) {
+            m_publicKeySent = true;
+            sendMessage(A_AUTH, AUTH_RSAPUBLICKEY, 0, key + '\0');
+            return;}}
+    const QString message = QString("Autoryzacja adbd nieudana (%1:%2).").arg(m_host).arg(m_port);
+    m_socket->abort();
+    failAll(message);
+    setState(Failed);
+    emit connectionError(message);}
+
+QByteArray AdbdConnection::signToken(const QByteArray &token, QString *error) const {
+#ifdef ADB_HAVE_OPENSSL
+    QFile file(m_keyPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("brak klucza %1").arg(m_keyPath);
+        return QByteArray();}
+    const QByteArray pem = file.readAll();
+    BIO *bio = BIO_new_mem_buf(pem.constData(), pem.size());
+    EVP_PKEY *key = PEM_read_bio_PrivateKey(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+    if (!key) {
+        *error = QString("niepoprawny klucz %1").arg(m_keyPath);
+        return QByteArray();}
+    // adbd weryfikuje RSA_verify(NID_sha1, token) - token podpisujemy jak gotowy skrót SHA-1.
+    QByteArray signature;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(key, nullptr);
+    size_t length = 0;
+    if (ctx && EVP_PKEY_sign_init(ctx) > 0 && EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) > 0 &&
+        EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha1()) > 0 &&
+        EVP_PKEY_sign(ctx, nullptr, &length, reinterpret_cast<const unsigned char*>(token.constData()), token.size()) > 0) {
+        signature.resize(static_cast<int>(length));
+        if (EVP_PKEY_sign(ctx, reinterpret_cast<unsigned char*>(signature.data()), &length,
+                          reinterpret_cast<const unsigned char*>(token.constData()), token.size()) > 0) {
+            signature.resize(static_cast<int>(length));
+        } else {
+            signature.clear();}}
+    if (signature.isEmpty()) *error = "EVP_PKEY_sign nie powiódł się";
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(key);
+    return signature;
+#else
+    Q_UNUSED(token);
+    *error = "zbudowano bez OpenSSL";
+    return QByteArray();
+#endif
+}
+
+QByteArray AdbdConnection::publicKey() const {
+    // adbkey.pub ma już format adbd (base64 struktury RSAPublicKey + " user@host").
+    QFile file(m_keyPath + ".pub");
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll().trimmed();}
+
+void AdbdConnection::onDisconnected() {
+    if (m_state == Failed || m_state == Disconnected) return;
+    failAll(QString("adbd %1:%2 zamknął połączenie.").arg(m_host).arg(m_port));
+    setState(Disconnected);}
+
+void AdbdConnection::onSocketError(QAbstractSocket::SocketError err) {
+    if (err == QAbstractSocket::RemoteHostClosedError) return;
+    const QString message = QString("Błąd połączenia z adbd %1:%2: %3").arg(m_host).arg(m_port).arg(m_socket->errorString());
+    failAll(message);
+    setState(Failed);
+    emit connectionError(message);}
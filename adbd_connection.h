@@ -0,0 +1,118 @@
+#pragma once
+#include <QObject>
+#include <QTcpSocket>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+
+class AdbdConnection;
+
+// Jeden strumień (OPEN ... CLSE) multipleksowany na połączeniu z adbd.
+// Zapisy są dzielone na WRTE po maxPayload i wysyłane po jednym na każde OKAY.
+class AdbdStream : public QObject {
+    Q_OBJECT
+public:
+    quint32 localId() const { return m_localId; }
+    QString service() const { return m_service; }
+    bool isOpen() const { return m_state == Open; }
+    bool write(const QByteArray &data);
+    qint64 bytesToWrite() const { return m_pending.size() + m_inFlight; }
+    // Zamknięcie po wysłaniu zaległych danych (CLSE po ostatnim OKAY).
+    void close();
+    // Natychmiastowe CLSE bez czekania na bufor.
+    void abort();
+
+signals:
+    void opened();
+    void dataReceived(const QByteArray &data);
+    void bytesWritten(qint64 bytes);
+    // rejected = adbd odrzucił OPEN (CLSE przed OKAY).
+    void closed(bool rejected, const QString &message);
+
+private:
+    friend class AdbdConnection;
+    enum State { Pending, Opening, Open, Closing, Closed };
+    AdbdStream(AdbdConnection *connection, quint32 localId, const QString &service);
+
+    QPointer<AdbdConnection> m_connection;
+    quint32 m_localId = 0;
+    quint32 m_remoteId = 0;
+    QString m_service;
+    State m_state = Pending;
+    QByteArray m_pending;
+    qint64 m_inFlight = 0;
+    bool m_closeRequested = false;
+
+    void pump();
+};
+
+// Klient protokołu adbd (CNXN/AUTH/OPEN/WRTE/OKAY/CLSE) po TCP, bez serwera ADB.
+// Klucz RSA jest ten sam co adb (~/.android/adbkey) - urządzenie, które ufa
+// lokalnemu adb, ufa też temu połączeniu.
+class AdbdConnection : public QObject {
+    Q_OBJECT
+public:
+    enum State { Disconnected, Connecting, Authenticating, Online, Failed };
+    Q_ENUM(State)
+
+    explicit AdbdConnection(const QString &host, quint16 port, QObject *parent = nullptr);
+    ~AdbdConnection() override;
+
+    void setKeyPath(const QString &path) { m_keyPath = path; }
+    void connectToDevice();
+    void disconnectFromDevice();
+    State state() const { return m_state; }
+    QString host() const { return m_host; }
+    quint16 port() const { return m_port; }
+    quint32 maxPayload() const { return m_maxPayload; }
+    QString banner() const { return m_banner; }
+    int streamCount() const { return m_streams.size(); }
+
+    // Strumień żyje do sygnału closed(); OPEN idzie od razu albo po CNXN.
+    AdbdStream *openStream(const QString &service);
+
+signals:
+    void stateChanged(AdbdConnection::State state);
+    void online(const QString &banner);
+    void connectionError(const QString &message);
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+    void onSocketError(QAbstractSocket::SocketError err);
+
+private:
+    friend class AdbdStream;
+    struct Message {
+        quint32 command = 0;
+        quint32 arg0 = 0;
+        quint32 arg1 = 0;
+        QByteArray data;
+    };
+
+    QString m_host;
+    quint16 m_port;
+    QString m_keyPath;
+    QTcpSocket *m_socket;
+    State m_state = Disconnected;
+    QByteArray m_buffer;
+    quint32 m_maxPayload = 4096;
+    quint32 m_nextLocalId = 1;
+    int m_authAttempts = 0;
+    bool m_publicKeySent = false;
+    QString m_banner;
+    QHash<quint32, AdbdStream*> m_streams;
+
+    void setState(State state);
+    void sendMessage(quint32 command, quint32 arg0, quint32 arg1, const QByteArray &data = QByteArray());
+    void handleMessage(const Message &msg);
+    void handleAuth(const Message &msg);
+    void sendOpen(AdbdStream *stream);
+    void sendWrite(AdbdStream *stream, const QByteArray &chunk);
+    void sendClose(AdbdStream *stream);
+    void dropStream(AdbdStream *stream, bool rejected, const QString &message);
+    void failAll(const QString &message);
+    QByteArray signToken(const QByteArray &token, QString *error) const;
+    QByteArray publicKey() const;
+};
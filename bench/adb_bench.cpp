@@ -0,0 +1,245 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryFile>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include "fake_adb_server.h"
+#include "adb_client.h"
+#include "adb_buffer.h"
+#include "adb_sync.h"
+#include "commandexecutor.h"
+
+// Benchmark ścieżki smart-socket: N żądań z zadaną współbieżnością przeciwko
+// FakeAdbServer (w procesie) albo zewnętrznemu serwerowi (--server host:port).
+// Wynik: komendy/s, p50/p99 opóźnienia i bajty/s - jedna linia JSON na przebieg.
+
+struct BenchState {
+    QString mode;
+    int total = 0;
+    int concurrency = 1;
+    int started = 0;
+    int completed = 0;
+    int failed = 0;
+    qint64 bytes = 0;
+    QHash<quint64, QElapsedTimer> inflight;
+    QVector<qint64> latenciesUs;
+    QElapsedTimer wall;
+};
+
+static double percentileMs(QVector<qint64> values, double p) {
+    if (values.isEmpty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    const int index = qBound(0, static_cast<int>(std::ceil(p * values.size())) - 1, values.size() - 1);
+    return values.at(index) / 1000.0;}
+
+static QJsonObject report(const BenchState &s, AdbClient *client) {
+    const double seconds = qMax<qint64>(1, s.wall.nsecsElapsed()) / 1e9;
+    QJsonObject json;
+    json["mode"] = s.mode;
+    json["requests"] = s.completed;
+    json["failed"] = s.failed;
+    json["concurrency"] = s.concurrency;
+    json["seconds"] = seconds;
+    json["commandsPerSec"] = s.completed / seconds;
+    json["p50Ms"] = percentileMs(s.latenciesUs, 0.50);
+    json["p99Ms"] = percentileMs(s.latenciesUs, 0.99);
+    json["maxMs"] = percentileMs(s.latenciesUs, 1.0);
+    json["bytes"] = s.bytes;
+    json["bytesPerSec"] = s.bytes / seconds;
+    json["pool"] = client->transportPool()->stats();
+    return json;}
+
+// Strumień shell,v2 (ramki stdout po frameSize B) pocięty na odczyty gniazda po 64 KiB.
+static QList<QByteArray> shellV2Reads(int frames, int frameSize) {
+    QByteArray stream;
+    const QByteArray data(frameSize, 'x');
+    char header[5];
+    header[0] = 1;
+    qToLittleEndian<quint32>(static_cast<quint32>(frameSize), header + 1);
+    for (int i = 0; i < frames; ++i) {
+        stream.append(header, sizeof(header));
+        stream.append(data);}
+    QList<QByteArray> reads;
+    for (qsizetype offset = 0; offset < stream.size(); offset += 64 * 1024) reads << stream.mid(offset, 64 * 1024);
+    return reads;}
+
+// Bufor sprzed AdbChunkBuffer: append + mid + remove(0, n) na jednym QByteArray.
+static qint64 parseWithByteArray(const QList<QByteArray> &reads) {
+    QByteArray buffer;
+    qint64 delivered = 0;
+    for (const QByteArray &read : reads) {
+        buffer.append(read);
+        while (buffer.size() >= 5) {
+            const quint32 length = qFromLittleEndian<quint32>(buffer.constData() + 1);
+            if (static_cast<quint32>(buffer.size()) < 5 + length) break;
+            const QByteArray data = buffer.mid(5, length);
+            buffer.remove(0, 5 + length);
+            delivered += data.size();}}
+    return delivered;}
+
+static qint64 parseWithChunkBuffer(const QList<QByteArray> &reads) {
+    AdbChunkBuffer buffer;
+    qint64 delivered = 0;
+    char header[5];
+    for (const QByteArray &read : reads) {
+        buffer.append(read);
+        while (buffer.peek(header, 5)) {
+            const quint32 length = qFromLittleEndian<quint32>(header + 1);
+            if (static_cast<quint64>(buffer.size()) < 5 + static_cast<quint64>(length)) break;
+            buffer.skip(5);
+            delivered += buffer.take(length).size();}}
+    return delivered;}
+
+static QJsonObject runBufferBench(int frames, int frameSize) {
+    const QList<QByteArray> reads = shellV2Reads(frames, frameSize);
+    QJsonObject json;
+    json["mode"] = "buffer";
+    json["frames"] = frames;
+    json["frameSize"] = frameSize;
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 before = parseWithByteArray(reads);
+    const double beforeSec = qMax<qint64>(1, timer.nsecsElapsed()) / 1e9;
+    timer.restart();
+    const qint64 after = parseWithChunkBuffer(reads);
+    const double afterSec = qMax<qint64>(1, timer.nsecsElapsed()) / 1e9;
+    json["bytes"] = after;
+    json["consistent"] = (before == after);
+    json["byteArrayMBps"] = before / beforeSec / 1e6;
+    json["chunkBufferMBps"] = after / afterSec / 1e6;
+    return json;}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("adb_bench");
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption modeOption(QStringList() << "m" << "mode", "host | shell | shellv2 | executor | push | buffer (domyślnie shellv2).", "mode", "shellv2");
+    QCommandLineOption countOption(QStringList() << "n" << "requests", "Liczba żądań.", "count", "1000");
+    QCommandLineOption concurrencyOption(QStringList() << "c" << "concurrency", "Żądania w locie.", "count", "8");
+    QCommandLineOption latencyOption(QStringList() << "l" << "latency", "Opóźnienie FakeAdbServer [ms].", "ms", "0");
+    QCommandLineOption payloadOption(QStringList() << "b" << "payload", "Rozmiar wyjścia shell / pliku push [B].", "bytes", "64");
+    QCommandLineOption poolOption(QStringList() << "pool", "Rozmiar puli transportów AdbClient.", "size", "2");
+    QCommandLineOption serverOption(QStringList() << "server", "Zewnętrzny serwer ADB zamiast FakeAdbServer.", "host:port");
+    QCommandLineOption serialOption(QStringList() << "d" << "device-serial", "Serial urządzenia.", "serial", "fake-0001");
+    parser.addOptions({modeOption, countOption, concurrencyOption, latencyOption, payloadOption, poolOption, serverOption, serialOption});
+    parser.process(a);
+
+    BenchState state;
+    state.mode = parser.value(modeOption);
+    state.total = qMax(1, parser.value(countOption).toInt());
+    state.concurrency = qMax(1, parser.value(concurrencyOption).toInt());
+    const int payload = parser.value(payloadOption).toInt();
+    const QString serial = parser.value(serialOption);
+    if (state.mode == "buffer") {
+        // Bez sieci: sam parser ramek, -n ramek po --payload bajtów.
+        const QJsonObject json = runBufferBench(state.total, qMax(1, payload));
+        std::printf("%s\n", QJsonDocument(json).toJson(QJsonDocument::Compact).constData());
+        return json["consistent"].toBool() ? 0 : 1;}
+
+    FakeAdbServer::Options options;
+    options.serials = QStringList() << serial;
+    options.latencyMs = parser.value(latencyOption).toInt();
+    options.payloadBytes = payload;
+    FakeAdbServer fake(options);
+    QString host = "127.0.0.1";
+    quint16 port = 0;
+    if (parser.isSet(serverOption)) {
+        const QString spec = parser.value(serverOption);
+        host = spec.section(':', 0, 0);
+        port = spec.section(':', 1).toUShort();
+    } else {
+        if (!fake.listen()) {
+            qCritical() << "FakeAdbServer: nie można nasłuchiwać na loopbacku.";
+            return 1;}
+        port = fake.port();}
+
+    CommandExecutor executor;
+    AdbClient *client = executor.adbClient();
+    client->setServer(host, port);
+    client->transportPool()->setPoolSize(parser.value(poolOption).toInt());
+    executor.setTargetDevice(serial);
+    executor.setConcurrencyLimits(state.concurrency, state.concurrency);
+    AdbSync sync(client);
+
+    QTemporaryFile pushFile;
+    if (state.mode == "push") {
+        if (!pushFile.open()) {
+            qCritical() << "Nie można utworzyć pliku tymczasowego.";
+            return 1;}
+        pushFile.write(QByteArray(qMax(1, payload), 'p'));
+        pushFile.flush();}
+
+    std::function<void()> launch;
+    auto complete = [&](quint64 id, bool ok) {
+        auto it = state.inflight.find(id);
+        if (it == state.inflight.end()) return;
+        state.latenciesUs.append(it->nsecsElapsed() / 1000);
+        state.inflight.erase(it);
+        state.completed++;
+        if (!ok) state.failed++;
+        if (state.completed == state.total) {
+            const QJsonObject json = report(state, client);
+            std::printf("%s\n", QJsonDocument(json).toJson(QJsonDocument::Compact).constData());
+            QTimer::singleShot(0, &a, &QCoreApplication::quit);
+            return;}
+        launch();};
+
+    launch = [&]() {
+        while (state.inflight.size() < state.concurrency && state.started < state.total) {
+            QElapsedTimer timer;
+            timer.start();
+            quint64 id = 0;
+            if (state.mode == "host") {
+                id = client->sendAdbCommand("host:version");
+            } else if (state.mode == "shell") {
+                id = client->sendDeviceCommand(serial, QString("shell:bench %1").arg(state.started));
+            } else if (state.mode == "shellv2") {
+                id = client->sendShellV2(serial, QString("bench %1").arg(state.started));
+            } else if (state.mode == "push") {
+                id = sync.push(serial, pushFile.fileName(), QString("/data/local/tmp/bench_%1").arg(state.started % 16));
+            } else if (state.mode == "executor") {
+                id = executor.executeSequenceCommand(QString("input tap %1 %1").arg(state.started), "shell", serial);
+            } else {
+                qCritical() << "Nieznany tryb:" << state.mode;
+                QTimer::singleShot(0, &a, [&a]() { a.exit(2); });
+                return;}
+            state.started++;
+            if (id == 0) {
+                qCritical() << "Nie udało się wysłać żądania" << state.started;
+                QTimer::singleShot(0, &a, [&a]() { a.exit(1); });
+                return;}
+            state.inflight.insert(id, timer);}};
+
+    QObject::connect(client, &AdbClient::requestSlice, [&](quint64 id, const AdbSlice &data) {
+        if (state.mode != "push" && state.inflight.contains(id)) state.bytes += data.size();});
+    QObject::connect(client, &AdbClient::requestFinished, [&](quint64 id) {
+        if (state.mode == "host" || state.mode == "shell" || state.mode == "shellv2") complete(id, true);});
+    QObject::connect(client, &AdbClient::requestFailed, [&](quint64 id, const QString &message) {
+        if (state.mode != "host" && state.mode != "shell" && state.mode != "shellv2") return;
+        if (state.failed == 0) qWarning() << "Pierwszy błąd:" << message;
+        complete(id, false);});
+    QObject::connect(&sync, &AdbSync::finished, [&](quint64 op, bool ok, bool, const QString &message) {
+        if (!ok && state.failed == 0) qWarning() << "Pierwszy błąd push:" << message;
+        if (ok) state.bytes += pushFile.size();
+        complete(op, ok);});
+    QObject::connect(&executor, &CommandExecutor::commandRawData, [&](quint64, const QByteArray &data) {
+        state.bytes += data.size();});
+    QObject::connect(&executor, &CommandExecutor::commandFinished, [&](quint64 id, int exitCode, QProcess::ExitStatus) {
+        if (state.mode == "executor") complete(id, exitCode == 0);});
+
+    // Pula potrzebuje chwili na rozgrzanie - pierwsze żądania nie powinny płacić za connect.
+    QTimer::singleShot(100, &a, [&]() {
+        state.wall.start();
+        launch();});
+    return a.exec();
+}
@@ -0,0 +1,237 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QVector>
+#include <cstdio>
+#include <functional>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include "fake_adbd.h"
+#include "adbd_connection.h"
+
+// AdbdConnection przeciwko FakeAdbd (w procesie): autoryzacja podpisem, odrzucenie
+// podpisu i klucza, odrzucenie usługi, echo na kilku strumieniach z kontrolą przepływu
+// (jeden WRTE w locie) i odbiór source:N. Jedna linia JSON na scenariusz, kod 1 przy błędzie.
+
+static bool generateKey(const QString &path) {
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    if (!ctx || EVP_PKEY_keygen_init(ctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) <= 0 ||
+        EVP_PKEY_keygen(ctx, &key) <= 0) {
+        EVP_PKEY_CTX_free(ctx);
+        return false;}
+    EVP_PKEY_CTX_free(ctx);
+    BIO *bio = BIO_new(BIO_s_mem());
+    const bool ok = PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+    char *data = nullptr;
+    const long length = BIO_get_mem_data(bio, &data);
+    QFile file(path);
+    const bool written = ok && file.open(QIODevice::WriteOnly) && file.write(data, length) == length;
+    BIO_free(bio);
+    EVP_PKEY_free(key);
+    if (!written) return false;
+    // FakeAdbd nie parsuje adbkey.pub - wystarczy, że plik istnieje i host go wyśle.
+    QFile pub(path + ".pub");
+    return pub.open(QIODevice::WriteOnly) && pub.write("QAAAAGZha2U= bench@adbd_bench\n") > 0;}
+
+static bool waitFor(const std::function<bool()> &done, int timeoutMs) {
+    QEventLoop loop;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, [&]() { if (done()) loop.quit(); });
+    QTimer::singleShot(timeoutMs, &loop, &QEventLoop::quit);
+    poll.start(1);
+    if (!done()) loop.exec();
+    return done();}
+
+static QJsonObject statsJson(const FakeAdbd::Stats &s) {
+    QJsonObject json;
+    json["signaturesAccepted"] = s.signaturesAccepted;
+    json["signaturesRejected"] = s.signaturesRejected;
+    json["publicKeysOffered"] = s.publicKeysOffered;
+    json["streamsOpened"] = s.streamsOpened;
+    json["streamsRejected"] = s.streamsRejected;
+    json["hostWrites"] = static_cast<qint64>(s.hostWrites);
+    json["deviceWrites"] = static_cast<qint64>(s.deviceWrites);
+    json["maxHostWriteSize"] = s.maxHostWriteSize;
+    json["flowViolations"] = s.flowViolations;
+    json["ackViolations"] = s.ackViolations;
+    json["protocolErrors"] = s.protocolErrors;
+    return json;}
+
+struct Check {
+    QString scenario;
+    QJsonObject json;
+    QStringList errors;
+    void expect(bool condition, const QString &what) { if (!condition) errors << what; }
+    bool print() {
+        json["scenario"] = scenario;
+        json["ok"] = errors.isEmpty();
+        if (!errors.isEmpty()) json["errors"] = errors.join("; ");
+        std::printf("%s\n", QJsonDocument(json).toJson(QJsonDocument::Compact).constData());
+        return errors.isEmpty();}
+};
+
+// Łączy się z fake i czeka na Online albo Failed.
+static AdbdConnection::State connectTo(AdbdConnection *connection, int timeoutMs) {
+    connection->connectToDevice();
+    waitFor([connection]() {
+        return connection->state() == AdbdConnection::Online || connection->state() == AdbdConnection::Failed;}, timeoutMs);
+    return connection->state();}
+
+static bool runAuthRejected(const QString &clientKey, const QString &deviceKey, int timeoutMs) {
+    Check check{"authRejected"};
+    FakeAdbd::Options options;
+    options.trustedKeys << deviceKey;
+    FakeAdbd fake(options);
+    if (!fake.listen()) {
+        check.expect(false, "listen");
+        return check.print();}
+    AdbdConnection connection("127.0.0.1", fake.port());
+    connection.setKeyPath(clientKey);
+    QString error;
+    QObject::connect(&connection, &AdbdConnection::connectionError, [&error](const QString &message) { error = message; });
+    // Strumień otwarty przed CNXN musi zostać zamknięty błędem, a nie wisieć.
+    bool streamClosed = false;
+    AdbdStream *stream = connection.openStream("echo:");
+    QObject::connect(stream, &AdbdStream::closed, [&streamClosed](bool, const QString &) { streamClosed = true; });
+    const AdbdConnection::State state = connectTo(&connection, timeoutMs);
+    waitFor([&streamClosed]() { return streamClosed; }, timeoutMs);
+    check.json["stats"] = statsJson(fake.stats());
+    check.json["error"] = error;
+    check.expect(state == AdbdConnection::Failed, "połączenie nie przeszło w Failed");
+    check.expect(!error.isEmpty(), "brak connectionError");
+    check.expect(fake.stats().signaturesRejected == 1, "podpis nieznanym kluczem nie został odrzucony");
+    check.expect(fake.stats().publicKeysOffered == 1, "host nie wysłał klucza publicznego");
+    check.expect(fake.stats().streamsOpened == 0, "OPEN przed autoryzacją");
+    check.expect(streamClosed, "oczekujący strumień nie został zamknięty");
+    return check.print();}
+
+static bool runPublicKeyAccepted(const QString &clientKey, const QString &deviceKey, int timeoutMs) {
+    Check check{"publicKeyAccepted"};
+    FakeAdbd::Options options;
+    options.trustedKeys << deviceKey;
+    options.acceptPublicKey = true;
+    FakeAdbd fake(options);
+    if (!fake.listen()) {
+        check.expect(false, "listen");
+        return check.print();}
+    AdbdConnection connection("127.0.0.1", fake.port());
+    connection.setKeyPath(clientKey);
+    const AdbdConnection::State state = connectTo(&connection, timeoutMs);
+    check.json["stats"] = statsJson(fake.stats());
+    check.expect(state == AdbdConnection::Online, "brak CNXN po zaakceptowaniu klucza");
+    check.expect(fake.stats().signaturesRejected == 1 && fake.stats().publicKeysOffered == 1, "niepoprawna sekwencja AUTH");
+    return check.print();}
+
+static bool runSession(const QString &clientKey, int streams, int payload, quint32 maxPayload, int timeoutMs) {
+    Check check{"session"};
+    FakeAdbd::Options options;
+    options.trustedKeys << clientKey;
+    options.maxPayload = maxPayload;
+    FakeAdbd fake(options);
+    if (!fake.listen()) {
+        check.expect(false, "listen");
+        return check.print();}
+    AdbdConnection connection("127.0.0.1", fake.port());
+    connection.setKeyPath(clientKey);
+    const AdbdConnection::State state = connectTo(&connection, timeoutMs);
+    check.json["banner"] = connection.banner();
+    check.expect(state == AdbdConnection::Online, "brak Online");
+    check.expect(fake.stats().signaturesAccepted == 1, "podpis zaufanym kluczem nie został przyjęty");
+    check.expect(connection.maxPayload() == maxPayload, "maxPayload nie pochodzi z CNXN urządzenia");
+    if (state != AdbdConnection::Online) return check.print();
+
+    // Usługa nieznana - CLSE zamiast OKAY na OPEN.
+    bool rejected = false;
+    bool rejectedClosed = false;
+    AdbdStream *bogus = connection.openStream("bogus:service");
+    QObject::connect(bogus, &AdbdStream::closed, [&](bool wasRejected, const QString &) {
+        rejectedClosed = true;
+        rejected = wasRejected;});
+    waitFor([&rejectedClosed]() { return rejectedClosed; }, timeoutMs);
+    check.expect(rejectedClosed && rejected, "odrzucenie usługi nie dotarło jako closed(rejected)");
+
+    // Echo: każdy strumień wysyła payload bajtów naraz - AdbdStream musi pociąć go na WRTE
+    // po maxPayload i wysyłać następny dopiero po OKAY.
+    QByteArray data(payload, Qt::Uninitialized);
+    for (int i = 0; i < payload; ++i) data[i] = static_cast<char>(i * 31 + 7);
+    QVector<QByteArray> received(streams);
+    int corrupt = 0;
+    int closedEarly = 0;
+    QElapsedTimer wall;
+    wall.start();
+    for (int i = 0; i < streams; ++i) {
+        AdbdStream *stream = connection.openStream("echo:");
+        QObject::connect(stream, &AdbdStream::opened, [stream, &data]() { stream->write(data); });
+        QObject::connect(stream, &AdbdStream::dataReceived, [&, i, stream](const QByteArray &chunk) {
+            received[i].append(chunk);
+            if (received[i].size() == data.size()) {
+                if (received[i] != data) corrupt++;
+                stream->close();}});
+        QObject::connect(stream, &AdbdStream::closed, [&, i](bool, const QString &message) {
+            if (received[i].size() != data.size() || !message.isEmpty()) closedEarly++;});}
+    const bool echoed = waitFor([&]() {
+        for (const QByteArray &r : received) if (r.size() < data.size()) return false;
+        return true;}, timeoutMs);
+    const double seconds = qMax<qint64>(1, wall.nsecsElapsed()) / 1e9;
+    waitFor([&connection]() { return connection.streamCount() == 0; }, timeoutMs);
+
+    // source:N - urządzenie pisze, host potwierdza każdy WRTE, na końcu CLSE.
+    QByteArray sourced;
+    bool sourceClosed = false;
+    AdbdStream *source = connection.openStream(QString("source:%1").arg(payload));
+    QObject::connect(source, &AdbdStream::dataReceived, [&sourced](const QByteArray &chunk) { sourced.append(chunk); });
+    QObject::connect(source, &AdbdStream::closed, [&sourceClosed](bool, const QString &) { sourceClosed = true; });
+    waitFor([&sourceClosed]() { return sourceClosed; }, timeoutMs);
+
+    const FakeAdbd::Stats &s = fake.stats();
+    const quint64 chunksPerStream = (static_cast<quint64>(payload) + maxPayload - 1) / maxPayload;
+    check.json["stats"] = statsJson(s);
+    check.json["streams"] = streams;
+    check.json["payload"] = payload;
+    check.json["echoMBps"] = 2.0 * streams * payload / seconds / 1e6;
+    check.expect(echoed, "echo nie wróciło w całości");
+    check.expect(corrupt == 0, "echo zwróciło inne dane");
+    check.expect(closedEarly == 0, "strumień echo zamknięty przed końcem");
+    check.expect(s.flowViolations == 0, "więcej niż jeden WRTE w locie na strumieniu");
+    check.expect(s.ackViolations == 0, "OKAY hosta bez WRTE w locie");
+    check.expect(s.protocolErrors == 0, "błędy protokołu po stronie urządzenia");
+    check.expect(static_cast<quint32>(s.maxHostWriteSize) <= maxPayload, "WRTE hosta większy niż maxPayload");
+    check.expect(s.hostWrites == chunksPerStream * streams, "WRTE hosta nie pocięte po maxPayload");
+    check.expect(sourceClosed && sourced.size() == payload, "source: niepełne dane albo brak CLSE");
+    return check.print();}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("adbd_bench");
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption streamsOption(QStringList() << "c" << "streams", "Równoległe strumienie echo.", "count", "4");
+    QCommandLineOption payloadOption(QStringList() << "b" << "payload", "Bajty na strumień [B].", "bytes", "1048576");
+    QCommandLineOption maxPayloadOption(QStringList() << "max-payload", "maxPayload urządzenia w CNXN [B].", "bytes", "4096");
+    QCommandLineOption timeoutOption(QStringList() << "t" << "timeout", "Limit na etap scenariusza [ms].", "ms", "10000");
+    parser.addOptions({streamsOption, payloadOption, maxPayloadOption, timeoutOption});
+    parser.process(a);
+    const int timeoutMs = qMax(100, parser.value(timeoutOption).toInt());
+
+    QTemporaryDir dir;
+    const QString clientKey = dir.filePath("adbkey");
+    const QString otherKey = dir.filePath("otherkey");
+    if (!dir.isValid() || !generateKey(clientKey) || !generateKey(otherKey)) {
+        qCritical() << "Nie można wygenerować kluczy RSA.";
+        return 1;}
+
+    bool ok = runSession(clientKey, qMax(1, parser.value(streamsOption).toInt()), qMax(1, parser.value(payloadOption).toInt()),
+                         qBound(256u, parser.value(maxPayloadOption).toUInt(), 256u * 1024), timeoutMs);
+    ok = runAuthRejected(clientKey, otherKey, timeoutMs) && ok;
+    ok = runPublicKeyAccepted(clientKey, otherKey, timeoutMs) && ok;
+    return ok ? 0 : 1;
+}
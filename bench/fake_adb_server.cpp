@@ -0,0 +1,250 @@
+#include "fake_adb_server.h"
+#include <QDebug>
+#include <QHostAddress>
+#include <QPointer>
+#include <QTimer>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+static const int SYNC_DATA_MAX = 64 * 1024;
+
+FakeAdbServer::FakeAdbServer(const Options &options, QObject *parent)
+    : QObject(parent), m_options(options), m_server(new QTcpServer(this)) {
+    connect(m_server, &QTcpServer::newConnection, this, &FakeAdbServer::onNewConnection);}
+
+FakeAdbServer::~FakeAdbServer() {
+    const QList<Connection*> connections = m_connections.values();
+    for (Connection *c : connections) dropConnection(c);}
+
+bool FakeAdbServer::listen(quint16 port) {
+    return m_server->listen(QHostAddress::LocalHost, port);}
+
+void FakeAdbServer::onNewConnection() {
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        Connection *c = new Connection;
+        c->socket = socket;
+        m_connections.insert(socket, c);
+        connect(socket, &QTcpSocket::readyRead, this, [this, c]() { onReadyRead(c); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, c]() { dropConnection(c); });}}
+
+void FakeAdbServer::dropConnection(Connection *c) {
+    if (!m_connections.remove(c->socket)) return;
+    c->socket->disconnect(this);
+    c->socket->abort();
+    c->socket->deleteLater();
+    delete c;}
+
+void FakeAdbServer::later(Connection *c, std::function<void(Connection*)> fn) {
+    if (m_options.latencyMs <= 0) {
+        fn(c);
+        return;}
+    QPointer<QTcpSocket> socket = c->socket;
+    QTimer::singleShot(m_options.latencyMs, this, [this, socket, fn]() {
+        if (!socket) return;
+        if (Connection *conn = m_connections.value(socket, nullptr)) fn(conn);});}
+
+void FakeAdbServer::onReadyRead(Connection *c) {
+    c->buffer.append(c->socket->readAll());
+    while (m_connections.contains(c->socket)) {
+        if (c->stage == Streaming) {
+            // stdin shell,v2 / dane po odpowiedzi - ignorujemy.
+            c->buffer.clear();
+            return;}
+        if (c->stage == Sync) {
+            if (!handleSync(c)) return;
+            continue;}
+        if (c->buffer.size() < 4) return;
+        bool ok;
+        const int length = c->buffer.left(4).toInt(&ok, 16);
+        if (!ok) {
+            writeFail(c, "bad length");
+            c->socket->disconnectFromHost();
+            return;}
+        if (c->buffer.size() < 4 + length) return;
+        const QString service = QString::fromUtf8(c->buffer.mid(4, length));
+        c->buffer.remove(0, 4 + length);
+        m_servicesHandled++;
+        if (!handleService(c, service)) return;}}
+
+bool FakeAdbServer::handleService(Connection *c, const QString &service) {
+    if (c->stage == DeviceService) {
+        handleDeviceService(c, service);
+        return c->stage == Sync;}
+    if (service.startsWith("host:transport:") || service == "host:transport-any") {
+        const QString serial = service.startsWith("host:transport:") ? service.mid(15) : m_options.serials.value(0);
+        if (!m_options.serials.contains(serial)) {
+            writeFail(c, QString("device '%1' not found").arg(serial));
+            c->socket->disconnectFromHost();
+            return false;}
+        writeOkay(c);
+        c->stage = DeviceService;
+        c->serial = serial;
+        return true;}
+    handleHostService(c, service);
+    return false;}
+
+void FakeAdbServer::handleHostService(Connection *c, const QString &service) {
+    QByteArray devices;
+    for (const QString &serial : m_options.serials) {
+        devices += QString("%1\tdevice product:fake model:Fake_Device device:fake transport_id:1\n").arg(serial).toUtf8();}
+    if (service == "host:version") {
+        writeOkay(c);
+        writeLengthPrefixed(c, "0029");
+    } else if (service == "host:devices" || service == "host:devices-l") {
+        writeOkay(c);
+        writeLengthPrefixed(c, devices);
+    } else if (service == "host:track-devices" || service == "host:track-devices-l") {
+        writeOkay(c);
+        writeLengthPrefixed(c, devices);
+        c->stage = Streaming;
+        return;
+    } else if (service == "host:list-forward") {
+        writeOkay(c);
+        writeLengthPrefixed(c, m_forwards.join('\n').toUtf8() + (m_forwards.isEmpty() ? "" : "\n"));
+    } else if (service.startsWith("host-serial:") && service.contains(":forward:")) {
+        const int at = service.indexOf(":forward:");
+        const QString serial = service.mid(12, at - 12);
+        QString spec = service.mid(at + 9);
+        if (spec.startsWith("norebind:")) spec = spec.mid(9);
+        QString local = spec.section(';', 0, 0);
+        const QString remote = spec.section(';', 1);
+        writeOkay(c);
+        QByteArray port;
+        if (local == "tcp:0") {
+            port = QByteArray::number(27183 + m_forwards.size());
+            local = "tcp:" + QString::fromLatin1(port);}
+        m_forwards << QString("%1 %2 %3").arg(serial, local, remote);
+        writeOkay(c);
+        if (!port.isEmpty()) writeLengthPrefixed(c, port);
+    } else if (service.startsWith("host-serial:") && service.contains(":killforward:")) {
+        const QString local = service.mid(service.indexOf(":killforward:") + 13);
+        writeOkay(c);
+        const int before = m_forwards.size();
+        m_forwards.erase(std::remove_if(m_forwards.begin(), m_forwards.end(), [&local](const QString &f) {
+            return f.section(' ', 1, 1) == local;}), m_forwards.end());
+        if (m_forwards.size() == before) {
+            writeFail(c, QString("listener '%1' not found").arg(local));
+        } else {
+            writeOkay(c);}
+    } else {
+        writeFail(c, QString("unknown host service '%1'").arg(service));}
+    c->socket->disconnectFromHost();}
+
+void FakeAdbServer::handleDeviceService(Connection *c, const QString &service) {
+    if (service == "sync:") {
+        writeOkay(c);
+        c->stage = Sync;
+        return;}
+    const bool shellV2 = service.startsWith("shell,v2,raw:") || service.startsWith("shell,v2:");
+    const bool raw = service.startsWith("shell:") || service.startsWith("exec:");
+    if (!shellV2 && !raw) {
+        writeFail(c, QString("unknown service '%1'").arg(service));
+        c->socket->disconnectFromHost();
+        return;}
+    c->stage = Streaming;
+    const QString command = service.section(':', 1);
+    later(c, [this, shellV2, command](Connection *conn) {
+        writeOkay(conn);
+        const QByteArray output = shellOutput(command);
+        if (shellV2) {
+            writeShellPacket(conn, 1, output);
+            writeShellPacket(conn, 3, QByteArray(1, static_cast<char>(m_options.exitCode)));
+        } else {
+            conn->socket->write(output);}
+        conn->socket->disconnectFromHost();});}
+
+bool FakeAdbServer::handleSync(Connection *c) {
+    if (c->buffer.size() < 8) return false;
+    const QByteArray id = c->buffer.left(4);
+    const quint32 value = qFromLittleEndian<quint32>(c->buffer.constData() + 4);
+    const bool hasPayload = (id == "STAT" || id == "SEND" || id == "RECV" || id == "DATA");
+    if (hasPayload && static_cast<quint32>(c->buffer.size()) < 8 + value) return false;
+    const QByteArray payload = hasPayload ? c->buffer.mid(8, static_cast<int>(value)) : QByteArray();
+    c->buffer.remove(0, 8 + payload.size());
+    if (id == "STAT") {
+        const QString path = QString::fromUtf8(payload);
+        later(c, [this, path](Connection *conn) {
+            const auto it = m_files.constFind(path);
+            writeSyncHeader(conn, "STAT", it == m_files.constEnd() ? 0 : it->mode);
+            char tail[8];
+            qToLittleEndian<quint32>(it == m_files.constEnd() ? 0 : static_cast<quint32>(it->data.size()), tail);
+            qToLittleEndian<quint32>(it == m_files.constEnd() ? 0 : it->mtime, tail + 4);
+            conn->socket->write(tail, sizeof(tail));});
+    } else if (id == "SEND") {
+        const QString spec = QString::fromUtf8(payload);
+        c->sending = true;
+        c->sendPath = spec.section(',', 0, 0);
+        c->sendMode = spec.section(',', 1).toUInt();
+        c->sendData.clear();
+    } else if (id == "DATA" && c->sending) {
+        c->sendData.append(payload);
+    } else if (id == "DONE" && c->sending) {
+        File &f = m_files[c->sendPath];
+        f.data = c->sendData;
+        f.mode = c->sendMode ? c->sendMode : 0100644;
+        f.mtime = value ? value : static_cast<quint32>(QDateTime::currentSecsSinceEpoch());
+        c->sending = false;
+        c->sendData.clear();
+        later(c, [this](Connection *conn) { writeSyncHeader(conn, "OKAY", 0); });
+    } else if (id == "RECV") {
+        const QString path = QString::fromUtf8(payload);
+        later(c, [this, path](Connection *conn) {
+            const auto it = m_files.constFind(path);
+            if (it == m_files.constEnd()) {
+                const QByteArray message = "No such file or directory";
+                writeSyncHeader(conn, "FAIL", static_cast<quint32>(message.size()));
+                conn->socket->write(message);
+                return;}
+            for (int offset = 0; offset < it->data.size(); offset += SYNC_DATA_MAX) {
+                const QByteArray chunk = it->data.mid(offset, SYNC_DATA_MAX);
+                writeSyncHeader(conn, "DATA", static_cast<quint32>(chunk.size()));
+                conn->socket->write(chunk);}
+            writeSyncHeader(conn, "DONE", 0);});
+    } else if (id == "QUIT") {
+        c->stage = Streaming;
+        c->socket->disconnectFromHost();
+        return false;
+    } else {
+        const QByteArray message = "unknown sync command " + id;
+        writeSyncHeader(c, "FAIL", static_cast<quint32>(message.size()));
+        c->socket->write(message);}
+    return true;}
+
+QByteArray FakeAdbServer::shellOutput(const QString &command) const {
+    if (command.startsWith("echo ")) return command.mid(5).toUtf8() + '\n';
+    if (command.startsWith("sha256sum ")) {
+        QString path = command.mid(10).trimmed();
+        if (path.startsWith('\'') && path.endsWith('\'')) path = path.mid(1, path.size() - 2);
+        const auto it = m_files.constFind(path);
+        if (it == m_files.constEnd()) return QByteArray();
+        return QCryptographicHash::hash(it->data, QCryptographicHash::Sha256).toHex() + "  " + path.toUtf8() + '\n';}
+    QByteArray output(qMax(0, m_options.payloadBytes), 'x');
+    if (!output.isEmpty()) output[output.size() - 1] = '\n';
+    return output;}
+
+void FakeAdbServer::writeOkay(Connection *c) {c->socket->write("OKAY", 4);}
+
+void FakeAdbServer::writeFail(Connection *c, const QString &message) {
+    c->socket->write("FAIL", 4);
+    writeLengthPrefixed(c, message.toUtf8());}
+
+void FakeAdbServer::writeLengthPrefixed(Connection *c, const QByteArray &data) {
+    c->socket->write(QByteArray::number(data.size(), 16).rightJustified(4, '0'));
+    c->socket->write(data);}
+
+void FakeAdbServer::writeShellPacket(Connection *c, quint8 id, const QByteArray &data) {
+    char header[5];
+    header[0] = static_cast<char>(id);
+    qToLittleEndian<quint32>(static_cast<quint32>(data.size()), header + 1);
+    c->socket->write(header, sizeof(header));
+    if (!data.isEmpty()) c->socket->write(data);}
+
+void FakeAdbServer::writeSyncHeader(Connection *c, const char id[4], quint32 value) {
+    char header[8];
+    memcpy(header, id, 4);
+    qToLittleEndian<quint32>(value, header + 4);
+    c->socket->write(header, sizeof(header));}
@@ -0,0 +1,74 @@
+#pragma once
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHash>
+#include <QStringList>
+#include <functional>
+
+// Zastępczy serwer ADB na loopbacku: host:version/devices/transport, forward/killforward,
+// shell:, exec:, shell,v2 i sync: (STAT/SEND/RECV na plikach w pamięci).
+// Każda odpowiedź usługi urządzenia jest opóźniana o latencyMs, a shell zwraca
+// payloadBytes bajtów - dzięki temu benchmark mierzy sam AdbClient, nie telefon.
+class FakeAdbServer : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        QStringList serials = QStringList() << "fake-0001";
+        int latencyMs = 0;
+        int payloadBytes = 64;
+        int exitCode = 0;
+    };
+
+    explicit FakeAdbServer(const Options &options, QObject *parent = nullptr);
+    ~FakeAdbServer() override;
+
+    bool listen(quint16 port = 0);
+    quint16 port() const { return m_server->serverPort(); }
+    const Options &options() const { return m_options; }
+    quint64 servicesHandled() const { return m_servicesHandled; }
+    int fileCount() const { return m_files.size(); }
+
+private slots:
+    void onNewConnection();
+
+private:
+    enum Stage { HostService, DeviceService, Sync, Streaming };
+    struct Connection {
+        QTcpSocket *socket = nullptr;
+        QByteArray buffer;
+        Stage stage = HostService;
+        QString serial;
+        // sync: SEND w toku
+        bool sending = false;
+        QString sendPath;
+        quint32 sendMode = 0;
+        QByteArray sendData;
+    };
+    struct File {
+        QByteArray data;
+        quint32 mode = 0100644;
+        quint32 mtime = 0;
+    };
+
+    Options m_options;
+    QTcpServer *m_server;
+    QHash<QTcpSocket*, Connection*> m_connections;
+    QHash<QString, File> m_files;
+    QStringList m_forwards;
+    quint64 m_servicesHandled = 0;
+
+    void onReadyRead(Connection *c);
+    bool handleService(Connection *c, const QString &service);
+    void handleHostService(Connection *c, const QString &service);
+    void handleDeviceService(Connection *c, const QString &service);
+    bool handleSync(Connection *c);
+    void later(Connection *c, std::function<void(Connection*)> fn);
+    void writeOkay(Connection *c);
+    void writeFail(Connection *c, const QString &message);
+    void writeLengthPrefixed(Connection *c, const QByteArray &data);
+    void writeShellPacket(Connection *c, quint8 id, const QByteArray &data);
+    void writeSyncHeader(Connection *c, const char id[4], quint32 value);
+    QByteArray shellOutput(const QString &command) const;
+    void dropConnection(Connection *c);
+};
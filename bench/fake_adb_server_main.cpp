@@ -0,0 +1,31 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include "fake_adb_server.h"
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("fake_adb_server");
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption portOption(QStringList() << "p" << "port", "Port nasłuchu (domyślnie 5038).", "port", "5038");
+    QCommandLineOption serialOption(QStringList() << "d" << "device-serial", "Serial udawanego urządzenia (można powtarzać).", "serial");
+    QCommandLineOption latencyOption(QStringList() << "l" << "latency", "Opóźnienie odpowiedzi usług urządzenia [ms].", "ms", "0");
+    QCommandLineOption payloadOption(QStringList() << "b" << "payload", "Rozmiar wyjścia shell [B].", "bytes", "64");
+    QCommandLineOption exitOption(QStringList() << "e" << "exit-code", "Kod wyjścia zwracany przez shell,v2.", "code", "0");
+    parser.addOptions({portOption, serialOption, latencyOption, payloadOption, exitOption});
+    parser.process(a);
+
+    FakeAdbServer::Options options;
+    if (parser.isSet(serialOption)) options.serials = parser.values(serialOption);
+    options.latencyMs = parser.value(latencyOption).toInt();
+    options.payloadBytes = parser.value(payloadOption).toInt();
+    options.exitCode = parser.value(exitOption).toInt();
+    FakeAdbServer server(options);
+    if (!server.listen(parser.value(portOption).toUShort())) {
+        qCritical() << "Nie można nasłuchiwać na porcie" << parser.value(portOption);
+        return 1;}
+    qDebug() << "fake adb server na 127.0.0.1:" << server.port() << "urządzenia:" << options.serials
+             << "latency" << options.latencyMs << "ms, payload" << options.payloadBytes << "B";
+    return a.exec();
+}
@@ -0,0 +1,243 @@
+#include "fake_adbd.h"
+#include <QDebug>
+#include <QFile>
+#include <QHostAddress>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QtEndian>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+
+static const quint32 A_CNXN = 0x4e584e43;
+static const quint32 A_AUTH = 0x48545541;
+static const quint32 A_OPEN = 0x4e45504f;
+static const quint32 A_OKAY = 0x59414b4f;
+static const quint32 A_WRTE = 0x45545257;
+static const quint32 A_CLSE = 0x45534c43;
+static const quint32 A_VERSION = 0x01000001;
+static const quint32 MAX_MESSAGE = 256 * 1024;
+static const int HEADER_SIZE = 24;
+static const int TOKEN_SIZE = 20;
+
+static const quint32 AUTH_TOKEN = 1;
+static const quint32 AUTH_SIGNATURE = 2;
+static const quint32 AUTH_RSAPUBLICKEY = 3;
+
+FakeAdbd::FakeAdbd(const Options &options, QObject *parent)
+    : QObject(parent), m_options(options), m_server(new QTcpServer(this)) {
+    connect(m_server, &QTcpServer::newConnection, this, &FakeAdbd::onNewConnection);}
+
+FakeAdbd::~FakeAdbd() {
+    const QList<Connection*> connections = m_connections.values();
+    for (Connection *c : connections) dropConnection(c);}
+
+bool FakeAdbd::listen(quint16 port) {
+    return m_server->listen(QHostAddress::LocalHost, port);}
+
+void FakeAdbd::onNewConnection() {
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        Connection *c = new Connection;
+        c->socket = socket;
+        m_connections.insert(socket, c);
+        m_stats.connections++;
+        connect(socket, &QTcpSocket::readyRead, this, [this, c]() { onReadyRead(c); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, c]() { dropConnection(c); });}}
+
+void FakeAdbd::dropConnection(Connection *c) {
+    if (!m_connections.remove(c->socket)) return;
+    c->socket->disconnect(this);
+    c->socket->abort();
+    c->socket->deleteLater();
+    qDeleteAll(c->streams);
+    delete c;}
+
+void FakeAdbd::onReadyRead(Connection *c) {
+    c->buffer.append(c->socket->readAll());
+    while (c->buffer.size() >= HEADER_SIZE && m_connections.contains(c->socket)) {
+        const char *h = c->buffer.constData();
+        const quint32 command = qFromLittleEndian<quint32>(h);
+        const quint32 arg0 = qFromLittleEndian<quint32>(h + 4);
+        const quint32 arg1 = qFromLittleEndian<quint32>(h + 8);
+        const quint32 length = qFromLittleEndian<quint32>(h + 12);
+        const quint32 check = qFromLittleEndian<quint32>(h + 16);
+        const quint32 magic = qFromLittleEndian<quint32>(h + 20);
+        if (magic != (command ^ 0xffffffff) || length > MAX_MESSAGE) {
+            m_stats.protocolErrors++;
+            qWarning() << "FakeAdbd: uszkodzony nagłówek" << Qt::hex << command;
+            dropConnection(c);
+            return;}
+        if (static_cast<quint32>(c->buffer.size()) < HEADER_SIZE + length) return;
+        const QByteArray data = c->buffer.mid(HEADER_SIZE, static_cast<int>(length));
+        c->buffer.remove(0, HEADER_SIZE + static_cast<int>(length));
+        quint32 sum = 0;
+        for (char ch : data) sum += static_cast<quint8>(ch);
+        if (sum != check) m_stats.protocolErrors++;
+        handleMessage(c, command, arg0, arg1, data);}}
+
+void FakeAdbd::handleMessage(Connection *c, quint32 command, quint32 arg0, quint32 arg1, const QByteArray &data) {
+    if (command == A_CNXN) {
+        c->hostMaxPayload = qMin(arg1, MAX_MESSAGE);
+        if (m_options.requireAuth) {
+            sendToken(c);
+        } else {
+            sendConnect(c);}
+        return;}
+    if (command == A_AUTH) {
+        handleAuth(c, arg0, data);
+        return;}
+    if (!c->online) {
+        // Przed CNXN od urządzenia host nie może otwierać strumieni.
+        m_stats.protocolErrors++;
+        return;}
+    if (command == A_OPEN) {
+        handleOpen(c, arg0, QString::fromUtf8(data).remove(QChar('\0')));
+        return;}
+    Stream *s = c->streams.value(arg1, nullptr);
+    if (!s || s->remoteId != arg0) {
+        if (command == A_WRTE) sendMessage(c, A_CLSE, arg1, arg0);
+        return;}
+    if (command == A_WRTE) {
+        handleWrite(c, s, data);
+    } else if (command == A_OKAY) {
+        if (!s->deviceWriteInFlight) m_stats.ackViolations++;
+        s->deviceWriteInFlight = false;
+        pump(c, s);
+    } else if (command == A_CLSE) {
+        c->streams.remove(s->localId);
+        delete s;
+    } else {
+        m_stats.protocolErrors++;}}
+
+void FakeAdbd::handleAuth(Connection *c, quint32 type, const QByteArray &data) {
+    if (c->online || c->token.isEmpty()) {
+        m_stats.protocolErrors++;
+        return;}
+    if (type == AUTH_SIGNATURE) {
+        if (verifySignature(c->token, data)) {
+            m_stats.signaturesAccepted++;
+            sendConnect(c);
+            return;}
+        // Prawdziwy adbd po nieznanym podpisie wysyła nowy token i czeka na RSAPUBLICKEY.
+        m_stats.signaturesRejected++;
+        sendToken(c);
+    } else if (type == AUTH_RSAPUBLICKEY) {
+        m_stats.publicKeysOffered++;
+        if (m_options.acceptPublicKey) {
+            sendConnect(c);
+        } else {
+            // Urządzenie czekałoby na użytkownika; tu odmowa - kolejny token, host się poddaje.
+            sendToken(c);}
+    } else {
+        m_stats.protocolErrors++;}}
+
+void FakeAdbd::handleOpen(Connection *c, quint32 remoteId, const QString &service) {
+    Stream *s = new Stream;
+    s->remoteId = remoteId;
+    if (service == "echo:") {
+        s->echo = true;
+    } else if (service.startsWith("source:")) {
+        bool ok;
+        const int size = service.mid(7).toInt(&ok);
+        if (!ok || size < 0) {
+            delete s;
+            m_stats.streamsRejected++;
+            sendMessage(c, A_CLSE, 0, remoteId);
+            return;}
+        s->outgoing.reserve(size);
+        for (int i = 0; i < size; ++i) s->outgoing.append(static_cast<char>('a' + i % 26));
+        s->closeAfterSend = true;
+    } else {
+        delete s;
+        m_stats.streamsRejected++;
+        sendMessage(c, A_CLSE, 0, remoteId);
+        return;}
+    s->localId = c->nextLocalId++;
+    c->streams.insert(s->localId, s);
+    m_stats.streamsOpened++;
+    sendMessage(c, A_OKAY, s->localId, remoteId);
+    pump(c, s);}
+
+void FakeAdbd::handleWrite(Connection *c, Stream *s, const QByteArray &data) {
+    if (s->hostWriteUnacked) m_stats.flowViolations++;
+    if (static_cast<quint32>(data.size()) > m_options.maxPayload) m_stats.protocolErrors++;
+    m_stats.hostWrites++;
+    m_stats.hostBytes += data.size();
+    m_stats.maxHostWriteSize = qMax(m_stats.maxHostWriteSize, static_cast<int>(data.size()));
+    s->hostWriteUnacked = true;
+    if (s->echo) s->outgoing.append(data);
+    // OKAY z opóźnieniem: host, który nie czeka na OKAY, zdąży wysłać następny WRTE.
+    QPointer<QTcpSocket> socket = c->socket;
+    const quint32 localId = s->localId;
+    QTimer::singleShot(m_options.okayDelayMs, this, [this, socket, localId]() {
+        if (!socket) return;
+        Connection *conn = m_connections.value(socket, nullptr);
+        Stream *stream = conn ? conn->streams.value(localId, nullptr) : nullptr;
+        if (!stream) return;
+        stream->hostWriteUnacked = false;
+        sendMessage(conn, A_OKAY, stream->localId, stream->remoteId);});
+    pump(c, s);}
+
+void FakeAdbd::pump(Connection *c, Stream *s) {
+    if (s->deviceWriteInFlight) return;
+    if (!s->outgoing.isEmpty()) {
+        const int size = static_cast<int>(qMin(m_options.maxPayload, c->hostMaxPayload));
+        const QByteArray chunk = s->outgoing.left(size);
+        s->outgoing.remove(0, chunk.size());
+        s->deviceWriteInFlight = true;
+        m_stats.deviceWrites++;
+        sendMessage(c, A_WRTE, s->localId, s->remoteId, chunk);
+        return;}
+    if (s->closeAfterSend) closeStream(c, s);}
+
+void FakeAdbd::closeStream(Connection *c, Stream *s) {
+    sendMessage(c, A_CLSE, s->localId, s->remoteId);
+    c->streams.remove(s->localId);
+    delete s;}
+
+void FakeAdbd::sendToken(Connection *c) {
+    c->token.resize(TOKEN_SIZE);
+    QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(c->token.data()), TOKEN_SIZE / 4);
+    sendMessage(c, A_AUTH, AUTH_TOKEN, 0, c->token);}
+
+void FakeAdbd::sendConnect(Connection *c) {
+    c->online = true;
+    c->token.clear();
+    sendMessage(c, A_CNXN, A_VERSION, m_options.maxPayload,
+                QByteArray("device::ro.product.name=fake;ro.product.model=Fake_Device;features=shell_v2,cmd") + '\0');}
+
+void FakeAdbd::sendMessage(Connection *c, quint32 command, quint32 arg0, quint32 arg1, const QByteArray &data) {
+    quint32 check = 0;
+    for (char ch : data) check += static_cast<quint8>(ch);
+    char header[HEADER_SIZE];
+    qToLittleEndian<quint32>(command, header);
+    qToLittleEndian<quint32>(arg0, header + 4);
+    qToLittleEndian<quint32>(arg1, header + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(data.size()), header + 12);
+    qToLittleEndian<quint32>(check, header + 16);
+    qToLittleEndian<quint32>(command ^ 0xffffffff, header + 20);
+    c->socket->write(header, HEADER_SIZE);
+    if (!data.isEmpty()) c->socket->write(data);}
+
+bool FakeAdbd::verifySignature(const QByteArray &token, const QByteArray &signature) const {
+    for (const QString &path : m_options.trustedKeys) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        const QByteArray pem = file.readAll();
+        BIO *bio = BIO_new_mem_buf(pem.constData(), pem.size());
+        EVP_PKEY *key = PEM_read_bio_PrivateKey(bio, nullptr, nullptr, nullptr);
+        BIO_free(bio);
+        if (!key) continue;
+        // Jak adbd: RSA_verify(NID_sha1) na tokenie traktowanym jako gotowy skrót.
+        EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(key, nullptr);
+        const bool ok = ctx && EVP_PKEY_verify_init(ctx) > 0 &&
+                        EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) > 0 &&
+                        EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha1()) > 0 &&
+                        EVP_PKEY_verify(ctx, reinterpret_cast<const unsigned char*>(signature.constData()), signature.size(),
+                                        reinterpret_cast<const unsigned char*>(token.constData()), token.size()) == 1;
+        EVP_PKEY_CTX_free(ctx);
+        EVP_PKEY_free(key);
+        if (ok) return true;}
+    return false;}
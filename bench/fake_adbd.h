@@ -0,0 +1,88 @@
+#pragma once
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHash>
+#include <QStringList>
+
+// Zastępczy adbd na loopbacku dla AdbdConnection: CNXN, AUTH (token, podpis sprawdzany
+// kluczem z trustedKeys, RSAPUBLICKEY), OPEN/WRTE/OKAY/CLSE. Usługi:
+//   echo:      - odsyła wszystko, co przyjdzie
+//   source:N   - wysyła N bajtów i zamyka strumień
+// Inne usługi są odrzucane (CLSE zamiast OKAY na OPEN). Pilnuje też kontroli przepływu
+// hosta: drugi WRTE przed OKAY na poprzedni liczy się jako naruszenie.
+class FakeAdbd : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        QStringList trustedKeys;        // klucze prywatne PEM (adbd trzyma publiczne w adb_keys)
+        bool requireAuth = true;
+        bool acceptPublicKey = false;   // true = "Allow USB debugging?" zaakceptowane
+        quint32 maxPayload = 4096;
+        int okayDelayMs = 1;            // opóźnienie OKAY na WRTE hosta - okno na naruszenie
+    };
+
+    struct Stats {
+        int connections = 0;
+        int signaturesAccepted = 0;
+        int signaturesRejected = 0;
+        int publicKeysOffered = 0;
+        int streamsOpened = 0;
+        int streamsRejected = 0;
+        quint64 hostWrites = 0;
+        quint64 hostBytes = 0;
+        quint64 deviceWrites = 0;
+        int maxHostWriteSize = 0;
+        int flowViolations = 0;         // WRTE hosta przed OKAY na poprzedni
+        int ackViolations = 0;          // OKAY hosta bez WRTE w locie
+        int protocolErrors = 0;
+    };
+
+    explicit FakeAdbd(const Options &options, QObject *parent = nullptr);
+    ~FakeAdbd() override;
+
+    bool listen(quint16 port = 0);
+    quint16 port() const { return m_server->serverPort(); }
+    const Stats &stats() const { return m_stats; }
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Stream {
+        quint32 localId = 0;
+        quint32 remoteId = 0;
+        bool echo = false;
+        bool hostWriteUnacked = false;  // WRTE hosta czeka na nasze OKAY
+        bool deviceWriteInFlight = false;
+        bool closeAfterSend = false;
+        QByteArray outgoing;
+    };
+    struct Connection {
+        QTcpSocket *socket = nullptr;
+        QByteArray buffer;
+        bool online = false;
+        quint32 hostMaxPayload = 4096;
+        QByteArray token;
+        QHash<quint32, Stream*> streams;
+        quint32 nextLocalId = 1;
+    };
+
+    Options m_options;
+    QTcpServer *m_server;
+    QHash<QTcpSocket*, Connection*> m_connections;
+    Stats m_stats;
+
+    void onReadyRead(Connection *c);
+    void handleMessage(Connection *c, quint32 command, quint32 arg0, quint32 arg1, const QByteArray &data);
+    void handleAuth(Connection *c, quint32 type, const QByteArray &data);
+    void handleOpen(Connection *c, quint32 remoteId, const QString &service);
+    void handleWrite(Connection *c, Stream *s, const QByteArray &data);
+    void sendToken(Connection *c);
+    void sendConnect(Connection *c);
+    void sendMessage(Connection *c, quint32 command, quint32 arg0, quint32 arg1, const QByteArray &data = QByteArray());
+    void pump(Connection *c, Stream *s);
+    void closeStream(Connection *c, Stream *s);
+    bool verifySignature(const QByteArray &token, const QByteArray &signature) const;
+    void dropConnection(Connection *c);
+};
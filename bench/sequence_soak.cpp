@@ -0,0 +1,103 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <cstdio>
+#include "sequence_program.h"
+#include "sequence_simulator.h"
+
+// Długa pętla sterowania w symulatorze (zegar wirtualny, bez urządzenia): repeat z N
+// krokami, add, if na lastExit i captureAs na końcu. Sprawdza liczbę wykonanych kroków,
+// końcowe pc, liczniki pętli i zmienne - jedna linia JSON, kod 1 przy rozbieżności.
+//
+// [ {"set": {"n": 0, "failed": 0}},
+//   {"repeat": N, "as": "i", "do": [
+//       {"command": "input tap ${i} 100", "runMode": "shell", "stopOnError": false, "delayAfterMs": D},
+//       {"add": {"n": 1}},
+//       {"if": "lastExit != 0", "then": [ {"add": {"failed": 1}} ]} ]},
+//   {"command": "echo ${n}", "runMode": "shell", "captureAs": "final", "delayAfterMs": 0} ]
+
+static QJsonArray soakSequence(int iterations, int delayMs) {
+    QJsonObject tap;
+    tap["command"] = "input tap ${i} 100";
+    tap["runMode"] = "shell";
+    tap["stopOnError"] = false;
+    tap["delayAfterMs"] = delayMs;
+    QJsonObject count;
+    count["add"] = QJsonObject{{"n", 1}};
+    QJsonObject onFailure;
+    onFailure["if"] = "lastExit != 0";
+    onFailure["then"] = QJsonArray{QJsonObject{{"add", QJsonObject{{"failed", 1}}}}};
+    QJsonObject loop;
+    loop["repeat"] = iterations;
+    loop["as"] = "i";
+    loop["do"] = QJsonArray{tap, count, onFailure};
+    QJsonObject echo;
+    echo["command"] = "echo ${n}";
+    echo["runMode"] = "shell";
+    echo["captureAs"] = "final";
+    echo["delayAfterMs"] = 0;
+    return QJsonArray{QJsonObject{{"set", QJsonObject{{"n", 0}, {"failed", 0}}}}, loop, echo};}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("sequence_soak");
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption iterationsOption(QStringList() << "n" << "iterations", "Liczba powtórzeń pętli.", "count", "10000");
+    QCommandLineOption failEveryOption(QStringList() << "fail-every", "Co który tap kończy się kodem 1 (0 = żaden).", "k", "7");
+    QCommandLineOption delayOption(QStringList() << "delay", "delayAfterMs kroku w pętli [ms].", "ms", "50");
+    QCommandLineOption wallOption(QStringList() << "wall-limit", "Limit czasu rzeczywistego [ms].", "ms", "600000");
+    parser.addOptions({iterationsOption, failEveryOption, delayOption, wallOption});
+    parser.process(a);
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    const int failEvery = qMax(0, parser.value(failEveryOption).toInt());
+
+    QString error;
+    const QSharedPointer<const SequenceProgram> program =
+        SequenceProgram::compile(soakSequence(iterations, qMax(0, parser.value(delayOption).toInt())), &error);
+    if (!program) {
+        qCritical() << "Kompilacja sekwencji nie powiodła się:" << error;
+        return 1;}
+
+    SequenceSimulator::Options options;
+    options.wallLimitMs = qMax(1000, parser.value(wallOption).toInt());
+    options.timelineLimit = 0;
+    options.responder = [failEvery](const SeqInstr &instr, SimulatedExecutor::Outcome *outcome) {
+        // Polecenie jest już po podstawieniu ${i} / ${n}.
+        if (instr.command.startsWith("input tap ")) {
+            const int i = instr.command.section(' ', 2, 2).toInt();
+            if (failEvery > 0 && i % failEvery == 0) outcome->exitCode = 1;
+        } else if (instr.command.startsWith("echo ")) {
+            outcome->output = instr.command.mid(5).toUtf8() + '\n';}};
+    SequenceSimulator simulator(options);
+    QJsonObject report = simulator.run(program);
+    report.remove("timeline");
+    report.remove("criticalPath");
+
+    const QJsonObject vars = report.value("variables").toObject();
+    const int failures = failEvery > 0 ? (iterations - 1) / failEvery + 1 : 0;
+    QStringList mismatches;
+    auto expect = [&mismatches](bool condition, const QString &what) { if (!condition) mismatches << what; };
+    expect(!report.contains("error") && !report.contains("aborted"), "symulacja przerwana: " + report.value("error").toString() + report.value("aborted").toString());
+    expect(report.value("success").toBool(), "sekwencja nie zakończyła się sukcesem");
+    expect(report.value("commands").toInteger() == iterations + 1, QString("commands %1 != %2").arg(report.value("commands").toInteger()).arg(iterations + 1));
+    expect(report.value("stepsDone").toInt() == iterations + 1, QString("stepsDone %1 != %2").arg(report.value("stepsDone").toInt()).arg(iterations + 1));
+    expect(report.value("finalPc").toInt() == -1, QString("finalPc %1 != -1").arg(report.value("finalPc").toInt()));
+    expect(report.value("loopCounters").toArray() == QJsonArray{iterations}, "loopCounters != [" + QString::number(iterations) + "]");
+    expect(report.value("notExecuted").toInt() == 0, "kroki niewykonane");
+    expect(vars.value("n").toString() == QString::number(iterations), "n = " + vars.value("n").toString());
+    expect(vars.value("i").toString() == QString::number(iterations - 1), "i = " + vars.value("i").toString());
+    expect(vars.value("failed").toString() == QString::number(failures), "failed = " + vars.value("failed").toString());
+    expect(vars.value("final").toString() == QString::number(iterations), "final = " + vars.value("final").toString());
+    expect(vars.value("lastExit").toString() == "0", "lastExit = " + vars.value("lastExit").toString());
+
+    report["iterations"] = iterations;
+    report["expectedFailures"] = failures;
+    report["ok"] = mismatches.isEmpty();
+    if (!mismatches.isEmpty()) report["mismatches"] = mismatches.join("; ");
+    std::printf("%s\n", QJsonDocument(report).toJson(QJsonDocument::Compact).constData());
+    return mismatches.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include "command_metrics.h"
+#include <QtAlgorithms>
+
+static const int HIST_LINEAR = 64;
+static const int HIST_SUB_BITS = 5;
+static const int HIST_SUB = 1 << HIST_SUB_BITS;
+static const int HIST_MAX_EXP = 40;
+static const int HIST_BUCKETS = HIST_LINEAR + (HIST_MAX_EXP - 6 + 1) * HIST_SUB;
+
+LatencyHistogram::LatencyHistogram() : m_buckets(HIST_BUCKETS, 0) {}
+
+int LatencyHistogram::bucketFor(qint64 us) {
+    if (us < HIST_LINEAR) return int(qMax<qint64>(0, us));
+    const int exp = 63 - int(qCountLeadingZeroBits(quint64(us)));
+    if (exp > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    const int sub = int((us >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return HIST_LINEAR + (exp - 6) * HIST_SUB + sub;}
+
+qint64 LatencyHistogram::bucketUpperUs(int index) {
+    if (index < HIST_LINEAR) return index;
+    const int exp = (index - HIST_LINEAR) / HIST_SUB + 6;
+    const int sub = (index - HIST_LINEAR) % HIST_SUB;
+    const qint64 step = qint64(1) << (exp - HIST_SUB_BITS);
+    return (qint64(1) << exp) + (sub + 1) * step - 1;}
+
+void LatencyHistogram::record(qint64 us) {
+    us = qMax<qint64>(0, us);
+    m_buckets[bucketFor(us)]++;
+    if (m_count == 0 || us < m_min) m_min = us;
+    if (us > m_max) m_max = us;
+    m_sum += us;
+    m_count++;}
+
+qint64 LatencyHistogram::percentileUs(double p) const {
+    if (m_count == 0) return 0;
+    const quint64 target = qMax<quint64>(1, quint64(qBound(0.0, p, 1.0) * m_count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        seen += m_buckets.at(i);
+        if (seen >= target) return qMin(bucketUpperUs(i), m_max);}
+    return m_max;}
+
+void LatencyHistogram::reset() {
+    m_buckets.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;}
+
+QJsonObject LatencyHistogram::toJson() const {
+    QJsonObject json;
+    json["count"] = static_cast<qint64>(m_count);
+    json["minUs"] = minUs();
+    json["meanUs"] = meanUs();
+    json["p50Us"] = percentileUs(0.50);
+    json["p90Us"] = percentileUs(0.90);
+    json["p99Us"] = percentileUs(0.99);
+    json["p999Us"] = percentileUs(0.999);
+    json["maxUs"] = m_max;
+    return json;}
+
+const char *CommandMetrics::phaseName(Phase phase) {
+    switch (phase) {
+    case Queue: return "queue";
+    case Connect: return "connect";
+    case Okay: return "okay";
+    case FirstByte: return "firstByte";
+    case Total: return "total";
+    default: return "?";}}
+
+void CommandMetrics::record(const QString &serial, const QString &path, Phase phase, qint64 us) {
+    if (phase < 0 || phase >= PhaseCount) return;
+    m_series[key(serial, path)].phases[phase].record(us);}
+
+const LatencyHistogram *CommandMetrics::histogram(const QString &serial, const QString &path, Phase phase) const {
+    const auto it = m_series.constFind(key(serial, path));
+    if (it == m_series.constEnd() || phase < 0 || phase >= PhaseCount) return nullptr;
+    return &it->phases[phase];}
+
+void CommandMetrics::reset() {m_series.clear();}
+
+QJsonObject CommandMetrics::toJson() const {
+    QJsonObject json;
+    for (auto it = m_series.constBegin(); it != m_series.constEnd(); ++it) {
+        QJsonObject phases;
+        for (int p = 0; p < PhaseCount; ++p) {
+            const LatencyHistogram &h = it->phases[p];
+            if (h.count()) phases[phaseName(Phase(p))] = h.toJson();}
+        json[it.key()] = phases;}
+    return json;}
+
+QStringList CommandMetrics::summary() const {
+    QStringList lines;
+    QStringList keys = m_series.keys();
+    keys.sort();
+    for (const QString &k : std::as_const(keys)) {
+        const Series &s = m_series[k];
+        QStringList parts;
+        for (int p = 0; p < PhaseCount; ++p) {
+            const LatencyHistogram &h = s.phases[p];
+            if (!h.count()) continue;
+            parts << QString("%1 p50=%2 p99=%3")
+                         .arg(phaseName(Phase(p)))
+                         .arg(h.percentileUs(0.50) / 1000.0, 0, 'f', 1)
+                         .arg(h.percentileUs(0.99) / 1000.0, 0, 'f', 1);}
+        lines << QString("%1 (n=%2): %3 ms").arg(k).arg(s.phases[Total].count()).arg(parts.join(", "));}
+    return lines;}
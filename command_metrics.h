@@ -0,0 +1,59 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include <QJsonObject>
+
+// Histogram opóźnień w stylu HDR: do 64 µs kubełki liniowe, dalej 32 kubełki na każdą
+// potęgę dwójki (błąd względny ~3%). Stały rozmiar, zapis to inkrementacja licznika.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(qint64 us);
+    quint64 count() const { return m_count; }
+    qint64 minUs() const { return m_count ? m_min : 0; }
+    qint64 maxUs() const { return m_max; }
+    double meanUs() const { return m_count ? double(m_sum) / m_count : 0.0; }
+    // p w [0, 1]; zwraca górną granicę kubełka, w którym leży percentyl.
+    qint64 percentileUs(double p) const;
+    void reset();
+    QJsonObject toJson() const;
+
+private:
+    static int bucketFor(qint64 us);
+    static qint64 bucketUpperUs(int index);
+
+    QVector<quint64> m_buckets;
+    quint64 m_count = 0;
+    qint64 m_sum = 0;
+    qint64 m_min = 0;
+    qint64 m_max = 0;
+};
+
+// Fazy poleceń CommandExecutora zebrane per urządzenie i ścieżka wykonania
+// (process, shell,v2, shell, root, capture, query). Nieobecna faza nie jest zapisywana.
+class CommandMetrics {
+public:
+    enum Phase { Queue, Connect, Okay, FirstByte, Total, PhaseCount };
+
+    void record(const QString &serial, const QString &path, Phase phase, qint64 us);
+    const LatencyHistogram *histogram(const QString &serial, const QString &path, Phase phase) const;
+    void reset();
+    QJsonObject toJson() const;
+    // Po jednej linii na urządzenie/ścieżkę: p50/p99 każdej fazy w ms.
+    QStringList summary() const;
+
+    static const char *phaseName(Phase phase);
+
+private:
+    struct Series {
+        LatencyHistogram phases[PhaseCount];
+    };
+
+    static QString key(const QString &serial, const QString &path) {
+        return (serial.isEmpty() ? QStringLiteral("-") : serial) + QLatin1Char('/') + path;}
+
+    QHash<QString, Series> m_series;
+};
@@ -3,168 +3,658 @@
 #include <QDebug>
 #include <QProcess>
 #include <QCoreApplication>
-#include "adb_client.h" 
+#include <QMetaObject>
+#include "adb_client.h"
+#include "adb_capture.h"
+#include "persistent_shell.h"
+#include "control_socket.h"
+#include <QTimer>
+#include <cstddef>
 
 CommandExecutor::CommandExecutor(QObject *parent) : QObject(parent) {
     m_adbPath = "adb";
     m_targetSerial = QString();
+    m_clock.start();
     m_adbClient = new AdbClient(this);
-    connect(m_adbClient, &AdbClient::adbError,
-            this, &CommandExecutor::onAdbClientError);
-    connect(m_adbClient, &AdbClient::rawDataReady,
-            this, &CommandExecutor::onAdbClientRawDataReady);
-    connect(m_adbClient, &AdbClient::commandResponseReady,
-            this, &CommandExecutor::onAdbClientCommandResponseReady);
-    m_shellProcess = new QProcess(this);
-    connect(m_shellProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), 
-            this, &CommandExecutor::onShellProcessFinished);
-    connect(m_shellProcess, &QProcess::readyReadStandardOutput, this, &CommandExecutor::readStdOut);
-    connect(m_shellProcess, &QProcess::readyReadStandardError, this, &CommandExecutor::readStdErr);
+    connect(m_adbClient, &AdbClient::requestSlice,
+            this, &CommandExecutor::onAdbRequestData);
+    connect(m_adbClient, &AdbClient::requestStateChanged,
+            this, &CommandExecutor::onAdbRequestState);
+    connect(m_adbClient, &AdbClient::requestFinished,
+            this, &CommandExecutor::onAdbRequestFinished);
+    connect(m_adbClient, &AdbClient::requestFailed,
+            this, &CommandExecutor::onAdbRequestFailed);
+    connect(m_adbClient, &AdbClient::serviceRejected,
+            this, &CommandExecutor::onAdbServiceRejected);
+    connect(m_adbClient, &AdbClient::shellStderr,
+            this, &CommandExecutor::onAdbShellStderr);
+    connect(m_adbClient, &AdbClient::shellExited,
+            this, &CommandExecutor::onAdbShellExited);
+    connect(m_adbClient, &AdbClient::deviceTrackingLost,
+            this, &CommandExecutor::onDeviceTrackingLost);
+    // Reconnect/reboot przechodzi przez offline lub zniknięcie z listy - wpisy cache są wtedy nieaktualne.
+    connect(m_adbClient, &AdbClient::deviceStateChanged,
+            this, &CommandExecutor::onDeviceStateChanged);
+    connect(m_adbClient, &AdbClient::deviceAdded, this, [this](const AdbDevice &dev) {
+        m_queryCache.invalidateDevice(dev.serial);});
+    connect(m_adbClient, &AdbClient::deviceRemoved, this, [this](const QString &serial) {
+        m_queryCache.invalidateDevice(serial);});
+    m_capture = new AdbCapture(m_adbClient, this);
+    connect(m_capture, &AdbCapture::progress, this, &CommandExecutor::onCaptureProgress);
+    connect(m_capture, &AdbCapture::finished, this, &CommandExecutor::onCaptureFinished);
 }
 
 CommandExecutor::~CommandExecutor() {stop();}
 
-void CommandExecutor::setAdbPath(const QString &path) {if (!path.isEmpty()) m_adbPath = path;}
+void CommandExecutor::setAdbPath(const QString &path) {
+    if (path.isEmpty() || path == m_adbPath) return;
+    m_adbPath = path;
+    // Powłoki uruchomione starą ścieżką nie są już właściwe.
+    for (PersistentShell *shell : std::as_const(m_shells)) {
+        if (!shell->isBusy()) shell->deleteLater();}
+    for (PersistentShell *shell : std::as_const(m_rootShells)) {
+        if (!shell->isBusy()) shell->deleteLater();}
+    m_shells.clear();
+    m_rootShells.clear();}
 
 void CommandExecutor::setTargetDevice(const QString &serial) {
     m_targetSerial = serial;
     if (m_adbClient) {
-        m_adbClient->setTargetDevice(serial);}
-    if (m_shellProcess && m_shellProcess->state() == QProcess::Running) {
-        m_shellProcess->kill();
-        m_shellProcess->waitForFinished(500);}}
+        m_adbClient->setTargetDevice(serial);}}
+
+void CommandExecutor::setConcurrencyLimits(int global, int perDevice) {
+    m_maxConcurrent = qMax(1, global);
+    m_maxPerDevice = qMax(1, perDevice);
+    pump();}
+
+void CommandExecutor::setShellCommandTimeout(int ms) {
+    m_shellTimeoutMs = qMax(0, ms);
+    for (PersistentShell *shell : std::as_const(m_shells)) shell->setCommandTimeout(m_shellTimeoutMs);
+    for (PersistentShell *shell : std::as_const(m_rootShells)) shell->setCommandTimeout(m_shellTimeoutMs);}
 
 void CommandExecutor::stop() {
-    if (m_process) {
-        if (m_process->state() == QProcess::Running) {
-            m_process->kill();
-            m_process->waitForFinished(500);}
-        m_process->disconnect();
-        delete m_process;
-        m_process = nullptr;}
-    if (m_shellProcess && m_shellProcess->state() == QProcess::Running) {
-        m_shellProcess->kill();    
-        m_shellProcess->waitForFinished(500);}}
+    // Najpierw czekający i trafienia w cache - inaczej anulowany lider awansowałby czekającego.
+    m_cacheDeliveries.clear();
+    const QList<quint64> waiters = m_queryLeader.keys();
+    for (quint64 id : waiters) cancel(id);
+    const QList<quint64> ids = m_jobs.keys();
+    for (quint64 id : ids) cancel(id);}
 
 void CommandExecutor::cancelCurrentCommand() {stop();}
 
-bool CommandExecutor::isRunning() const {return m_process && m_process->state() == QProcess::Running; }
+bool CommandExecutor::isRunning() const {
+    return !m_jobs.isEmpty() || !m_queryLeader.isEmpty() || !m_cacheDeliveries.isEmpty();}
 
-void CommandExecutor::runAdbCommand(const QStringList &args) {
-    stop();
-    m_process = new QProcess(this);
-    connect(m_process, &QProcess::readyReadStandardOutput, this, &CommandExecutor::readStdOut);
-    connect(m_process, &QProcess::readyReadStandardError, this, &CommandExecutor::readStdErr);
-    connect(m_process, &QProcess::started, this, &CommandExecutor::onStarted);
-    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-    this, &CommandExecutor::onFinished);
-    QStringList finalArgs;
-    if (!m_targetSerial.isEmpty()) {
-        finalArgs << "-s" << m_targetSerial;}
-    finalArgs.append(args);
-    m_process->start(m_adbPath, finalArgs);}
+void CommandExecutor::cancel(quint64 id) {
+    // Trafienie w cache i czekający na cudze zapytanie nie mają zadania - znikają bez sygnałów.
+    if (m_cacheDeliveries.remove(id)) return;
+    if (m_queryLeader.contains(id)) {
+        const quint64 leader = m_queryLeader.take(id);
+        auto it = m_queryWaiters.find(leader);
+        if (it != m_queryWaiters.end()) {
+            it->removeOne(id);
+            if (it->isEmpty()) m_queryWaiters.erase(it);}
+        return;}
+    Job *job = m_jobs.value(id, nullptr);
+    if (!job) return;
+    if (!job->query) {
+        abortJob(job);
+        return;}
+    // Anulowanie dotyczy tylko wywołującego lidera - czekający dostaną wynik z nowego wykonania.
+    const QList<quint64> waiters = m_queryWaiters.take(id);
+    const QString serial = job->serial;
+    const QString command = job->command;
+    const int ttlMs = job->ttlMs;
+    abortJob(job);
+    if (!waiters.isEmpty()) promoteQueryWaiter(serial, command, ttlMs, waiters);}
+
+void CommandExecutor::abortJob(Job *job) {
+    const quint64 id = job->id;
+    if (!job->running) {
+        // Z kolejki znika bez sygnałów - nikt jeszcze nie dostał commandStarted.
+        m_queue.removeOne(job);
+        m_jobs.remove(id);
+        const QString key = queryKey(job->serial, job->command);
+        if (job->query && m_inflightQueries.value(key) == id) m_inflightQueries.remove(key);
+        delete job;
+        return;}
+    if (job->process) {
+        job->process->disconnect(this);
+        if (job->process->state() != QProcess::NotRunning) {
+            job->process->kill();
+            job->process->waitForFinished(500);}}
+    if (job->adbRequest) {
+        m_byAdbRequest.remove(job->adbRequest);
+        m_adbClient->cancel(job->adbRequest);
+        job->adbRequest = 0;}
+    if (job->captureOp) {
+        m_byCapture.remove(job->captureOp);
+        const quint64 op = job->captureOp;
+        job->captureOp = 0;
+        m_capture->cancel(op);}
+    if (job->onShell) {
+        job->onShell = false;
+        const QHash<QString, PersistentShell*> &shells = job->root ? m_rootShells : m_shells;
+        if (PersistentShell *shell = shells.value(job->serial, nullptr)) shell->cancel(id);}
+    if (job->kind == ControlJob && job->packetOffset > 0 && job->packetOffset < job->packets.size()) {
+        // Przerwany swipe - ostatni pakiet (TOUCH_UP) podnosi palec, żeby nie został na ekranie.
+        if (ControlSocket *socket = controlSocketFor(job->serial)) {
+            socket->sendPackets(job->packets.right(int(sizeof(ControlPacket))));}}
+    finishJob(job, -1, QProcess::CrashExit);}
+
+quint64 CommandExecutor::runAdbCommand(const QStringList &args, const QString &serial) {
+    Job *job = new Job;
+    job->kind = ProcessJob;
+    job->serial = serial.isEmpty() ? m_targetSerial : serial;
+    job->args = args;
+    job->command = args.join(' ');
+    return enqueue(job);}
 
-void CommandExecutor::executeAdbCommand(const QString &command) {
+quint64 CommandExecutor::executeAdbCommand(const QString &command) {
     QStringList args = command.split(' ', Qt::SkipEmptyParts);
-    runAdbCommand(args);
+    return runAdbCommand(args);
 }
 
-void CommandExecutor::executeShellCommand(const QString &command) {
-    ensureShellRunning();
-    if (m_shellProcess->state() != QProcess::Running) {
-        qCritical() << "Cannot execute shell command, persistent shell is not running.";
-        return;}
-    QByteArray cmdData = (command + "\n").toUtf8();
-    m_shellProcess->write(cmdData);}
+quint64 CommandExecutor::executeShellCommand(const QString &command, const QString &serial) {
+    Job *job = new Job;
+    job->kind = PersistentShellJob;
+    job->serial = serial.isEmpty() ? m_targetSerial : serial;
+    job->command = command;
+    return enqueue(job);}
+
+quint64 CommandExecutor::executeRootShellCommand(const QString &command, const QString &serial) {
+    Job *job = new Job;
+    job->kind = PersistentShellJob;
+    job->root = true;
+    job->serial = serial.isEmpty() ? m_targetSerial : serial;
+    job->command = command;
+    return enqueue(job);}
+
+PersistentShell *CommandExecutor::shellFor(const QString &serial, bool root) {
+    QHash<QString, PersistentShell*> &shells = root ? m_rootShells : m_shells;
+    PersistentShell *shell = shells.value(serial, nullptr);
+    if (shell) return shell;
+    shell = new PersistentShell(m_adbPath, serial, root, this);
+    shell->setCommandTimeout(m_shellTimeoutMs);
+    connect(shell, &PersistentShell::begun, this, &CommandExecutor::onShellBegun);
+    connect(shell, &PersistentShell::output, this, &CommandExecutor::onShellOutput);
+    connect(shell, &PersistentShell::errorOutput, this, &CommandExecutor::onShellErrorOutput);
+    connect(shell, &PersistentShell::finished, this, &CommandExecutor::onShellFinished);
+    connect(shell, &PersistentShell::failed, this, &CommandExecutor::onShellFailed);
+    shells.insert(serial, shell);
+    return shell;}
+
+void CommandExecutor::startPersistentShell(Job *job) {
+    job->kind = PersistentShellJob;
+    job->onShell = true;
+    job->exitCode = -1;
+    shellFor(job->serial, job->root)->run(job->id, job->command);}
+
+void CommandExecutor::onShellBegun(quint64 id) {
+    // Dla powłoki "połączenie" to moment, w którym polecenie faktycznie ruszyło -
+    // zawiera spawn sesji, jeśli była zimna, i czekanie na wcześniejsze polecenia.
+    Job *job = m_jobs.value(id, nullptr);
+    if (job && job->onShell) markPhase(job, &Job::connectUs);}
+
+void CommandExecutor::onShellOutput(quint64 id, const QByteArray &data) {
+    Job *job = m_jobs.value(id, nullptr);
+    if (!job || !job->onShell) return;
+    markPhase(job, &Job::firstByteUs);
+    if (job->query) job->captured.append(data);
+    emit commandRawData(id, data);
+    emit rawDataReady(data);
+    emitOutput(id, QString::fromUtf8(data));}
+
+void CommandExecutor::onShellErrorOutput(quint64 id, const QByteArray &data) {
+    Job *job = m_jobs.value(id, nullptr);
+    if (!job || !job->onShell) return;
+    markPhase(job, &Job::firstByteUs);
+    emitError(id, QString::fromUtf8(data));}
+
+void CommandExecutor::onShellFinished(quint64 id, int exitCode) {
+    Job *job = m_jobs.value(id, nullptr);
+    if (!job || !job->onShell) return;
+    job->onShell = false;
+    finishJob(job, exitCode, QProcess::NormalExit);}
 
-void CommandExecutor::executeRootShellCommand(const QString &command) {
-    runAdbCommand(QStringList() << "shell" << "su" << "-c" << command);}
+void CommandExecutor::onShellFailed(quint64 id, const QString &message) {
+    Job *job = m_jobs.value(id, nullptr);
+    if (!job || !job->onShell) return;
+    job->onShell = false;
+    emitError(id, QString("[SHELL ERROR] %1").arg(message));
+    finishJob(job, -1, QProcess::CrashExit);}
 
-void CommandExecutor::ensureShellRunning() {
-    if (m_shellProcess && m_shellProcess->state() == QProcess::Running) {
+void CommandExecutor::startDeviceTracking() {m_adbClient->startDeviceTracking();}
+
+void CommandExecutor::onDeviceTrackingLost(const QString &message) {
+    // Gdy serwer ADB nie działa, track-devices dostaje odmowę połączenia - jednorazowo go uruchamiamy.
+    if (m_adbServerStartAttempted) return;
+    m_adbServerStartAttempted = true;
+    qWarning() << "Device tracking lost:" << message << "- starting adb server.";
+    QProcess::startDetached(m_adbPath, QStringList() << "start-server");}
+
+quint64 CommandExecutor::enqueue(Job *job) {
+    // Id nadane z góry: czekający na zapytanie przejmuje wykonanie po anulowanym liderze.
+    if (job->id == 0) job->id = m_nextJobId++;
+    job->enqueuedUs = nowUs();
+    m_jobs.insert(job->id, job);
+    m_queue.append(job);
+    // Start w następnym obrocie pętli: wywołujący zdąży zapamiętać id przed commandStarted/commandFinished.
+    QMetaObject::invokeMethod(this, &CommandExecutor::pump, Qt::QueuedConnection);
+    return job->id;}
+
+bool CommandExecutor::canStart(const Job *job) const {
+    if (m_activeCount >= m_maxConcurrent) return false;
+    return m_activePerDevice.value(job->serial, 0) < m_maxPerDevice;}
+
+void CommandExecutor::pump() {
+    for (int i = 0; i < m_queue.size() && m_activeCount < m_maxConcurrent;) {
+        Job *job = m_queue.at(i);
+        if (!canStart(job)) {
+            // Urządzenie wysycone - kolejne polecenia innych urządzeń mogą ruszyć.
+            ++i;
+            continue;}
+        m_queue.removeAt(i);
+        startJob(job);}}
+
+void CommandExecutor::startJob(Job *job) {
+    job->running = true;
+    job->startedUs = nowUs();
+    m_activeCount++;
+    m_activePerDevice[job->serial]++;
+    emit commandStarted(job->id);
+    emit started();
+    switch (job->kind) {
+    case ProcessJob:
+        startProcess(job);
+        break;
+    case ShellV2Job:
+        startShellV2(job);
+        break;
+    case CaptureJob:
+        startCapture(job);
+        break;
+    case PersistentShellJob:
+        startPersistentShell(job);
+        break;
+    case ControlJob:
+        startControl(job);
+        break;}}
+
+void CommandExecutor::startProcess(Job *job) {
+    const quint64 id = job->id;
+    QProcess *process = new QProcess(this);
+    job->process = process;
+    connect(process, &QProcess::started, this, [this, id]() {
+        if (Job *j = m_jobs.value(id, nullptr)) markPhase(j, &Job::connectUs);});
+    connect(process, &QProcess::readyReadStandardOutput, this, [this, id, process]() {
+        const QByteArray data = process->readAllStandardOutput();
+        if (data.isEmpty()) return;
+        if (Job *j = m_jobs.value(id, nullptr)) markPhase(j, &Job::firstByteUs);
+        emit commandRawData(id, data);
+        emitOutput(id, QString::fromUtf8(data));});
+    connect(process, &QProcess::readyReadStandardError, this, [this, id, process]() {
+        const QByteArray data = process->readAllStandardError();
+        if (data.isEmpty()) return;
+        if (Job *j = m_jobs.value(id, nullptr)) markPhase(j, &Job::firstByteUs);
+        emitError(id, QString::fromUtf8(data));});
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [this, id](int exitCode, QProcess::ExitStatus status) {
+        if (Job *j = m_jobs.value(id, nullptr)) finishJob(j, exitCode, status);});
+    connect(process, &QProcess::errorOccurred, this, [this, id, process](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) return;
+        emitError(id, QString("Nie można uruchomić %1: %2").arg(m_adbPath, process->errorString()));
+        if (Job *j = m_jobs.value(id, nullptr)) finishJob(j, -1, QProcess::CrashExit);});
+    QStringList finalArgs;
+    if (!job->serial.isEmpty()) {
+        finalArgs << "-s" << job->serial;}
+    finalArgs.append(job->args);
+    process->start(m_adbPath, finalArgs);}
+
+void CommandExecutor::startShellV2(Job *job) {
+    qDebug() << "Executing command via AdbClient (shell,v2):" << job->command;
+    job->exitCode = -1;
+    job->fallback = false;
+    // Zakończenie przychodzi z onAdbRequestFinished/onAdbRequestFailed, z kodem z pakietu exit.
+    job->adbRequest = m_adbClient->sendShellV2(job->serial, job->command);
+    if (job->adbRequest) {
+        m_byAdbRequest.insert(job->adbRequest, job);
+        // Gniazdo z puli przechodzi do ServiceRequest jeszcze w sendShellV2.
+        onAdbRequestState(job->adbRequest, m_adbClient->requestState(job->adbRequest));
         return;}
-    qDebug() << "Starting persistent ADB shell process...";
-    QStringList args;
-    if (!m_targetSerial.isEmpty()) {
-        args << "-s" << m_targetSerial;}
-    args << "shell";
-    m_shellProcess->start(m_adbPath, args);
-    if (!m_shellProcess->waitForStarted(5000)) {    
-        qCritical() << "Failed to start persistent ADB shell!";
+    qWarning() << "AdbClient nie jest gotowy. Powrót do Persistent Shell dla:" << job->command;
+    startPersistentShell(job);}
+
+void CommandExecutor::startCapture(Job *job) {
+    const int redirect = job->command.lastIndexOf(" > ");
+    const QString deviceCommand = redirect > 0 ? job->command.left(redirect).trimmed() : QString();
+    const QString localPath = redirect > 0 ? job->command.mid(redirect + 3).trimmed() : QString();
+    if (deviceCommand.isEmpty() || localPath.isEmpty() || job->serial.isEmpty()) {
+        emitError(job->id, QString("[CAPTURE] Oczekiwano '<komenda> > <plik>' i urządzenia docelowego: %1").arg(job->command));
+        finishJob(job, 1, QProcess::NormalExit);
+        return;}
+    job->captureOp = m_capture->capture(job->serial, deviceCommand, localPath);
+    m_byCapture.insert(job->captureOp, job);}
+
+void CommandExecutor::finishJob(Job *job, int exitCode, QProcess::ExitStatus status) {
+    const quint64 id = job->id;
+    const bool query = job->query;
+    const QString serial = job->serial;
+    const QString command = job->command;
+    const QByteArray captured = job->captured;
+    const int ttlMs = job->ttlMs;
+    if (query && m_inflightQueries.value(queryKey(serial, command)) == id) m_inflightQueries.remove(queryKey(serial, command));
+    if (job->process) {
+        job->process->disconnect(this);
+        job->process->deleteLater();}
+    if (job->adbRequest) m_byAdbRequest.remove(job->adbRequest);
+    if (job->captureOp) m_byCapture.remove(job->captureOp);
+    if (job->timer) {
+        job->timer->stop();
+        job->timer->deleteLater();}
+    m_jobs.remove(id);
+    if (job->running) {
+        recordMetrics(job);
+        m_activeCount--;
+        if (--m_activePerDevice[job->serial] <= 0) m_activePerDevice.remove(job->serial);}
+    delete job;
+    emit commandFinished(id, exitCode, status);
+    emit finished(exitCode, status);
+    if (query) completeQuery(id, serial, command, captured, exitCode, ttlMs, status == QProcess::NormalExit && exitCode == 0);
+    // Bez rekurencji: slot commandFinished może od razu kolejkować następne polecenie,
+    // a synchroniczny pump zagnieżdżałby startJob -> finishJob -> pump na stosie.
+    QMetaObject::invokeMethod(this, &CommandExecutor::pump, Qt::QueuedConnection);}
+
+quint64 CommandExecutor::query(const QString &command, const QString &serial, int ttlMs) {
+    const QString target = serial.isEmpty() ? m_targetSerial : serial;
+    QByteArray cached;
+    int cachedExit = 0;
+    if (m_queryCache.lookup(target, command, &cached, &cachedExit)) {
+        const quint64 id = m_nextJobId++;
+        m_cacheDeliveries.insert(id);
+        QMetaObject::invokeMethod(this, [this, id, cached, cachedExit]() {
+            if (m_cacheDeliveries.remove(id)) deliverQuery(id, cached, cachedExit, true);}, Qt::QueuedConnection);
+        return id;}
+    const QString key = queryKey(target, command);
+    if (m_inflightQueries.contains(key)) {
+        const quint64 id = m_nextJobId++;
+        const quint64 leader = m_inflightQueries.value(key);
+        m_queryWaiters[leader].append(id);
+        m_queryLeader.insert(id, leader);
+        return id;}
+    Job *job = new Job;
+    job->kind = PersistentShellJob;
+    job->serial = target;
+    job->command = command;
+    job->query = true;
+    job->ttlMs = ttlMs;
+    const quint64 id = enqueue(job);
+    m_inflightQueries.insert(key, id);
+    return id;}
+
+bool CommandExecutor::cachedQuery(const QString &command, QByteArray *output, const QString &serial) {
+    return m_queryCache.lookup(serial.isEmpty() ? m_targetSerial : serial, command, output);}
+
+void CommandExecutor::invalidateQuery(const QString &command, const QString &serial) {
+    m_queryCache.invalidate(serial.isEmpty() ? m_targetSerial : serial, command);}
+
+void CommandExecutor::invalidateQueries(const QString &serial) {
+    if (serial.isEmpty()) {
+        m_queryCache.clear();
     } else {
-        qDebug() << "Persistent ADB shell started.";}}
+        m_queryCache.invalidateDevice(serial);}}
 
-void CommandExecutor::onShellProcessFinished(int exitCode, QProcess::ExitStatus exitStatus) {
-    qWarning() << "Persistent Shell process finished unexpectedly. Exit code:" << exitCode << "Status:" << exitStatus;
-}
+void CommandExecutor::completeQuery(quint64 id, const QString &serial, const QString &command, const QByteArray &output,
+                                    int exitCode, int ttlMs, bool store) {
+    if (store) m_queryCache.store(serial, command, output, ttlMs, exitCode);
+    emit queryFinished(id, output, exitCode, false);
+    // Czekający dostają świeży wynik z adb, nie z cache - fromCache zawsze false.
+    const QList<quint64> waiters = m_queryWaiters.take(id);
+    for (quint64 w : waiters) {
+        if (m_queryLeader.remove(w)) deliverQuery(w, output, exitCode, false);}}
+
+void CommandExecutor::promoteQueryWaiter(const QString &serial, const QString &command, int ttlMs, QList<quint64> waiters) {
+    // Pierwszy czekający przejmuje zapytanie pod swoim id - nie dostał jeszcze commandStarted.
+    Job *job = new Job;
+    job->id = waiters.takeFirst();
+    job->kind = PersistentShellJob;
+    job->serial = serial;
+    job->command = command;
+    job->query = true;
+    job->ttlMs = ttlMs;
+    m_queryLeader.remove(job->id);
+    const quint64 id = enqueue(job);
+    m_inflightQueries.insert(queryKey(serial, command), id);
+    if (waiters.isEmpty()) return;
+    for (quint64 w : std::as_const(waiters)) m_queryLeader.insert(w, id);
+    m_queryWaiters.insert(id, waiters);}
+
+void CommandExecutor::deliverQuery(quint64 id, const QByteArray &output, int exitCode, bool fromCache) {
+    // Ta sama kolejność sygnałów co przy wykonaniu - SequenceRunner i log nie widzą różnicy.
+    emit commandStarted(id);
+    emit started();
+    if (!output.isEmpty()) {
+        emit commandRawData(id, output);
+        emit rawDataReady(output);
+        emitOutput(id, QString::fromUtf8(output));}
+    emit commandFinished(id, exitCode, QProcess::NormalExit);
+    emit finished(exitCode, QProcess::NormalExit);
+    emit queryFinished(id, output, exitCode, fromCache);}
+
+void CommandExecutor::onDeviceStateChanged(const QString &serial, const QString &, const QString &) {
+    m_queryCache.invalidateDevice(serial);}
+
+void CommandExecutor::markPhase(Job *job, qint64 Job::*phase) {
+    if (job->*phase < 0) job->*phase = nowUs();}
+
+QString CommandExecutor::pathName(const Job *job) {
+    switch (job->kind) {
+    case ProcessJob: return QStringLiteral("process");
+    case ShellV2Job: return QStringLiteral("shell,v2");
+    case CaptureJob: return QStringLiteral("capture");
+    case ControlJob: return QStringLiteral("control");
+    case PersistentShellJob:
+        if (job->query) return QStringLiteral("query");
+        return job->root ? QStringLiteral("root") : QStringLiteral("shell");}
+    return QString();}
+
+void CommandExecutor::recordMetrics(const Job *job) {
+    const QString path = pathName(job);
+    const qint64 end = nowUs();
+    m_metrics.record(job->serial, path, CommandMetrics::Queue, job->startedUs - job->enqueuedUs);
+    if (job->connectUs >= 0) m_metrics.record(job->serial, path, CommandMetrics::Connect, job->connectUs - job->startedUs);
+    if (job->okayUs >= 0) m_metrics.record(job->serial, path, CommandMetrics::Okay, job->okayUs - job->startedUs);
+    if (job->firstByteUs >= 0) m_metrics.record(job->serial, path, CommandMetrics::FirstByte, job->firstByteUs - job->startedUs);
+    m_metrics.record(job->serial, path, CommandMetrics::Total, end - job->startedUs);}
+
+void CommandExecutor::emitOutput(quint64 id, const QString &text) {
+    emit commandOutput(id, text);
+    emit outputReceived(text);}
+
+void CommandExecutor::emitError(quint64 id, const QString &text) {
+    emit commandError(id, text);
+    emit errorReceived(text);}
+
+quint64 CommandExecutor::executeCapture(const QString &command, const QString &serial) {
+    Job *job = new Job;
+    job->kind = CaptureJob;
+    job->serial = serial.isEmpty() ? m_targetSerial : serial;
+    job->command = command;
+    return enqueue(job);}
+
+void CommandExecutor::onCaptureProgress(quint64 op, qint64 bytes, double bytesPerSec) {
+    if (!m_byCapture.contains(op)) return;
+    emit adbStatusChanged(QString("Capture: %1 MB (%2 MB/s)").arg(bytes / 1e6, 0, 'f', 1).arg(bytesPerSec / 1e6, 0, 'f', 1), false);}
+
+void CommandExecutor::onCaptureFinished(quint64 op, bool ok, qint64 bytes, const QString &message) {
+    Job *job = m_byCapture.take(op);
+    if (!job) return;
+    job->captureOp = 0;
+    Q_UNUSED(bytes);
+    if (ok) {
+        emitOutput(job->id, QString("[CAPTURE] %1").arg(message));
+    } else {
+        emitError(job->id, QString("[CAPTURE ERROR] %1").arg(message));}
+    finishJob(job, ok ? 0 : 1, QProcess::NormalExit);}
+
+void CommandExecutor::onAdbRequestState(quint64 id, AdbClient::RequestState state) {
+    Job *job = m_byAdbRequest.value(id, nullptr);
+    if (!job) return;
+    // Gniazdo połączone (z puli od razu ServiceRequest), OKAY usługi = Payload.
+    if (state == AdbClient::TransportRequest || state == AdbClient::ServiceRequest) {
+        markPhase(job, &Job::connectUs);
+    } else if (state == AdbClient::Payload) {
+        markPhase(job, &Job::connectUs);
+        markPhase(job, &Job::okayUs);}}
+
+void CommandExecutor::onAdbRequestData(quint64 id, const AdbSlice &data) {
+    Job *job = m_byAdbRequest.value(id, nullptr);
+    if (!job) return;
+    markPhase(job, &Job::firstByteUs);
+    const QByteArray bytes = data.toByteArray();
+    emit commandRawData(job->id, bytes);
+    emit rawDataReady(bytes);
+    emitOutput(job->id, QString::fromUtf8(data.view()));}
+
+void CommandExecutor::onAdbShellStderr(quint64 id, const QByteArray &data) {
+    Job *job = m_byAdbRequest.value(id, nullptr);
+    if (!job) return;
+    markPhase(job, &Job::firstByteUs);
+    emitError(job->id, QString::fromUtf8(data));}
 
-void CommandExecutor::onAdbClientError(const QString &message) {
+void CommandExecutor::onAdbShellExited(quint64 id, int exitCode) {
+    if (Job *job = m_byAdbRequest.value(id, nullptr)) job->exitCode = exitCode;}
+
+void CommandExecutor::onAdbServiceRejected(quint64 id, const QString &service, const QString &message) {
+    Job *job = m_byAdbRequest.value(id, nullptr);
+    if (!job || !service.startsWith("shell,v2")) return;
+    qWarning() << "Urządzenie" << job->serial << "nie obsługuje shell,v2:" << message;
+    m_shellV2Unsupported.insert(job->serial);
+    job->fallback = true;}
+
+void CommandExecutor::onAdbRequestFinished(quint64 id) {
+    Job *job = m_byAdbRequest.take(id);
+    if (!job) return;
+    job->adbRequest = 0;
+    // Brak pakietu exit oznacza przerwany strumień, a nie sukces.
+    finishJob(job, job->exitCode < 0 ? 1 : job->exitCode, QProcess::NormalExit);}
+
+void CommandExecutor::onAdbRequestFailed(quint64 id, const QString &message) {
+    Job *job = m_byAdbRequest.take(id);
+    if (!job) return;
+    job->adbRequest = 0;
+    if (job->fallback) {
+        startPersistentShell(job);
+        return;}
     // Przekazanie błędu z AdbClienta do głównego dziennika
-    emit errorReceived(QString("[ADB SOCKET ERROR] %1").arg(message));
-    emit finished(1, QProcess::NormalExit); }
-
-void CommandExecutor::onAdbClientRawDataReady(const QByteArray &data) {
-    emit rawDataReady(data);}
-
-void CommandExecutor::onAdbClientCommandResponseReady(const QByteArray &response) {
-    emit outputReceived(QString::fromUtf8(response));
-    emit finished(0, QProcess::NormalExit);}
-
-void CommandExecutor::readStdOut() {
-    if (m_process && sender() == m_process) {    
-        const QByteArray data = m_process->readAllStandardOutput();
-        if (!data.isEmpty()) emit outputReceived(QString::fromUtf8(data));}    
-    else if (m_shellProcess && sender() == m_shellProcess) {    
-        const QByteArray data = m_shellProcess->readAllStandardOutput();
-        if (!data.isEmpty()) {
-            emit outputReceived("[SHELL] " + QString::fromUtf8(data));}}}
-
-void CommandExecutor::readStdErr() {
-    if (m_process && sender() == m_process) {
-        const QByteArray data = m_process->readAllStandardError();
-        if (!data.isEmpty()) emit errorReceived(QString::fromUtf8(data));}
-    else if (m_shellProcess && sender() == m_shellProcess) {
-        const QByteArray data = m_shellProcess->readAllStandardError();
-        if (!data.isEmpty()) {
-             emit errorReceived("[SHELL ERROR] " + QString::fromUtf8(data));}}}
-
-void CommandExecutor::onStarted() {emit started();}
-
-void CommandExecutor::onFinished(int exitCode, QProcess::ExitStatus exitStatus) {
-    emit finished(exitCode, exitStatus);
-    if (m_process) {
-        m_process->disconnect();    
-        m_process->deleteLater();    
-        m_process = nullptr;}}
-
-void CommandExecutor::executeSequenceCommand(const QString &command, const QString &runMode) {
-    QString mode = runMode.toLower();    
-    if (mode == "shell" && command.startsWith("input ")) {
-        if (m_adbClient && !m_targetSerial.isEmpty() && m_adbClient->targetDevice() == m_targetSerial) {
-            qDebug() << "Executing command via AdbClient (Socket):" << command;
-            m_adbClient->sendDeviceCommand("shell:" + command);
-            emit finished(0, QProcess::NormalExit); 
-            return;}
+    emitError(job->id, QString("[ADB SOCKET ERROR] %1").arg(message));
+    finishJob(job, 1, QProcess::NormalExit);}
+
+quint64 CommandExecutor::executeSequenceCommand(const QString &command, const QString &runMode, const QString &serial) {
+    SeqInstr instr;
+    QString error;
+    if (!SequenceProgram::compileStep(command, runMode, &instr, &error)) {
+        // Nieznany tryb był zawsze traktowany jak "adb".
+        qWarning() << "executeSequenceCommand:" << error << "- uruchamiam jako adb:" << command;
+        SequenceProgram::compileStep(command, "adb", &instr, &error);}
+    return executeInstruction(instr, serial);}
+
+quint64 CommandExecutor::executeInstruction(const SeqInstr &instr, const QString &serial) {
+    const QString target = serial.isEmpty() ? m_targetSerial : serial;
+    switch (instr.op) {
+    case SeqInstr::Tap:
+    case SeqInstr::Swipe:
+    case SeqInstr::Key:
+        if (!instr.packets.isEmpty() && controlSocketFor(target)) {
+            Job *job = new Job;
+            job->kind = ControlJob;
+            job->serial = target;
+            job->command = instr.command;
+            job->packets = instr.packets;
+            job->packetIntervalMs = instr.packetIntervalMs;
+            return enqueue(job);}
+        return enqueueInput(instr.command, target);
+    case SeqInstr::Input:
+        return enqueueInput(instr.command, target);
+    case SeqInstr::Query:
+        return query(instr.command, target);
+    case SeqInstr::Capture:
+        return executeCapture(instr.command, target);
+    case SeqInstr::Root:
+        return executeRootShellCommand(instr.command, target);
+    case SeqInstr::Shell:
+        // Ramkowana, ciepła powłoka: ~5 ms zamiast spawnu "adb shell" (~150 ms), z tym samym kodem wyjścia.
+        return executeShellCommand(instr.command, target);
+    case SeqInstr::Adb:
+        break;
+    default:
+        // Jump..While wykonuje SequenceRunner bez udziału executora.
+        break;}
+    return runAdbCommand(instr.argv, target);}
+
+quint64 CommandExecutor::enqueueInput(const QString &command, const QString &serial) {
+    Job *job = new Job;
+    job->serial = serial;
+    job->command = command;
+    if (m_adbClient && !serial.isEmpty() && !m_shellV2Unsupported.contains(serial)) {
+        job->kind = ShellV2Job;
+    } else {
         qWarning() << "AdbClient nie jest gotowy lub brak urządzenia docelowego. Powrót do Persistent Shell dla:" << command;
-    }
-    if (mode == "shell" && command.startsWith("input ")) {
-        ensureShellRunning();
-        if (m_shellProcess->state() != QProcess::Running) {
-            qCritical() << "Persistent shell is not running, cannot execute fast command:" << command;
-            emit finished(1, QProcess::NormalExit);
+        job->kind = PersistentShellJob;}
+    return enqueue(job);}
+
+ControlSocket *CommandExecutor::controlSocketFor(const QString &serial) const {
+    if (!m_controlSocket || !m_controlSocket->isConnected()) return nullptr;
+    const QString socketSerial = m_controlSocket->deviceSerial();
+    if (!socketSerial.isEmpty() && socketSerial != serial) return nullptr;
+    return m_controlSocket;}
+
+void CommandExecutor::startInputFallback(Job *job) {
+    job->packets.clear();
+    if (m_adbClient && !job->serial.isEmpty() && !m_shellV2Unsupported.contains(job->serial)) {
+        job->kind = ShellV2Job;
+        startShellV2(job);
+    } else {
+        startPersistentShell(job);}}
+
+void CommandExecutor::startControl(Job *job) {
+    // Gniazdo mogło się rozłączyć, zanim zadanie wyszło z kolejki.
+    if (!controlSocketFor(job->serial)) {
+        qWarning() << "Gniazdo sterowania niedostępne. Powrót do 'input' dla:" << job->command;
+        startInputFallback(job);
+        return;}
+    markPhase(job, &Job::connectUs);
+    const quint64 id = job->id;
+    job->timer = new QTimer(this);
+    job->timer->setSingleShot(true);
+    job->timer->setTimerType(Qt::PreciseTimer);
+    connect(job->timer, &QTimer::timeout, this, [this, id]() {
+        if (Job *j = m_jobs.value(id, nullptr)) sendControlChunk(j);});
+    sendControlChunk(job);}
+
+void CommandExecutor::sendControlChunk(Job *job) {
+    // Jedna porcja na takt: wszystko do następnego TOUCH_MOVE, więc DOWN idzie od razu,
+    // każdy MOVE po packetIntervalMs, a UP razem z ostatnim MOVE. Tap i key to jedna porcja.
+    const int size = int(sizeof(ControlPacket));
+    const int typeOffset = int(offsetof(ControlPacket, type));
+    int end = job->packetOffset;
+    while (end < job->packets.size()) {
+        end += size;
+        if (end < job->packets.size() && quint8(job->packets.at(end + typeOffset)) == EVENT_TYPE_TOUCH_MOVE) break;}
+    ControlSocket *socket = controlSocketFor(job->serial);
+    if (!socket || !socket->sendPackets(job->packets.mid(job->packetOffset, end - job->packetOffset))) {
+        if (job->packetOffset == 0) {
+            qWarning() << "Zapis do gniazda sterowania nieudany. Powrót do 'input' dla:" << job->command;
+            job->timer->deleteLater();
+            job->timer = nullptr;
+            startInputFallback(job);
             return;}
-        QByteArray cmdData = (command + "\n").toUtf8();
-        m_shellProcess->write(cmdData);
-        emit finished(0, QProcess::NormalExit); 
+        emitError(job->id, QString("[CONTROL] Gniazdo sterowania rozłączone w trakcie gestu: %1").arg(job->command));
+        finishJob(job, 1, QProcess::NormalExit);
         return;}
-    else if (mode == "root") {
-        executeRootShellCommand(command);
-        return;
-    }
-    
-    else if (mode == "shell") {
-        runAdbCommand(QStringList() << "shell" << command);
+    markPhase(job, &Job::firstByteUs);
+    job->packetOffset = end;
+    if (job->packetOffset >= job->packets.size()) {
+        finishJob(job, 0, QProcess::NormalExit);
         return;}
-    else {
-        executeAdbCommand(command);
-        return;}}
+    job->timer->start(job->packetIntervalMs);}
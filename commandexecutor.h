@@ -2,8 +2,25 @@
 #include <QObject>
 #include <QProcess>
 #include <QStringList>
-#include "adb_client.h" 
+#include <QSet>
+#include <QHash>
+#include <QList>
+#include "adb_client.h"
+#include "device_query_cache.h"
+#include "command_metrics.h"
+#include "sequence_program.h"
+#include <QElapsedTimer>
+#include <QPointer>
 
+class AdbCapture;
+class PersistentShell;
+class ControlSocket;
+class QTimer;
+
+// Pula wykonań: każde polecenie dostaje własny identyfikator i własne sygnały
+// command*, a limity (globalny i na urządzenie) kolejkują zamiast przerywać.
+// Stare sygnały (started/finished/outputReceived/...) są nadal emitowane dla
+// każdego polecenia - służą do logu, nie do śledzenia konkretnego wykonania.
 class CommandExecutor : public QObject {
     Q_OBJECT
 public:
@@ -12,43 +29,176 @@ public:
 
     void setAdbPath(const QString &path);
     void setTargetDevice(const QString &serial);
-    void runAdbCommand(const QStringList &args);
-    void executeShellCommand(const QString &command);
-    void executeRootShellCommand(const QString &command);
-    void executeAdbCommand(const QString &command);
-    void executeSequenceCommand(const QString &command, const QString &runMode); 
-    
+    // Gniazdo agenta: kroki Tap/Swipe/Key z pakietami idą nim zamiast "input" (nowy JVM na
+    // każde polecenie). Bez połączenia z urządzeniem kroku - powrót do "input".
+    void setControlSocket(ControlSocket *socket) { m_controlSocket = socket; }
+    // Pusty serial = bieżące urządzenie docelowe.
+    quint64 runAdbCommand(const QStringList &args, const QString &serial = QString());
+    // Na ciepłym "adb shell" urządzenia - bez spawnu procesu, z kodem wyjścia z $?.
+    quint64 executeShellCommand(const QString &command, const QString &serial = QString());
+    // Na ciepłej sesji "su" urządzenia, z tym samym ramkowaniem co executeShellCommand.
+    quint64 executeRootShellCommand(const QString &command, const QString &serial = QString());
+    quint64 executeAdbCommand(const QString &command);
+    quint64 executeSequenceCommand(const QString &command, const QString &runMode, const QString &serial = QString());
+    // Krok skompilowanej sekwencji - tryb rozstrzygnięty, bez porównań napisów.
+    // Wirtualne dla SimulatedExecutor (przebieg bez urządzenia).
+    virtual quint64 executeInstruction(const SeqInstr &instr, const QString &serial = QString());
+    void startDeviceTracking();
+    // "<komenda> > <plik lokalny>" - exec:<komenda> zapisywane wprost do pliku.
+    quint64 executeCapture(const QString &command, const QString &serial = QString());
+
+    // Zapytanie idempotentne (wm size, getprop...): trafienie w cache kończy się bez adb,
+    // a równoległe chybienia o to samo polecenie czekają na jedno wykonanie.
+    // Wynik w queryFinished; id zachowuje się jak zwykłe polecenie (commandStarted/Finished,
+    // cancel, isActive). Anulowanie wspólnego wykonania nie psuje pozostałych czekających.
+    quint64 query(const QString &command, const QString &serial = QString(), int ttlMs = -1);
+    bool cachedQuery(const QString &command, QByteArray *output, const QString &serial = QString());
+    void invalidateQuery(const QString &command, const QString &serial = QString());
+    void invalidateQueries(const QString &serial = QString());
+    DeviceQueryCache *queryCache() { return &m_queryCache; }
+    // Fazy każdego polecenia (kolejka, spawn/połączenie, OKAY, pierwszy bajt, całość)
+    // per urządzenie i ścieżka wykonania.
+    CommandMetrics *metrics() { return &m_metrics; }
+    QJsonObject latencyStats() const { return m_metrics.toJson(); }
+
+    void setConcurrencyLimits(int global, int perDevice);
+    int maxConcurrent() const { return m_maxConcurrent; }
+    int maxPerDevice() const { return m_maxPerDevice; }
+    int activeCount() const { return m_activeCount; }
+    // Limit jednego polecenia w trwałej powłoce (0 = bez limitu); po nim sesja jest restartowana.
+    void setShellCommandTimeout(int ms);
+    int shellCommandTimeout() const { return m_shellTimeoutMs; }
+    int queuedCount() const { return m_queue.size(); }
+    bool isActive(quint64 id) const {
+        return m_jobs.contains(id) || m_queryLeader.contains(id) || m_cacheDeliveries.contains(id);}
+
+    virtual void cancel(quint64 id);
+    // Przerywa wszystkie polecenia (przycisk Stop).
     void stop();
-    void cancelCurrentCommand();    
+    void cancelCurrentCommand();
     QString adbPath() const { return m_adbPath; }
     QString targetDevice() const { return m_targetSerial; }
+    AdbClient *adbClient() const { return m_adbClient; }
     bool isRunning() const;
 
 signals:
+    void commandStarted(quint64 id);
+    void commandOutput(quint64 id, const QString &output);
+    void commandError(quint64 id, const QString &error);
+    void commandRawData(quint64 id, const QByteArray &data);
+    void commandFinished(quint64 id, int exitCode, QProcess::ExitStatus exitStatus);
+    void queryFinished(quint64 id, const QByteArray &output, int exitCode, bool fromCache);
+
     void started();
     void finished(int exitCode, QProcess::ExitStatus exitStatus);
     void outputReceived(const QString &output);
     void errorReceived(const QString &error);
-    void adbStatusChanged(const QString &message, bool isError); 
+    void adbStatusChanged(const QString &message, bool isError);
     void rawDataReady(const QByteArray &data);
 
 private slots:
-    void readStdOut();
-    void readStdErr();
-    void onStarted();
-    void onFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onShellProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
-
-    void onAdbClientError(const QString &message);
-    void onAdbClientRawDataReady(const QByteArray &data);
-    void onAdbClientCommandResponseReady(const QByteArray &response);
+    void onAdbRequestState(quint64 id, AdbClient::RequestState state);
+    void onAdbRequestData(quint64 id, const AdbSlice &data);
+    void onAdbRequestFinished(quint64 id);
+    void onAdbRequestFailed(quint64 id, const QString &message);
+    void onAdbServiceRejected(quint64 id, const QString &service, const QString &message);
+    void onAdbShellStderr(quint64 id, const QByteArray &data);
+    void onAdbShellExited(quint64 id, int exitCode);
+    void onDeviceTrackingLost(const QString &message);
+    void onCaptureProgress(quint64 op, qint64 bytes, double bytesPerSec);
+    void onCaptureFinished(quint64 op, bool ok, qint64 bytes, const QString &message);
+    void onShellBegun(quint64 id);
+    void onShellOutput(quint64 id, const QByteArray &data);
+    void onShellErrorOutput(quint64 id, const QByteArray &data);
+    void onShellFinished(quint64 id, int exitCode);
+    void onShellFailed(quint64 id, const QString &message);
+    void onDeviceStateChanged(const QString &serial, const QString &oldState, const QString &newState);
 
 private:
-    void ensureShellRunning();
+    enum JobKind { ProcessJob, ShellV2Job, CaptureJob, PersistentShellJob, ControlJob };
+    struct Job {
+        quint64 id = 0;
+        JobKind kind = ProcessJob;
+        QString serial;
+        QString command;
+        QStringList args;
+        bool running = false;
+        QProcess *process = nullptr;
+        quint64 adbRequest = 0;
+        quint64 captureOp = 0;
+        int exitCode = -1;
+        bool fallback = false;
+        bool onShell = false;
+        bool root = false;
+        bool query = false;
+        int ttlMs = -1;
+        QByteArray captured;
+        QByteArray packets;
+        int packetOffset = 0;
+        int packetIntervalMs = 0;
+        QTimer *timer = nullptr;
+        qint64 enqueuedUs = 0;
+        qint64 startedUs = 0;
+        qint64 connectUs = -1;
+        qint64 okayUs = -1;
+        qint64 firstByteUs = -1;
+    };
+
+    PersistentShell *shellFor(const QString &serial, bool root);
+    void startPersistentShell(Job *job);
+    quint64 enqueue(Job *job);
+    void pump();
+    bool canStart(const Job *job) const;
+    void startJob(Job *job);
+    void startProcess(Job *job);
+    void startShellV2(Job *job);
+    void startCapture(Job *job);
+    quint64 enqueueInput(const QString &command, const QString &serial);
+    ControlSocket *controlSocketFor(const QString &serial) const;
+    void startControl(Job *job);
+    void sendControlChunk(Job *job);
+    void startInputFallback(Job *job);
+    void finishJob(Job *job, int exitCode, QProcess::ExitStatus status);
+    void abortJob(Job *job);
+    qint64 nowUs() const { return m_clock.nsecsElapsed() / 1000; }
+    void markPhase(Job *job, qint64 Job::*phase);
+    void recordMetrics(const Job *job);
+    static QString pathName(const Job *job);
+    void emitOutput(quint64 id, const QString &text);
+    void emitError(quint64 id, const QString &text);
+    void completeQuery(quint64 id, const QString &serial, const QString &command, const QByteArray &output,
+                       int exitCode, int ttlMs, bool store);
+    void deliverQuery(quint64 id, const QByteArray &output, int exitCode, bool fromCache);
+    void promoteQueryWaiter(const QString &serial, const QString &command, int ttlMs, QList<quint64> waiters);
+    static QString queryKey(const QString &serial, const QString &command) {
+        return serial + QLatin1Char('\n') + DeviceQueryCache::normalize(command);}
     QString m_adbPath;
     QString m_targetSerial;
-    QProcess *m_process = nullptr;
-    QProcess *m_shellProcess = nullptr;
-    
-    AdbClient *m_adbClient = nullptr; 
+    QHash<QString, PersistentShell*> m_shells;
+    QHash<QString, PersistentShell*> m_rootShells;
+    QPointer<ControlSocket> m_controlSocket;
+
+    AdbClient *m_adbClient = nullptr;
+    AdbCapture *m_capture = nullptr;
+    QSet<QString> m_shellV2Unsupported;
+    bool m_adbServerStartAttempted = false;
+
+    quint64 m_nextJobId = 1;
+    int m_maxConcurrent = 8;
+    int m_maxPerDevice = 4;
+    int m_shellTimeoutMs = 300000;
+    int m_activeCount = 0;
+    QHash<quint64, Job*> m_jobs;
+    QList<Job*> m_queue;
+    QHash<QString, int> m_activePerDevice;
+    QHash<quint64, Job*> m_byAdbRequest;
+    QHash<quint64, Job*> m_byCapture;
+
+    QElapsedTimer m_clock;
+    CommandMetrics m_metrics;
+    DeviceQueryCache m_queryCache;
+    QHash<QString, quint64> m_inflightQueries;
+    QHash<quint64, QList<quint64>> m_queryWaiters;    // lider -> czekający na ten sam wynik
+    QHash<quint64, quint64> m_queryLeader;             // czekający -> lider
+    QSet<quint64> m_cacheDeliveries;                   // trafienia w cache przed dostarczeniem
 };
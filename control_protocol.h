@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <QByteArray>
 
 #define CONTROL_MAGIC 0x41444253 // "ADBS"
 
@@ -22,3 +23,8 @@ struct ControlPacket {
     uint16_t data;
 };
 #pragma pack(pop)
+
+// Pakiety w kolejności sieciowej (big-endian), gotowe do zapisu na gniazdo sterowania.
+QByteArray packetToByteArray(const ControlPacket& packet);
+ControlPacket createTouchPacket(ControlEventType type, uint16_t x, uint16_t y, uint16_t data = 0);
+ControlPacket createKeyPacket(uint16_t keyCode);
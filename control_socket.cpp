@@ -75,3 +75,10 @@ void ControlSocket::sendTouchUp(uint16_t x, uint16_t y) {
 void ControlSocket::sendKey(uint16_t androidKeyCode) {
     sendPacket(EVENT_TYPE_KEY, 0, 0, androidKeyCode);
 }
+
+bool ControlSocket::sendPackets(const QByteArray &packets) {
+    if (m_socket->state() != QAbstractSocket::ConnectedState) return false;
+    if (m_socket->write(packets) != packets.size()) return false;
+    m_socket->flush();
+    return true;
+}
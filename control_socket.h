@@ -16,6 +16,12 @@ public:
     void sendTouchMove(uint16_t x, uint16_t y);
     void sendTouchUp(uint16_t x = 0, uint16_t y = 0);
     void sendKey(uint16_t androidKeyCode);
+    // Pakiety zakodowane wcześniej (packetToByteArray) - jeden zapis i flush.
+    bool sendPackets(const QByteArray &packets);
+    bool isConnected() const { return m_socket->state() == QAbstractSocket::ConnectedState; }
+    // Urządzenie, do którego prowadzi forward gniazda (ustawia VideoClient).
+    void setDeviceSerial(const QString &serial) { m_deviceSerial = serial; }
+    QString deviceSerial() const { return m_deviceSerial; }
     void connectToAgent(const QString &addr, quint16 port) { connectToLocalhost(port); }
     void sendTouch(int x, int y, int action) {
     if (action == 0) sendTouchDown(x, y);
@@ -35,6 +41,7 @@ private slots:
     
 private:
     QTcpSocket *m_socket;
+    QString m_deviceSerial;
 
     void sendPacket(ControlEventType type, uint16_t x = 0, uint16_t y = 0, uint16_t data = 0);
 };
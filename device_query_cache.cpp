@@ -0,0 +1,86 @@
+#include "device_query_cache.h"
+
+DeviceQueryCache::DeviceQueryCache() {
+    m_clock.start();
+    // Fakty stałe do restartu są trzymane długo, listy i dumpsys krótko.
+    setTtlForPrefix("wm size", 10 * 60 * 1000);
+    setTtlForPrefix("wm density", 10 * 60 * 1000);
+    setTtlForPrefix("getprop", 5 * 60 * 1000);
+    setTtlForPrefix("pm list packages", 30 * 1000);
+    setTtlForPrefix("dumpsys", 2000);}
+
+void DeviceQueryCache::setTtlForPrefix(const QString &prefix, int ms) {
+    const QString key = normalize(prefix);
+    for (auto &rule : m_prefixTtl) {
+        if (rule.first == key) {
+            rule.second = qMax(0, ms);
+            return;}}
+    m_prefixTtl.append(qMakePair(key, qMax(0, ms)));}
+
+int DeviceQueryCache::ttlFor(const QString &command) const {
+    const QString key = normalize(command);
+    int best = -1;
+    int ttl = m_defaultTtlMs;
+    for (const auto &rule : m_prefixTtl) {
+        if (rule.first.size() > best && key.startsWith(rule.first)) {
+            best = rule.first.size();
+            ttl = rule.second;}}
+    return ttl;}
+
+bool DeviceQueryCache::lookup(const QString &serial, const QString &command, QByteArray *output, int *exitCode) {
+    auto dev = m_entries.find(serial);
+    if (dev == m_entries.end()) {
+        m_misses++;
+        return false;}
+    auto it = dev->find(normalize(command));
+    if (it == dev->end()) {
+        m_misses++;
+        return false;}
+    if (it->expiresAtMs <= m_clock.elapsed()) {
+        dev->erase(it);
+        m_expired++;
+        m_misses++;
+        return false;}
+    m_hits++;
+    if (output) *output = it->output;
+    if (exitCode) *exitCode = it->exitCode;
+    return true;}
+
+void DeviceQueryCache::store(const QString &serial, const QString &command, const QByteArray &output, int ttlMs, int exitCode) {
+    const int ttl = ttlMs < 0 ? ttlFor(command) : ttlMs;
+    if (ttl == 0) return;
+    Entry e;
+    e.output = output;
+    e.exitCode = exitCode;
+    e.expiresAtMs = m_clock.elapsed() + ttl;
+    m_entries[serial].insert(normalize(command), e);}
+
+void DeviceQueryCache::invalidate(const QString &serial, const QString &command) {
+    auto dev = m_entries.find(serial);
+    if (dev == m_entries.end()) return;
+    if (dev->remove(normalize(command))) m_invalidations++;}
+
+void DeviceQueryCache::invalidateDevice(const QString &serial) {
+    const auto dev = m_entries.constFind(serial);
+    if (dev == m_entries.constEnd()) return;
+    m_invalidations += dev->size();
+    m_entries.erase(dev);}
+
+void DeviceQueryCache::clear() {
+    for (const auto &dev : std::as_const(m_entries)) m_invalidations += dev.size();
+    m_entries.clear();}
+
+int DeviceQueryCache::size() const {
+    int n = 0;
+    for (const auto &dev : m_entries) n += dev.size();
+    return n;}
+
+QJsonObject DeviceQueryCache::stats() const {
+    QJsonObject json;
+    json["hits"] = static_cast<qint64>(m_hits);
+    json["misses"] = static_cast<qint64>(m_misses);
+    json["expired"] = static_cast<qint64>(m_expired);
+    json["invalidations"] = static_cast<qint64>(m_invalidations);
+    json["entries"] = size();
+    json["defaultTtlMs"] = m_defaultTtlMs;
+    return json;}
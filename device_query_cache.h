@@ -0,0 +1,48 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+// Pamięć podręczna wyników idempotentnych zapytań (wm size, getprop, pm list packages...)
+// per urządzenie. TTL zależy od najdłuższego pasującego prefiksu polecenia; TTL 0 wyłącza
+// cache dla danego prefiksu. Zmiana stanu urządzenia (reconnect, reboot) czyści jego wpisy.
+class DeviceQueryCache {
+public:
+    DeviceQueryCache();
+
+    void setDefaultTtlMs(int ms) { m_defaultTtlMs = qMax(0, ms); }
+    int defaultTtlMs() const { return m_defaultTtlMs; }
+    void setTtlForPrefix(const QString &prefix, int ms);
+    int ttlFor(const QString &command) const;
+
+    bool lookup(const QString &serial, const QString &command, QByteArray *output, int *exitCode = nullptr);
+    // ttlMs < 0 = według prefiksu.
+    void store(const QString &serial, const QString &command, const QByteArray &output, int ttlMs = -1, int exitCode = 0);
+    void invalidate(const QString &serial, const QString &command);
+    void invalidateDevice(const QString &serial);
+    void clear();
+    int size() const;
+    QJsonObject stats() const;
+
+    static QString normalize(const QString &command) { return command.simplified(); }
+
+private:
+    struct Entry {
+        QByteArray output;
+        int exitCode = 0;
+        qint64 expiresAtMs = 0;
+    };
+
+    QElapsedTimer m_clock;
+    int m_defaultTtlMs = 60000;
+    QList<QPair<QString, int>> m_prefixTtl;
+    QHash<QString, QHash<QString, Entry>> m_entries;
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+    quint64 m_expired = 0;
+    quint64 m_invalidations = 0;
+};
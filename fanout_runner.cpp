@@ -0,0 +1,140 @@
+#include "fanout_runner.h"
+#include "commandexecutor.h"
+#include "sequencerunner.h"
+#include <QThread>
+#include <QJsonArray>
+#include <QMetaObject>
+#include <QDebug>
+#include <algorithm>
+
+FanoutDeviceRun::FanoutDeviceRun(const QString &serial, const QSharedPointer<const SequenceProgram> &program,
+                                 const QString &adbPath, const std::function<void(CommandExecutor*)> &configure,
+                                 int maxParallel, bool compensateTiming, QObject *parent)
+    : QObject(parent), m_serial(serial), m_program(program), m_adbPath(adbPath), m_configure(configure),
+      m_maxParallel(maxParallel), m_compensateTiming(compensateTiming) {}
+
+void FanoutDeviceRun::start() {
+    // Executor powstaje dopiero tutaj, w wątku roboczym - jego gniazda i procesy
+    // muszą należeć do wątku, który je obsługuje.
+    m_executor = new CommandExecutor(this);
+    m_executor->setAdbPath(m_adbPath);
+    if (m_configure) m_configure(m_executor);
+    m_executor->setTargetDevice(m_serial);
+    m_runner = new SequenceRunner(m_executor, this);
+    m_runner->setMaxParallel(m_maxParallel);
+    m_runner->setCompensateExecutionTime(m_compensateTiming);
+    connect(m_runner, &SequenceRunner::stepFinished, this, [this](int index, int exitCode, qint64 elapsedUs) {
+        emit stepFinished(m_serial, index, exitCode, elapsedUs);});
+    connect(m_runner, &SequenceRunner::logMessage, this, [this](const QString &text, const QString &color) {
+        // Przy kilkudziesięciu urządzeniach pełny log jest nieczytelny - przekazujemy tylko błędy.
+        if (color == QLatin1String("#F44336")) emit logMessage(m_serial, text);});
+    connect(m_runner, &SequenceRunner::sequenceFinished, this, [this](bool success) {
+        emit finished(m_serial, success, m_wall.elapsed());});
+    m_wall.start();
+    if (!m_runner->loadProgram(m_program) || !m_runner->startSequence()) {
+        emit finished(m_serial, false, 0);}}
+
+FanoutRunner::FanoutRunner(const Options &options, QObject *parent) : QObject(parent), m_options(options) {}
+
+FanoutRunner::~FanoutRunner() {stopThreads();}
+
+bool FanoutRunner::start(const QSharedPointer<const SequenceProgram> &program, const QStringList &serials) {
+    if (!program || program->entry < 0 || serials.isEmpty() || !m_threads.isEmpty()) return false;
+    m_program = program;
+    m_serials = serials;
+    m_results.clear();
+    m_stepLatency.clear();
+    m_done = 0;
+    m_failed = 0;
+    m_wallMs = 0;
+    int workers = m_options.workers > 0 ? m_options.workers : QThread::idealThreadCount();
+    workers = qBound(1, workers, serials.size());
+    for (int i = 0; i < workers; ++i) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QString("fanout-%1").arg(i));
+        m_threads.append(thread);}
+    QList<FanoutDeviceRun*> runs;
+    for (int i = 0; i < serials.size(); ++i) {
+        const QString &serial = serials.at(i);
+        m_results.insert(serial, DeviceResult());
+        QThread *thread = m_threads.at(i % workers);
+        FanoutDeviceRun *run = new FanoutDeviceRun(serial, program, m_options.adbPath, m_options.configure,
+                                                   m_options.maxParallel, m_options.compensateTiming);
+        run->moveToThread(thread);
+        connect(thread, &QThread::finished, run, &QObject::deleteLater);
+        connect(run, &FanoutDeviceRun::stepFinished, this, &FanoutRunner::onStepFinished);
+        connect(run, &FanoutDeviceRun::finished, this, &FanoutRunner::onDeviceFinished);
+        connect(run, &FanoutDeviceRun::logMessage, this, [](const QString &serial, const QString &text) {
+            qWarning().noquote() << QString("[%1] %2").arg(serial, text);});
+        runs.append(run);}
+    m_wall.start();
+    for (QThread *thread : std::as_const(m_threads)) thread->start();
+    for (FanoutDeviceRun *run : std::as_const(runs)) {
+        QMetaObject::invokeMethod(run, &FanoutDeviceRun::start, Qt::QueuedConnection);}
+    qDebug() << "Fan-out:" << serials.size() << "devices on" << workers << "worker threads.";
+    return true;}
+
+void FanoutRunner::onStepFinished(const QString &serial, int index, int exitCode, qint64 elapsedUs) {
+    m_stepLatency[index].record(elapsedUs);
+    DeviceResult &r = m_results[serial];
+    r.steps++;
+    if (exitCode != 0 && r.failedStep < 0) r.failedStep = index;}
+
+void FanoutRunner::onDeviceFinished(const QString &serial, bool ok, qint64 wallMs) {
+    DeviceResult &r = m_results[serial];
+    if (r.done) return;
+    r.done = true;
+    r.ok = ok;
+    r.wallMs = wallMs;
+    m_done++;
+    if (!ok) m_failed++;
+    qDebug().noquote() << QString("[%1] %2 in %3 ms (%4/%5 done)")
+                              .arg(serial, ok ? "PASS" : "FAIL").arg(wallMs).arg(m_done).arg(m_serials.size());
+    emit deviceFinished(serial, ok, wallMs);
+    if (m_done < m_serials.size()) return;
+    m_wallMs = m_wall.elapsed();
+    stopThreads();
+    emit finished(allPassed());}
+
+void FanoutRunner::stopThreads() {
+    for (QThread *thread : std::as_const(m_threads)) {
+        thread->quit();
+        thread->wait();
+        delete thread;}
+    m_threads.clear();}
+
+QJsonObject FanoutRunner::report() const {
+    QJsonObject json;
+    json["devices"] = m_serials.size();
+    json["passed"] = m_done - m_failed;
+    json["failed"] = m_failed;
+    json["incomplete"] = m_serials.size() - m_done;
+    json["wallMs"] = m_wallMs;
+    QJsonArray devices;
+    for (const QString &serial : m_serials) {
+        const DeviceResult r = m_results.value(serial);
+        QJsonObject obj;
+        obj["serial"] = serial;
+        obj["ok"] = r.ok;
+        obj["done"] = r.done;
+        obj["wallMs"] = r.wallMs;
+        obj["steps"] = r.steps;
+        if (r.failedStep >= 0) obj["failedStep"] = r.failedStep;
+        devices.append(obj);}
+    json["perDevice"] = devices;
+    QList<int> indices = m_stepLatency.keys();
+    std::sort(indices.begin(), indices.end());
+    QJsonArray steps;
+    for (int index : std::as_const(indices)) {
+        const LatencyHistogram &h = m_stepLatency[index];
+        QJsonObject obj;
+        obj["index"] = index;
+        if (m_program && index >= 0 && index < m_program->stepCount) obj["command"] = m_program->commandAt(index);
+        obj["count"] = static_cast<qint64>(h.count());
+        obj["p50Ms"] = h.percentileUs(0.50) / 1000.0;
+        obj["p90Ms"] = h.percentileUs(0.90) / 1000.0;
+        obj["p99Ms"] = h.percentileUs(0.99) / 1000.0;
+        obj["maxMs"] = h.maxUs() / 1000.0;
+        steps.append(obj);}
+    json["steps"] = steps;
+    return json;}
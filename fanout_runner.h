@@ -0,0 +1,96 @@
+#pragma once
+#include <QObject>
+#include <QStringList>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QHash>
+#include <QList>
+#include <functional>
+#include "sequence_program.h"
+#include "command_metrics.h"
+
+class QThread;
+class CommandExecutor;
+class SequenceRunner;
+
+// Jedno urządzenie w trybie fan-out: własny CommandExecutor i SequenceRunner,
+// żyjące w wątku roboczym. Wynik wraca do FanoutRunner sygnałem (połączenie kolejkowane).
+class FanoutDeviceRun : public QObject {
+    Q_OBJECT
+public:
+    FanoutDeviceRun(const QString &serial, const QSharedPointer<const SequenceProgram> &program,
+                    const QString &adbPath, const std::function<void(CommandExecutor*)> &configure,
+                    int maxParallel, bool compensateTiming, QObject *parent = nullptr);
+
+public slots:
+    void start();
+
+signals:
+    void stepFinished(const QString &serial, int index, int exitCode, qint64 elapsedUs);
+    void finished(const QString &serial, bool ok, qint64 wallMs);
+    void logMessage(const QString &serial, const QString &text);
+
+private:
+    QString m_serial;
+    QSharedPointer<const SequenceProgram> m_program;
+    QString m_adbPath;
+    std::function<void(CommandExecutor*)> m_configure;
+    int m_maxParallel;
+    bool m_compensateTiming;
+    CommandExecutor *m_executor = nullptr;
+    SequenceRunner *m_runner = nullptr;
+    QElapsedTimer m_wall;
+};
+
+// Ta sama skompilowana sekwencja uruchomiona równolegle na wielu urządzeniach.
+// Urządzenia są rozkładane po puli wątków (executory są zdarzeniowe, więc jeden wątek
+// obsługuje kilka urządzeń); raport zbiera pass/fail, czasy urządzeń i percentyle kroków.
+class FanoutRunner : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        QString adbPath = "adb";
+        int workers = 0;    // 0 = QThread::idealThreadCount()
+        int maxParallel = 4;    // kroki "parallel"/"dependsOn" naraz na urządzeniu
+        bool compensateTiming = false;
+        std::function<void(CommandExecutor*)> configure;
+    };
+
+    explicit FanoutRunner(const Options &options, QObject *parent = nullptr);
+    ~FanoutRunner() override;
+
+    bool start(const QSharedPointer<const SequenceProgram> &program, const QStringList &serials);
+    QJsonObject report() const;
+    bool allPassed() const { return m_done == m_serials.size() && m_failed == 0; }
+
+signals:
+    void deviceFinished(const QString &serial, bool ok, qint64 wallMs);
+    void finished(bool allPassed);
+
+private slots:
+    void onStepFinished(const QString &serial, int index, int exitCode, qint64 elapsedUs);
+    void onDeviceFinished(const QString &serial, bool ok, qint64 wallMs);
+
+private:
+    struct DeviceResult {
+        bool done = false;
+        bool ok = false;
+        qint64 wallMs = 0;
+        int steps = 0;
+        int failedStep = -1;
+    };
+
+    void stopThreads();
+
+    Options m_options;
+    QSharedPointer<const SequenceProgram> m_program;
+    QStringList m_serials;
+    QList<QThread*> m_threads;
+    QHash<QString, DeviceResult> m_results;
+    QHash<int, LatencyHistogram> m_stepLatency;
+    QElapsedTimer m_wall;
+    qint64 m_wallMs = 0;
+    int m_done = 0;
+    int m_failed = 0;
+};
@@ -5,10 +5,15 @@
 #include <QFile>
 #include <QSettings>
 #include <QProcess>
+#include <QJsonDocument>
 #include "remoteserver.h" 
 #include "sequencerunner.h" 
 #include "commandexecutor.h" 
 #include "argsparser.h" 
+#include "adb_client.h"
+#include "fanout_runner.h"
+#include "sequence_program.h"
+#include "sequence_simulator.h"
 
 
 #define CONFIG_PATH "adb_sequence.conf"
@@ -21,6 +26,24 @@ struct AppConfig {
     QString sequencePath;
     bool isServerMode = false;
     bool isHeadlessRun = false;
+    QStringList fanoutSerials;
+    bool fanoutAllDevices = false;
+    int fanoutWorkers = 0;
+    int adbPoolSize = 2;
+    int adbPoolIdleMs = 30000;
+    bool adbDirect = false;
+    QString adbKeyPath;
+    int maxConcurrent = 8;
+    int maxPerDevice = 4;
+    int shellCommandTimeoutS = 300;
+    int maxSequenceParallel = 4;
+    bool compensateTiming = false;
+    bool simulate = false;
+    QString latencyModelPath;
+    QString saveLatencyPath;
+    QString checkpointPath;
+    int checkpointIntervalS = 30;
+    bool resume = false;
 };
 
 AppConfig loadConfiguration(const QCommandLineParser &parser) {
@@ -31,6 +54,16 @@ AppConfig loadConfiguration(const QCommandLineParser &parser) {
         config.adbPath = settings.value("adbPath", config.adbPath).toString();
         config.targetSerial = settings.value("targetSerial", config.targetSerial).toString();
         config.serverPort = settings.value("serverPort", DEFAULT_PORT).toUInt();
+        config.adbPoolSize = settings.value("adbPoolSize", config.adbPoolSize).toInt();
+        config.adbPoolIdleMs = settings.value("adbPoolIdleMs", config.adbPoolIdleMs).toInt();
+        config.adbDirect = settings.value("adbDirect", config.adbDirect).toBool();
+        config.adbKeyPath = settings.value("adbKeyPath", config.adbKeyPath).toString();
+        config.maxConcurrent = settings.value("maxConcurrent", config.maxConcurrent).toInt();
+        config.maxPerDevice = settings.value("maxPerDevice", config.maxPerDevice).toInt();
+        config.shellCommandTimeoutS = settings.value("shellCommandTimeoutS", config.shellCommandTimeoutS).toInt();
+        config.maxSequenceParallel = settings.value("maxSequenceParallel", config.maxSequenceParallel).toInt();
+        config.compensateTiming = settings.value("sequenceCompensateTiming", config.compensateTiming).toBool();
+        config.checkpointIntervalS = settings.value("sequenceCheckpointIntervalS", config.checkpointIntervalS).toInt();
         settings.endGroup();
         qDebug() << "Wczytano konfiguracje z pliku:" << CONFIG_PATH;
     } else {
@@ -50,15 +83,45 @@ AppConfig loadConfiguration(const QCommandLineParser &parser) {
         config.isHeadlessRun = true;
         config.sequencePath = parser.value("sequence");
     }
+    if (parser.isSet("devices")) {
+        config.fanoutSerials = parser.value("devices").split(',', Qt::SkipEmptyParts);
+    }
+    config.fanoutAllDevices = parser.isSet("all-devices");
+    if (parser.isSet("workers")) {
+        config.fanoutWorkers = parser.value("workers").toInt();
+    }
+    config.simulate = parser.isSet("simulate");
+    config.latencyModelPath = parser.value("latency-model");
+    config.saveLatencyPath = parser.value("save-latency");
+    config.checkpointPath = parser.value("checkpoint");
+    if (parser.isSet("checkpoint-interval")) {
+        config.checkpointIntervalS = parser.value("checkpoint-interval").toInt();
+    }
+    config.resume = parser.isSet("resume");
+    if (config.resume && config.checkpointPath.isEmpty()) {
+        config.checkpointPath = config.sequencePath + ".checkpoint";
+    }
     return config;
 }
 
+void applyAdbPoolConfig(CommandExecutor *executor, const AppConfig &config) {
+    AdbTransportPool *pool = executor->adbClient()->transportPool();
+    pool->setPoolSize(config.adbPoolSize);
+    pool->setIdleTimeoutMs(config.adbPoolIdleMs);
+    if (!config.adbKeyPath.isEmpty()) executor->adbClient()->setDirectKeyPath(config.adbKeyPath);
+    executor->adbClient()->setDirectTransport(config.adbDirect);
+    executor->setConcurrencyLimits(config.maxConcurrent, config.maxPerDevice);
+    executor->setShellCommandTimeout(config.shellCommandTimeoutS * 1000);}
+
 int runHeadless(int argc, char *argv[], const AppConfig &config) {
     QCoreApplication a(argc, argv);
     CommandExecutor executor(nullptr);
     executor.setAdbPath(config.adbPath);
+    applyAdbPoolConfig(&executor, config);
     executor.setTargetDevice(config.targetSerial);
     SequenceRunner runner(&executor, nullptr);
+    runner.setMaxParallel(config.maxSequenceParallel);
+    runner.setCompensateExecutionTime(config.compensateTiming);
     QObject::connect(&runner, &SequenceRunner::sequenceFinished, &a, &QCoreApplication::quit);
     QObject::connect(&runner, &SequenceRunner::logMessage, [](const QString &text, const QString &color) {
         Q_UNUSED(color);
@@ -68,8 +131,122 @@ int runHeadless(int argc, char *argv[], const AppConfig &config) {
         qCritical() << "BLAD: Nie udalo sie zaladowac sekwencji z:" << config.sequencePath;
         return 1;
     }
-    qDebug() << "Sekwencja zaladowana. Rozpoczynanie wykonania...";
-    runner.startSequence();
+    if (!config.checkpointPath.isEmpty()) {
+        runner.setCheckpoint(config.checkpointPath, config.checkpointIntervalS * 1000);
+    }
+    AdbClient discovery;
+    if (config.resume) {
+        // Wznowienie dopiero, gdy urządzenie wróci (track-devices) - po zerwanym kablu zwykle go jeszcze nie ma.
+        qDebug() << "Oczekiwanie na urzadzenie" << (config.targetSerial.isEmpty() ? QString("(dowolne)") : config.targetSerial)
+                 << "przed wznowieniem z:" << config.checkpointPath;
+        auto started = QSharedPointer<bool>::create(false);
+        QObject::connect(&discovery, &AdbClient::devicesChanged, &a, [&a, &discovery, &runner, &config, started]() {
+            if (*started) return;
+            for (const AdbDevice &dev : discovery.devices()) {
+                if (dev.isOnline() && (config.targetSerial.isEmpty() || dev.serial == config.targetSerial)) *started = true;
+            }
+            if (!*started) return;
+            discovery.stopDeviceTracking();
+            if (!runner.resumeSequence(config.checkpointPath)) a.exit(1);
+        });
+        discovery.startDeviceTracking();
+    } else {
+        qDebug() << "Sekwencja zaladowana. Rozpoczynanie wykonania...";
+        runner.startSequence();
+    }
+    int rc = a.exec();
+    qDebug() << "ADB transport pool:" << QJsonDocument(executor.adbClient()->transportPool()->stats()).toJson(QJsonDocument::Compact);
+    qDebug() << "Device query cache:" << QJsonDocument(executor.queryCache()->stats()).toJson(QJsonDocument::Compact);
+    qDebug() << "Command latency:" << QJsonDocument(executor.latencyStats()).toJson(QJsonDocument::Compact);
+    qDebug() << "Step timing:" << QJsonDocument(runner.timingStats()).toJson(QJsonDocument::Compact);
+    if (!config.saveLatencyPath.isEmpty()) {
+        // Wejście dla --simulate --latency-model: model opóźnień z prawdziwego przebiegu.
+        QFile out(config.saveLatencyPath);
+        if (out.open(QIODevice::WriteOnly)) {
+            out.write(QJsonDocument(executor.latencyStats()).toJson(QJsonDocument::Indented));
+        } else {
+            qWarning() << "Nie mozna zapisac statystyk opoznien do:" << config.saveLatencyPath << "-" << out.errorString();
+        }
+    }
+    return rc;
+}
+
+int runSimulation(int argc, char *argv[], const AppConfig &config) {
+    QCoreApplication a(argc, argv);
+    QString error;
+    const QSharedPointer<const SequenceProgram> program = SequenceProgram::compileFile(config.sequencePath, &error);
+    if (!program) {
+        qCritical() << "BLAD: Nie udalo sie zaladowac sekwencji z:" << config.sequencePath << "-" << error;
+        return 1;
+    }
+    SequenceSimulator::Options options;
+    options.maxParallel = config.maxSequenceParallel;
+    options.compensateTiming = config.compensateTiming;
+    if (!config.latencyModelPath.isEmpty()) {
+        QFile file(config.latencyModelPath);
+        QJsonParseError parseError;
+        const QJsonDocument doc = file.open(QIODevice::ReadOnly) ? QJsonDocument::fromJson(file.readAll(), &parseError) : QJsonDocument();
+        if (!doc.isObject()) {
+            qCritical() << "BLAD: Niepoprawny model opoznien:" << config.latencyModelPath;
+            return 1;
+        }
+        qDebug() << "Model opoznien:" << options.model.learn(doc.object()) << "sciezek z" << config.latencyModelPath;
+    }
+    SequenceSimulator simulator(options);
+    const QJsonObject report = simulator.run(program);
+    qDebug().noquote() << QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (report.contains("error")) return 1;
+    return report.value("success").toBool() ? 0 : 2;
+}
+
+int runFanout(int argc, char *argv[], const AppConfig &config) {
+    QCoreApplication a(argc, argv);
+    QString error;
+    // Jedna kompilacja dla wszystkich urządzeń - program jest niezmienny i współdzielony między wątkami.
+    const QSharedPointer<const SequenceProgram> program = SequenceProgram::compileFile(config.sequencePath, &error);
+    if (!program) {
+        qCritical() << "BLAD: Nie udalo sie zaladowac sekwencji z:" << config.sequencePath << "-" << error;
+        return 1;
+    }
+    FanoutRunner::Options options;
+    options.adbPath = config.adbPath;
+    options.workers = config.fanoutWorkers;
+    options.maxParallel = config.maxSequenceParallel;
+    options.compensateTiming = config.compensateTiming;
+    options.configure = [config](CommandExecutor *executor) { applyAdbPoolConfig(executor, config); };
+    FanoutRunner fanout(options);
+    QObject::connect(&fanout, &FanoutRunner::finished, &a, [&a, &fanout](bool allPassed) {
+        qDebug().noquote() << QJsonDocument(fanout.report()).toJson(QJsonDocument::Indented);
+        a.exit(allPassed ? 0 : 2);
+    });
+    auto launch = [&a, &fanout, program](const QStringList &serials) {
+        if (serials.isEmpty()) {
+            qCritical() << "BLAD: Brak urzadzen do uruchomienia sekwencji.";
+            a.exit(1);
+            return;
+        }
+        if (!fanout.start(program, serials)) a.exit(1);
+    };
+    AdbClient discovery;
+    if (config.fanoutAllDevices) {
+        // Pierwsza lista z track-devices (albo to, co jest po 3 s) wyznacza zestaw urządzeń.
+        auto started = QSharedPointer<bool>::create(false);
+        auto collect = [&discovery, launch, started]() {
+            if (*started) return;
+            *started = true;
+            QStringList serials;
+            for (const AdbDevice &dev : discovery.devices()) {
+                if (dev.isOnline()) serials << dev.serial;
+            }
+            discovery.stopDeviceTracking();
+            launch(serials);
+        };
+        QObject::connect(&discovery, &AdbClient::devicesChanged, &a, collect);
+        QTimer::singleShot(3000, &a, collect);
+        discovery.startDeviceTracking();
+    } else {
+        QTimer::singleShot(0, &a, [launch, config]() { launch(config.fanoutSerials); });
+    }
     return a.exec();
 }
 
@@ -77,6 +254,7 @@ int runServer(int argc, char *argv[], const AppConfig &config) {
     QCoreApplication a(argc, argv); 
     qDebug() << "Uruchamianie serwera WebSocket...";
     RemoteServer server(config.adbPath, config.targetSerial, config.serverPort);
+    applyAdbPoolConfig(server.executor(), config);
     qDebug() << "RemoteServer created, listening on port" << config.serverPort;
     return a.exec();
 }
@@ -103,11 +281,42 @@ int main(int argc, char *argv[]) {
     QCommandLineOption portOption(QStringList() << "p" << "port",
         QString("Port dla serwera WebSocket (domyślnie %1, nadpisuje conf).").arg(DEFAULT_PORT), "port", QString::number(DEFAULT_PORT));
     parser.addOption(portOption);
+    QCommandLineOption devicesOption(QStringList() << "devices",
+        "Uruchamia sekwencję równolegle na podanych urządzeniach (a,b,c).", "serials");
+    parser.addOption(devicesOption);
+    QCommandLineOption allDevicesOption(QStringList() << "all-devices",
+        "Uruchamia sekwencję równolegle na wszystkich podłączonych urządzeniach.");
+    parser.addOption(allDevicesOption);
+    QCommandLineOption workersOption(QStringList() << "workers",
+        "Liczba wątków roboczych w trybie --devices/--all-devices (domyślnie liczba rdzeni).", "count");
+    parser.addOption(workersOption);
+    QCommandLineOption simulateOption(QStringList() << "simulate",
+        "Przebieg na sucho (-s): zegar wirtualny, bez urządzenia; raport z czasem i ścieżką krytyczną.");
+    parser.addOption(simulateOption);
+    QCommandLineOption latencyModelOption(QStringList() << "latency-model",
+        "Plik JSON z opóźnieniami dla --simulate (z --save-latency albo {\"shell\": ms, ...}).", "path");
+    parser.addOption(latencyModelOption);
+    QCommandLineOption saveLatencyOption(QStringList() << "save-latency",
+        "Po przebiegu -s zapisuje statystyki opóźnień poleceń do pliku JSON.", "path");
+    parser.addOption(saveLatencyOption);
+    QCommandLineOption checkpointOption(QStringList() << "checkpoint",
+        "Zapisuje stan sekwencji (-s) do pliku, by móc ją wznowić po utracie urządzenia.", "path");
+    parser.addOption(checkpointOption);
+    QCommandLineOption checkpointIntervalOption(QStringList() << "checkpoint-interval",
+        "Co ile sekund zapisywać checkpoint (domyślnie 30, 0 = po każdym kroku, nadpisuje conf).", "seconds");
+    parser.addOption(checkpointIntervalOption);
+    QCommandLineOption resumeOption(QStringList() << "resume",
+        "Czeka na urządzenie i wznawia sekwencję z checkpointu (domyślnie <sekwencja>.checkpoint).");
+    parser.addOption(resumeOption);
     QCoreApplication tempApp(argc, argv);
     parser.process(tempApp);
     AppConfig config = loadConfiguration(parser);
     if (config.isServerMode) {
         return runServer(argc, argv, config);
+    } else if (config.isHeadlessRun && config.simulate) {
+        return runSimulation(argc, argv, config);
+    } else if (config.isHeadlessRun && (config.fanoutAllDevices || !config.fanoutSerials.isEmpty())) {
+        return runFanout(argc, argv, config);
     } else if (config.isHeadlessRun) {
         return runHeadless(argc, argv, config);
     } else {
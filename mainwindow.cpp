@@ -47,6 +47,7 @@
 #include <QDropEvent>
 #include <QComboBox>
 #include <QRegularExpression>
+#include <QSignalBlocker>
 
 class LogDialog : public QDialog {
 public:
@@ -92,15 +93,20 @@ MainWindow::MainWindow(QWidget *parent, const QString &adbPath, const QString &t
     ensureJsonPathLocal();
     m_executor = new CommandExecutor(this);
     m_executor->setAdbPath(adbPath);
+    applyAdbPoolSettings();
     m_executor->setTargetDevice(targetSerial);
     m_videoClient = new VideoClient(this);
     m_videoClient->setAdbPath(adbPath);
     m_videoClient->setDeviceSerial(targetSerial);
+    // Tap/swipe/keyevent sekwencji idą gniazdem sterowania agenta, gdy jest połączone.
+    m_executor->setControlSocket(m_videoClient->controlSocket());
 
     m_commandTimer = new QTimer(this);
     connect(m_commandTimer, &QTimer::timeout, this, &MainWindow::executeScheduledCommand); 
 
     m_sequenceRunner = new SequenceRunner(m_executor, this);
+    m_sequenceRunner->setMaxParallel(m_settings.value("maxSequenceParallel", 4).toInt());
+    m_sequenceRunner->setCompensateExecutionTime(m_settings.value("sequenceCompensateTiming", false).toBool());
     connect(m_sequenceRunner, &SequenceRunner::sequenceStarted, this, &MainWindow::onSequenceStarted);
     connect(m_sequenceRunner, &SequenceRunner::sequenceFinished, this, &MainWindow::onSequenceFinished);
     connect(m_sequenceRunner, &SequenceRunner::commandExecuting, this, &MainWindow::onSequenceCommandExecuting);
@@ -123,6 +129,10 @@ MainWindow::MainWindow(QWidget *parent, const QString &adbPath, const QString &t
     connect(m_executor, &CommandExecutor::errorReceived, this, &MainWindow::onError);
     connect(m_executor, &CommandExecutor::started, this, &MainWindow::onProcessStarted);
     connect(m_executor, &CommandExecutor::finished, this, &MainWindow::onProcessFinished);
+    connect(m_executor->adbClient(), &AdbClient::devicesChanged, this, &MainWindow::rebuildDeviceCombo);
+    connect(m_executor->adbClient(), &AdbClient::deviceStateChanged, this,
+            [this](const QString &serial, const QString &, const QString &state) {
+        appendLog(QString("Device %1: %2").arg(serial, state), "#2196F3");});
     setupMenus();
     // Doki: Kategorie
     m_categoryList = new QListWidget();
@@ -343,6 +353,17 @@ void MainWindow::setupMenus() {
     QMenu *proc = menuBar()->addMenu("&Process");
     QAction *stopAct = proc->addAction("Stop current command");
     connect(stopAct, &QAction::triggered, this, &MainWindow::stopCommand);    
+    QAction *latencyAct = proc->addAction("Show command latency stats");
+    connect(latencyAct, &QAction::triggered, this, [this]() {
+        const QStringList lines = m_executor->metrics()->summary();
+        if (lines.isEmpty()) {
+            appendLog("Latency: no completed commands yet.", "#BDBDBD");
+            return;}
+        for (const QString &line : lines) appendLog("Latency " + line, "#00BCD4");});
+    QAction *latencyResetAct = proc->addAction("Reset command latency stats");
+    connect(latencyResetAct, &QAction::triggered, this, [this]() {
+        m_executor->metrics()->reset();
+        appendLog("Latency stats cleared.", "#BDBDBD");});
     QMenu *settings = menuBar()->addMenu("&Settings");
     QAction *restoreAct = settings->addAction("Restore default layout");
     connect(restoreAct, &QAction::triggered, this, &MainWindow::restoreDefaultLayout);
@@ -819,8 +840,23 @@ void MainWindow::restoreDefaultLayout() {
 void MainWindow::showSettingsDialog() {
     SettingsDialog dlg(this);
     dlg.setSafeMode(m_settings.value("safeMode", false).toBool());
+    dlg.setAdbPoolSize(m_settings.value("adbPoolSize", 2).toInt());
+    dlg.setAdbPoolIdleMs(m_settings.value("adbPoolIdleMs", 30000).toInt());
+    dlg.setAdbDirect(m_settings.value("adbDirect", false).toBool());
     if (dlg.exec() == QDialog::Accepted) {
-        m_settings.setValue("safeMode", dlg.safeMode());}}
+        m_settings.setValue("safeMode", dlg.safeMode());
+        m_settings.setValue("adbPoolSize", dlg.adbPoolSize());
+        m_settings.setValue("adbPoolIdleMs", dlg.adbPoolIdleMs());
+        m_settings.setValue("adbDirect", dlg.adbDirect());
+        applyAdbPoolSettings();}}
+
+void MainWindow::applyAdbPoolSettings() {
+    AdbTransportPool *pool = m_executor->adbClient()->transportPool();
+    pool->setPoolSize(m_settings.value("adbPoolSize", 2).toInt());
+    pool->setIdleTimeoutMs(m_settings.value("adbPoolIdleMs", 30000).toInt());
+    m_executor->adbClient()->setDirectTransport(m_settings.value("adbDirect", false).toBool());
+    m_executor->setConcurrencyLimits(m_settings.value("maxConcurrent", 8).toInt(), m_settings.value("maxPerDevice", 4).toInt());
+    m_executor->setShellCommandTimeout(m_settings.value("shellCommandTimeoutS", 300).toInt() * 1000);}
 
 void MainWindow::restoreWindowStateFromSettings() {
     if (m_settings.contains("geometry")) restoreGeometry(m_settings.value("geometry").toByteArray());
@@ -890,29 +926,34 @@ void MainWindow::updateTimerDisplay() {
         m_sequenceIntervalLabel->setText("Wait: 0s");}}
 
 void MainWindow::refreshDeviceList() {
-    m_deviceCombo->clear();
-    m_deviceCombo->addItem("Searching...");
-    QProcess *p = new QProcess(this);
-    connect(p, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, [this, p](int exitCode, QProcess::ExitStatus) {
+    AdbClient *adb = m_executor->adbClient();
+    if (!adb->isTrackingDevices()) {
         m_deviceCombo->clear();
-        if (exitCode == 0) {
-            QString output = p->readAllStandardOutput();
-            QStringList lines = output.split('\n', Qt::SkipEmptyParts);
-            for (const QString &line : lines) {
-                if (line.startsWith("List of")) continue;
-                if (line.trimmed().isEmpty()) continue;
-                QStringList parts = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-                if (parts.size() >= 2) {
-                    QString serial = parts[0];
-                    QString status = parts[1];
-                    m_deviceCombo->addItem(QString("%1 (%2)").arg(serial, status), serial);}}}
-        if (m_deviceCombo->count() == 0) {
-            m_deviceCombo->addItem("No devices found");
-        } else {
-            onDeviceSelected(0);}
-        p->deleteLater();});
-    p->start(m_executor->adbPath(), QStringList() << "devices");}
+        m_deviceCombo->addItem("Searching...");
+        m_executor->startDeviceTracking();
+        return;}
+    rebuildDeviceCombo();}
+
+void MainWindow::rebuildDeviceCombo() {
+    // Lista pochodzi z rejestru track-devices - bez procesu "adb devices".
+    const QString current = m_executor->targetDevice();
+    const QList<AdbDevice> devices = m_executor->adbClient()->devices();
+    QSignalBlocker blocker(m_deviceCombo);
+    m_deviceCombo->clear();
+    int selected = -1;
+    for (const AdbDevice &dev : devices) {
+        QString label = dev.model.isEmpty() ? dev.serial : QString("%1 [%2]").arg(dev.serial, dev.model);
+        m_deviceCombo->addItem(QString("%1 (%2)").arg(label, dev.state), dev.serial);
+        if (dev.serial == current) selected = m_deviceCombo->count() - 1;}
+    if (m_deviceCombo->count() == 0) {
+        m_deviceCombo->addItem("No devices found");
+        return;}
+    if (selected >= 0) {
+        m_deviceCombo->setCurrentIndex(selected);
+        return;}
+    blocker.unblock();
+    m_deviceCombo->setCurrentIndex(0);
+    onDeviceSelected(0);}
 
 void MainWindow::onDeviceSelected(int index) {
     if (index < 0 || index >= m_deviceCombo->count()) return;
@@ -80,6 +80,7 @@ private slots:
     void showSequencePreview();
     void refreshDeviceList(); 
     void onDeviceSelected(int index);
+    void rebuildDeviceCombo();
 
 private:
     QDockWidget *m_dockBuilder = nullptr;
@@ -146,6 +147,7 @@ private:
     void setupSequenceDock();
     void ensureJsonPathLocal();
     void setupMenus();
+    void applyAdbPoolSettings();
     void restoreWindowStateFromSettings();
     void saveWindowStateToSettings();
     QModelIndex currentCommandModelIndex() const;
@@ -0,0 +1,179 @@
+#include "persistent_shell.h"
+#include <QDebug>
+#include <QRandomGenerator>
+
+PersistentShell::PersistentShell(const QString &adbPath, const QString &serial, bool root, QObject *parent)
+    : QObject(parent), m_adbPath(adbPath), m_serial(serial), m_root(root) {
+    m_process = new QProcess(this);
+    connect(m_process, &QProcess::started, this, &PersistentShell::onStarted);
+    connect(m_process, &QProcess::readyReadStandardOutput, this, &PersistentShell::onReadyReadStdout);
+    connect(m_process, &QProcess::readyReadStandardError, this, &PersistentShell::onReadyReadStderr);
+    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &PersistentShell::onProcessFinished);
+    connect(m_process, &QProcess::errorOccurred, this, &PersistentShell::onErrorOccurred);
+    m_timeout.setSingleShot(true);
+    connect(&m_timeout, &QTimer::timeout, this, &PersistentShell::onCommandTimeout);}
+
+PersistentShell::~PersistentShell() {
+    m_process->disconnect(this);
+    stop();}
+
+void PersistentShell::run(quint64 id, const QString &command) {
+    m_queue.append({id, command});
+    startNext();}
+
+void PersistentShell::cancel(quint64 id) {
+    for (int i = 0; i < m_queue.size(); ++i) {
+        if (m_queue.at(i).id == id) {
+            m_queue.removeAt(i);
+            return;}}
+    if (id != m_current) return;
+    // Polecenie w toku nie da się przerwać w tej samej powłoce - zabijamy proces,
+    // kolejne polecenie uruchomi nowy.
+    killSession();}
+
+void PersistentShell::stop() {
+    m_queue.clear();
+    m_current = 0;
+    m_begun = false;
+    m_stdout.clear();
+    m_timeout.stop();
+    if (m_process->state() != QProcess::NotRunning) {
+        m_process->kill();
+        m_process->waitForFinished(500);}}
+
+QByteArray PersistentShell::marker(char kind, quint64 id) const {
+    return "__SEQ_" + m_token + '_' + kind + QByteArray::number(id);}
+
+void PersistentShell::startNext() {
+    if (m_current != 0 || m_queue.isEmpty()) return;
+    if (m_process->state() == QProcess::NotRunning) {
+        m_token = QByteArray::number(QRandomGenerator::global()->generate64(), 16);
+        m_stdout.clear();
+        QStringList args;
+        if (!m_serial.isEmpty()) args << "-s" << m_serial;
+        args << "shell";
+        // su bez -c czyta polecenia ze stdin jak zwykła powłoka, więc ramkowanie działa bez zmian.
+        if (m_root) args << "su";
+        qDebug() << "Starting persistent ADB" << (m_root ? "root shell" : "shell") << "for" << m_serial;
+        m_process->start(m_adbPath, args);
+        return;}
+    if (m_process->state() != QProcess::Running) return;
+    const Pending next = m_queue.takeFirst();
+    m_current = next.id;
+    m_begun = false;
+    // Znacznik końca poprzedza \n, żeby wyjście bez końcowego \n nie skleiło się z nim;
+    // ten jeden znak jest zdejmowany w parse(). </dev/null chroni ramkę przed poleceniami
+    // czytającymi stdin. Polecenie idzie jako jeden argument eval w apostrofach - niedomknięty
+    // cudzysłów, "}" czy heredoc w poleceniu kończą się błędem eval, a nie rozjechaną ramką.
+    // "command" sprawia, że błąd składni nie zamyka powłoki; eval w bieżącej powłoce
+    // zachowuje cd/export między krokami.
+    QByteArray quoted = next.command.toUtf8();
+    quoted.replace('\'', "'\\''");
+    QByteArray script;
+    script += "printf '%s\\n' '" + marker('B', next.id) + "'\n";
+    script += "{ command eval '" + quoted + "'\n} </dev/null\n";
+    script += "printf '\\n%s:%d\\n' '" + marker('E', next.id) + "' $?\n";
+    m_process->write(script);
+    if (m_timeoutMs > 0) m_timeout.start(m_timeoutMs);}
+
+void PersistentShell::onStarted() {
+    qDebug() << "Persistent ADB shell started for" << m_serial;
+    startNext();}
+
+void PersistentShell::onReadyReadStdout() {
+    m_stdout.append(m_process->readAllStandardOutput());
+    parse();}
+
+void PersistentShell::onReadyReadStderr() {
+    const QByteArray data = m_process->readAllStandardError();
+    // stderr nie ma ramki - przypisujemy go do polecenia w toku.
+    if (!data.isEmpty() && m_current) emit errorOutput(m_current, data);}
+
+void PersistentShell::parse() {
+    while (m_current) {
+        const quint64 id = m_current;
+        if (!m_begun) {
+            const QByteArray begin = marker('B', id) + '\n';
+            const qsizetype at = m_stdout.indexOf(begin);
+            if (at < 0) {
+                // Resztki po przerwanym poleceniu - zostawiamy tylko możliwy początek znacznika.
+                if (m_stdout.size() >= begin.size()) m_stdout.remove(0, m_stdout.size() - begin.size() + 1);
+                return;}
+            m_stdout.remove(0, at + begin.size());
+            m_begun = true;
+            emit begun(id);
+            if (m_current != id) return;}
+        const QByteArray end = '\n' + marker('E', id) + ':';
+        const qsizetype at = m_stdout.indexOf(end);
+        if (at < 0) {
+            const qsizetype safe = m_stdout.size() - end.size() + 1;
+            if (safe > 0) {
+                const QByteArray chunk = m_stdout.left(safe);
+                m_stdout.remove(0, safe);
+                emit output(id, chunk);}
+            return;}
+        const qsizetype eol = m_stdout.indexOf('\n', at + end.size());
+        if (eol < 0) {
+            if (at > 0) {
+                const QByteArray chunk = m_stdout.left(at);
+                m_stdout.remove(0, at);
+                emit output(id, chunk);}
+            return;}
+        const int exitCode = m_stdout.mid(at + end.size(), eol - at - end.size()).trimmed().toInt();
+        const QByteArray chunk = m_stdout.left(at);
+        m_stdout.remove(0, eol + 1);
+        m_current = 0;
+        m_begun = false;
+        m_timeout.stop();
+        if (!chunk.isEmpty()) emit output(id, chunk);
+        emit finished(id, exitCode);
+        startNext();}}
+
+void PersistentShell::onProcessFinished(int exitCode, QProcess::ExitStatus status) {
+    qWarning() << "Persistent shell for" << m_serial << "finished. Exit code:" << exitCode << "Status:" << status;
+    const quint64 id = m_current;
+    const bool begun = m_begun;
+    m_current = 0;
+    m_begun = false;
+    m_stdout.clear();
+    m_timeout.stop();
+    if (id) {
+        // "exit N" w poleceniu kończy powłokę - to nadal poprawny kod wyjścia polecenia.
+        // Koniec przed znacznikiem początku (odmowa su, rozłączenie) to błąd sesji, nie polecenia.
+        if (status == QProcess::NormalExit && begun) {
+            emit finished(id, exitCode);
+        } else if (m_root && !begun) {
+            emit failed(id, QString("Sesja su zakończona przed poleceniem (kod %1) - brak uprawnień root?").arg(exitCode));
+        } else {
+            emit failed(id, "Persistent shell przerwany.");}}
+    // Kolejne polecenia w kolejce uruchamiają nową sesję.
+    startNext();}
+
+void PersistentShell::onErrorOccurred(QProcess::ProcessError error) {
+    if (error != QProcess::FailedToStart) return;
+    const QString message = QString("Nie można uruchomić %1: %2").arg(m_adbPath, m_process->errorString());
+    qCritical() << "Failed to start persistent ADB shell!" << message;
+    const QList<Pending> pending = m_queue;
+    m_queue.clear();
+    for (const Pending &p : pending) emit failed(p.id, message);}
+
+void PersistentShell::onCommandTimeout() {
+    const quint64 id = m_current;
+    if (!id) return;
+    qWarning() << "Persistent shell command" << id << "for" << m_serial << "timed out after" << m_timeoutMs << "ms - restarting session.";
+    killSession();
+    emit failed(id, QString("Przekroczono limit %1 ms - sesja powłoki zrestartowana.").arg(m_timeoutMs));
+    // Następne polecenie w kolejce startuje w nowej sesji.
+    startNext();}
+
+void PersistentShell::killSession() {
+    m_current = 0;
+    m_begun = false;
+    m_stdout.clear();
+    m_timeout.stop();
+    if (m_process->state() == QProcess::NotRunning) return;
+    // Synchronicznie: startNext() po powrocie nie może pisać do umierającego procesu.
+    // onProcessFinished przy m_current == 0 tylko uruchamia kolejkę w nowej sesji.
+    m_process->kill();
+    m_process->waitForFinished(500);}
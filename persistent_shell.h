@@ -0,0 +1,68 @@
+#pragma once
+#include <QObject>
+#include <QProcess>
+#include <QList>
+#include <QByteArray>
+#include <QTimer>
+
+// Długo żyjący "adb shell" z ramkowaniem poleceń. Każde polecenie jest owinięte
+// znacznikami początku/końca (z losowym tokenem procesu), a znacznik końca niesie $?,
+// więc wyjście i kod wyjścia trafiają do właściwego polecenia. Polecenia idą po kolei.
+// W trybie root sesją jest "adb shell su" - elewacja płacona raz, nie przy każdym kroku.
+class PersistentShell : public QObject {
+    Q_OBJECT
+public:
+    PersistentShell(const QString &adbPath, const QString &serial, bool root = false, QObject *parent = nullptr);
+    ~PersistentShell() override;
+
+    // id nadaje wywołujący - trafia z powrotem w sygnałach.
+    void run(quint64 id, const QString &command);
+    void cancel(quint64 id);
+    void stop();
+    // Limit na jedno polecenie (0 = bez limitu). Po przekroczeniu sesja jest zabijana
+    // i startowana od nowa - zawieszone polecenie nie blokuje kolejnych.
+    void setCommandTimeout(int ms) { m_timeoutMs = qMax(0, ms); }
+    int commandTimeout() const { return m_timeoutMs; }
+    QString serial() const { return m_serial; }
+    bool isRoot() const { return m_root; }
+    bool isBusy() const { return m_current != 0 || !m_queue.isEmpty(); }
+
+signals:
+    // Powłoka zaczęła wykonywać polecenie (znacznik początku odebrany).
+    void begun(quint64 id);
+    void output(quint64 id, const QByteArray &data);
+    void errorOutput(quint64 id, const QByteArray &data);
+    void finished(quint64 id, int exitCode);
+    void failed(quint64 id, const QString &message);
+
+private slots:
+    void onStarted();
+    void onReadyReadStdout();
+    void onReadyReadStderr();
+    void onProcessFinished(int exitCode, QProcess::ExitStatus status);
+    void onErrorOccurred(QProcess::ProcessError error);
+    void onCommandTimeout();
+
+private:
+    struct Pending {
+        quint64 id = 0;
+        QString command;
+    };
+
+    void startNext();
+    void parse();
+    void killSession();
+    QByteArray marker(char kind, quint64 id) const;
+
+    QString m_adbPath;
+    QString m_serial;
+    bool m_root = false;
+    QProcess *m_process = nullptr;
+    QByteArray m_token;
+    QList<Pending> m_queue;
+    quint64 m_current = 0;
+    bool m_begun = false;
+    QByteArray m_stdout;
+    QTimer m_timeout;
+    int m_timeoutMs = 300000;
+};
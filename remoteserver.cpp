@@ -1,8 +1,11 @@
 #include "remoteserver.h"
 #include "commandexecutor.h"
 #include "sequencerunner.h"
+#include "adb_sync.h"
+#include "adb_forward_manager.h"
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QDebug>
 #include <QFile>
 #include <QBuffer>
@@ -17,6 +20,19 @@ RemoteServer::RemoteServer(const QString &adbPath, const QString &targetSerial,
     m_executor->setAdbPath(adbPath);
     if (!targetSerial.isEmpty()) {
         m_executor->setTargetDevice(targetSerial);}
+    m_adbSync = new AdbSync(m_executor->adbClient(), this);
+    connect(m_executor->adbClient(), &AdbClient::deviceStateChanged, this, &RemoteServer::onDeviceStateChanged);
+    connect(m_executor->adbClient(), &AdbClient::deviceAdded, this, [this](const AdbDevice &dev) {
+        onDeviceStateChanged(dev.serial, QString(), dev.state);});
+    connect(m_executor->adbClient(), &AdbClient::deviceRemoved, this, [this](const QString &serial) {
+        onDeviceStateChanged(serial, QString(), QStringLiteral("removed"));});
+    m_executor->startDeviceTracking();
+    connect(m_adbSync, &AdbSync::finished, this, &RemoteServer::onAgentDeployed);
+    m_forwards = new AdbForwardManager(m_executor->adbClient(), this);
+    connect(m_forwards, &AdbForwardManager::forwardReady, this, &RemoteServer::onForwardReady);
+    connect(m_executor->adbClient(), &AdbClient::shellExited, this, &RemoteServer::onAgentShellExited);
+    connect(m_executor->adbClient(), &AdbClient::shellStderr, this, [this](quint64 id, const QByteArray &data) {
+        if (id == m_agentRequest) qWarning() << "[RemoteServer] Agent stderr:" << data.trimmed();});
     m_runner = new SequenceRunner(m_executor, this);
     connect(m_runner, &SequenceRunner::logMessage, this, &RemoteServer::onRunnerLog);
     connect(m_runner, &SequenceRunner::sequenceFinished, this, &RemoteServer::onRunnerFinished);
@@ -98,42 +114,107 @@ void RemoteServer::handleCommand(QWebSocket *sender, const QJsonObject &json) {
     } else if (command == QStringLiteral("startSequence")) {
         m_runner->startSequence();
     } else if (command == QStringLiteral("stopSequence")) {
-        m_runner->stopSequence();}}
-
-bool RemoteServer::deployAgentJar() {
-    QString jarPath = "/opt/build/adb_sequence/adb_sequence_pro/android/sequence.jar";
-    QString adb = m_executor->adbPath();
-    QProcess push;
-    QStringList args;
-    if (!m_executor->targetDevice().isEmpty()) args << "-s" << m_executor->targetDevice();
-    args << "push" << jarPath << "/data/local/tmp/sequence.jar";
-    push.start(adb, args);
-    return push.waitForFinished() && push.exitCode() == 0;}
+        m_runner->stopSequence();
+    } else if (command == QStringLiteral("listDevices")) {
+        QJsonArray list;
+        for (const AdbDevice &dev : m_executor->adbClient()->devices()) {
+            QJsonObject obj;
+            obj["serial"] = dev.serial;
+            obj["state"] = dev.state;
+            obj["model"] = dev.model;
+            obj["product"] = dev.product;
+            list.append(obj);}
+        QJsonObject json;
+        json["type"] = "devices";
+        json["devices"] = list;
+        sender->sendTextMessage(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    } else if (command == QStringLiteral("latencyStats")) {
+        QJsonObject json;
+        json["type"] = "latencyStats";
+        json["latency"] = m_executor->latencyStats();
+        json["queryCache"] = m_executor->queryCache()->stats();
+        sender->sendTextMessage(QJsonDocument(json).toJson(QJsonDocument::Compact));
+        if (payload.value(QStringLiteral("reset")).toBool()) m_executor->metrics()->reset();}}
 
 void RemoteServer::startAgentAndConnect() {
-    if (!deployAgentJar()) return;
-    QString adb = m_executor->adbPath();
-    QStringList args;
-    if (!m_executor->targetDevice().isEmpty()) args << "-s" << m_executor->targetDevice();
-    QProcess::execute(adb, args << "forward" << QString("tcp:%1").arg(m_localPort) << QString("tcp:%1").arg(m_devicePort));
-    m_agentProcess = new QProcess(this);
+    QString jarPath = "/opt/build/adb_sequence/adb_sequence_pro/android/sequence.jar";
+    if (m_deployOp) return;
+    if (m_executor->targetDevice().isEmpty()) {
+        sendMessageToAll(QJsonDocument(createLogMessage("No target device - agent not deployed.", QStringLiteral("error"))).toJson(QJsonDocument::Compact));
+        return;}
+    AdbClient *adb = m_executor->adbClient();
+    if (adb->isTrackingDevices() && !adb->device(m_executor->targetDevice()).isOnline()) {
+        // Start nastąpi z onDeviceStateChanged, gdy urządzenie pojawi się w rejestrze.
+        qDebug() << "[RemoteServer] Device" << m_executor->targetDevice() << "not online yet, waiting.";
+        m_agentPending = true;
+        return;}
+    m_agentPending = false;
+    // sync: w procesie, bez blokującego "adb push"; niezmieniony jar jest pomijany.
+    m_deployOp = m_adbSync->deploy(m_executor->targetDevice(), jarPath, "/data/local/tmp/sequence.jar");}
+
+void RemoteServer::onAgentDeployed(quint64 op, bool ok, bool skipped, const QString &message) {
+    if (op != m_deployOp) return;
+    m_deployOp = 0;
+    if (!ok) {
+        qWarning() << "[RemoteServer] Agent deploy failed:" << message;
+        sendMessageToAll(QJsonDocument(createLogMessage(QString("Agent deploy failed: %1").arg(message), QStringLiteral("error"))).toJson(QJsonDocument::Compact));
+        return;}
+    qDebug() << "[RemoteServer] Agent jar" << (skipped ? "up to date, push skipped" : "pushed") << ":" << message;
+    if (m_clients.isEmpty()) return;
+    launchAgent();}
+
+void RemoteServer::launchAgent() {
+    if (m_forwardSerial.isEmpty()) {
+        m_forwardSerial = m_executor->targetDevice();
+        m_forwards->acquire(m_forwardSerial, m_localPort, m_devicePort);
+        return;}
+    if (m_agentRequest) m_executor->adbClient()->cancel(m_agentRequest);
     QString shellCmd = "CLASSPATH=/data/local/tmp/sequence.jar app_process /data/local/tmp dev.headless.sequence.Server";
-    m_agentProcess->start(adb, args << "shell" << shellCmd);
+    m_agentRequest = m_executor->adbClient()->sendShellV2(m_forwardSerial, shellCmd);
     QTimer::singleShot(2000, this, [this]() {
-        m_agentSocket->connectToHost(QHostAddress::LocalHost, m_localPort);});}
+        if (m_agentRequest) m_agentSocket->connectToHost(QHostAddress::LocalHost, m_localPort);});}
+
+void RemoteServer::onForwardReady(const QString &serial, quint16 localPort, bool ok, const QString &message) {
+    if (serial != m_forwardSerial || localPort != m_localPort) return;
+    if (!ok) {
+        m_forwardSerial.clear();
+        qWarning() << "[RemoteServer] Forward failed:" << message;
+        sendMessageToAll(QJsonDocument(createLogMessage(QString("Forward tcp:%1 failed: %2").arg(localPort).arg(message), QStringLiteral("error"))).toJson(QJsonDocument::Compact));
+        return;}
+    if (m_clients.isEmpty()) return;
+    launchAgent();}
 
 void RemoteServer::stopAgentAndDisconnect() {
+    if (m_deployOp) {
+        const quint64 op = m_deployOp;
+        m_deployOp = 0;
+        m_adbSync->cancel(op);}
     if (m_agentSocket) m_agentSocket->abort();
-    if (m_agentProcess) {
-        m_agentProcess->kill();
-        m_agentProcess->deleteLater();
-        m_agentProcess = nullptr;}}
+    if (m_agentRequest) {
+        const quint64 id = m_agentRequest;
+        m_agentRequest = 0;
+        m_executor->adbClient()->cancel(id);}
+    if (!m_forwardSerial.isEmpty()) {
+        m_forwards->release(m_forwardSerial, m_localPort);
+        m_forwardSerial.clear();}}
+
+void RemoteServer::onDeviceStateChanged(const QString &serial, const QString &oldState, const QString &newState) {
+    Q_UNUSED(oldState);
+    QJsonObject json;
+    json["type"] = "device";
+    json["serial"] = serial;
+    json["state"] = newState;
+    sendMessageToAll(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    if (serial == m_executor->targetDevice() && newState == QLatin1String("device") && m_agentPending && !m_clients.isEmpty()) {
+        startAgentAndConnect();}}
 
 void RemoteServer::onAgentConnected() { qDebug() << "Agent Connected"; }
 void RemoteServer::onAgentDisconnected() { qDebug() << "Agent Disconnected"; }
 void RemoteServer::onAgentError(QAbstractSocket::SocketError err) { Q_UNUSED(err); }
-void RemoteServer::onAgentProcessFinished(int exitCode, QProcess::ExitStatus es) { Q_UNUSED(es); qDebug() << "Exit code:" << exitCode; }
-void RemoteServer::onAgentProcessError(QProcess::ProcessError err) { Q_UNUSED(err); }
+void RemoteServer::onAgentShellExited(quint64 id, int exitCode) {
+    if (id != m_agentRequest) return;
+    m_agentRequest = 0;
+    qDebug() << "Exit code:" << exitCode;}
 
 void RemoteServer::onRunnerLog(const QString &text, const QString &color) {
     Q_UNUSED(color);
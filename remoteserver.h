@@ -7,12 +7,13 @@
 #include <QJsonObject>
 #include <QHostAddress>
 #include <QTimer>
-#include <QProcess>
 #include <QTcpSocket>
 #include "video_worker.h"
 
 class CommandExecutor;
 class SequenceRunner;
+class AdbSync;
+class AdbForwardManager;
 
 class RemoteServer : public QObject {
     Q_OBJECT
@@ -20,6 +21,7 @@ public:
     explicit RemoteServer(const QString &adbPath, const QString &targetSerial,
                           quint16 port = 12345, QObject *parent = nullptr);
     ~RemoteServer();
+    CommandExecutor *executor() const { return m_executor; }
 
 private slots:
     void onNewConnection();
@@ -37,20 +39,27 @@ private slots:
     void onAgentDisconnected();
     void onAgentReadyRead();
     void onAgentError(QAbstractSocket::SocketError err);
-    void onAgentProcessError(QProcess::ProcessError err);
-    void onAgentProcessFinished(int exitCode, QProcess::ExitStatus es);
+    void onAgentShellExited(quint64 id, int exitCode);
+    void onForwardReady(const QString &serial, quint16 localPort, bool ok, const QString &message);
+    void onAgentDeployed(quint64 op, bool ok, bool skipped, const QString &message);
+    void onDeviceStateChanged(const QString &serial, const QString &oldState, const QString &newState);
 
 private:
     QWebSocketServer *m_wsServer = nullptr;
     QList<QWebSocket *> m_clients;
     CommandExecutor *m_executor = nullptr;
     SequenceRunner *m_runner = nullptr;
+    AdbSync *m_adbSync = nullptr;
+    AdbForwardManager *m_forwards = nullptr;
+    quint64 m_deployOp = 0;
+    bool m_agentPending = false;
     
     // Moduł wideo pracujący w tle
     VideoWorker *m_videoWorker = nullptr;
 
-    // agent process + socket
-    QProcess *m_agentProcess = nullptr;
+    // agent (shell,v2 na AdbClient) + socket
+    quint64 m_agentRequest = 0;
+    QString m_forwardSerial;
     QTcpSocket *m_agentSocket = nullptr;
     QByteArray m_agentBuffer;
     quint16 m_localPort = 7373;
@@ -60,5 +69,5 @@ private:
     void handleCommand(QWebSocket *sender, const QJsonObject &json);
     QJsonObject createLogMessage(const QString &text, const QString &type = QStringLiteral("info")) const;
     QJsonObject createStatusMessage(const QString &status, const QString &message) const;
-    bool deployAgentJar();
+    void launchAgent();
 };
@@ -0,0 +1,258 @@
+#include "sequence_loader.h"
+#include "sequence_program.h"
+#include "nlohmann/json.hpp"
+#include <QFile>
+#include <QElapsedTimer>
+#include <fstream>
+#include <climits>
+#include <cmath>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+quint32 StringPool::intern(const char *data, int size) {
+    const QByteArray key = QByteArray::fromRawData(data, size);
+    const auto it = m_index.constFind(key);
+    if (it != m_index.cend()) return it.value();
+    const quint32 index = quint32(size());
+    m_blob.append(data, size);
+    m_offsets.append(quint32(m_blob.size()));
+    // Klucz fromRawData wskazuje bufor parsera - do indeksu trafia kopia.
+    m_index.insert(QByteArray(data, size), index);
+    return index;}
+
+QString StringPool::at(quint32 index) const {
+    if (index == None || int(index) >= size()) return QString();
+    const quint32 begin = m_offsets.at(index);
+    return QString::fromUtf8(m_blob.constData() + begin, int(m_offsets.at(index + 1) - begin));}
+
+void StringPool::squeeze() {
+    m_index = QHash<QByteArray, quint32>();
+    m_blob.squeeze();
+    m_offsets.squeeze();}
+
+qint64 StringPool::memoryBytes() const {
+    return m_blob.capacity() + m_offsets.capacity() * qint64(sizeof(quint32));}
+
+const QStringList &StepTable::modeNames() {
+    static const QStringList names = {"adb", "shell", "root", "capture", "query"};
+    return names;}
+
+namespace {
+
+using json = nlohmann::json;
+
+// Stan: 0 = przed tablicą, 1 = w tablicy kroków, 2 = w obiekcie kroku; głębsze
+// zagnieżdżenia (nieznane pola) są pomijane licznikiem m_skip.
+class StepSaxHandler : public nlohmann::json_sax<json> {
+public:
+    explicit StepSaxHandler(StepTable *table) : m_table(table) {}
+
+    QString error;
+    bool needsFull = false;
+
+    bool null() override { return value(Null); }
+    bool boolean(bool v) override {
+        m_bool = v;
+        return value(Bool);}
+    bool number_integer(number_integer_t v) override {
+        m_number = double(v);
+        m_integral = true;
+        return value(Number);}
+    bool number_unsigned(number_unsigned_t v) override {
+        m_number = double(v);
+        m_integral = true;
+        return value(Number);}
+    bool number_float(number_float_t v, const string_t &) override {
+        m_number = v;
+        m_integral = v >= 0 && v <= INT_MAX && v == std::floor(v);
+        return value(Number);}
+    bool string(string_t &v) override {
+        m_string = &v;
+        return value(String);}
+    bool binary(binary_t &) override { return value(Other); }
+
+    bool start_object(std::size_t) override {
+        if (m_skip > 0 || m_depth == 2) return nested();
+        if (m_depth != 1) return fail("File does not contain a valid JSON array.");
+        m_depth = 2;
+        m_row = StepTable::Row();
+        m_hasCommand = false;
+        return true;}
+
+    bool end_object() override {
+        if (m_skip > 0) {
+            m_skip--;
+            return true;}
+        m_depth = 1;
+        if (!m_hasCommand) return failStep("missing or non-string \"command\"");
+        QString message;
+        const QString &mode = StepTable::modeNames().at(m_row.mode);
+        if (!SequenceProgram::checkStep(m_table->strings.at(m_row.command), mode, &message)) return failStep(message);
+        if (m_row.successCommand != StringPool::None
+            && !SequenceProgram::checkStep(m_table->strings.at(m_row.successCommand), mode, &message)) {
+            return failStep(QString("successCommand: %1").arg(message));}
+        if (m_row.failureCommand != StringPool::None
+            && !SequenceProgram::checkStep(m_table->strings.at(m_row.failureCommand), mode, &message)) {
+            return failStep(QString("failureCommand: %1").arg(message));}
+        m_table->rows.append(m_row);
+        m_index++;
+        return true;}
+
+    bool start_array(std::size_t) override {
+        if (m_depth == 0) {
+            m_depth = 1;
+            return true;}
+        if (m_skip > 0 || m_depth == 2) return nested();
+        return failStep("expected an object");}
+
+    bool end_array() override {
+        if (m_skip > 0) {
+            m_skip--;
+            return true;}
+        m_depth = 0;
+        return true;}
+
+    bool key(string_t &k) override {
+        if (m_skip == 0) m_key = k;
+        return true;}
+
+    bool parse_error(std::size_t position, const std::string &, const nlohmann::detail::exception &ex) override {
+        error = QString("Invalid JSON at offset %1: %2").arg(position).arg(QString::fromUtf8(ex.what()));
+        return false;}
+
+private:
+    enum Kind { Null, Bool, Number, String, Other };
+
+    // Bloki równoległe, zależności, sterowanie (if, pętle, goto, zmienne) i przechwytywanie
+    // wyjścia do zmiennych buduje pełny kompilator.
+    static bool fullCompileKey(const std::string &key) {
+        static const char *const keys[] = {"parallel", "dependsOn", "if", "then", "else", "repeat", "while",
+                                           "do", "goto", "label", "set", "add", "captureAs", "captureRegex"};
+        for (const char *k : keys) {
+            if (key == k) return true;}
+        return false;}
+
+    bool nested() {
+        if (m_skip == 0 && fullCompileKey(m_key)) {
+            needsFull = true;
+            return false;}
+        if (m_skip == 0 && m_key == "id") return failStep("\"id\" must be a non-empty string");
+        m_skip++;
+        return true;}
+
+    bool fail(const QString &message) {
+        error = message;
+        return false;}
+
+    bool failStep(const QString &message) {
+        return fail(QString("JSON index %1: %2").arg(m_index).arg(message));}
+
+    bool value(Kind kind) {
+        if (m_skip > 0) return true;
+        if (m_depth == 0) return fail("File does not contain a valid JSON array.");
+        if (m_depth == 1) return failStep("expected an object");
+        if (m_key == "command") {
+            if (kind != String) return failStep("missing or non-string \"command\"");
+            m_row.command = m_table->strings.intern(m_string->data(), int(m_string->size()));
+            m_hasCommand = true;
+        } else if (m_key == "runMode") {
+            if (kind != String) return failStep("\"runMode\" must be a string");
+            const QString mode = QString::fromStdString(*m_string).toLower();
+            const int index = StepTable::modeNames().indexOf(mode.isEmpty() ? QStringLiteral("adb") : mode);
+            if (index < 0) return failStep(QString("unknown runMode \"%1\" (adb, shell, root, capture, query)").arg(QString::fromStdString(*m_string)));
+            m_row.mode = quint8(index);
+        } else if (m_key == "delayAfterMs") {
+            if (kind != Number || m_number < 0) return failStep("\"delayAfterMs\" must be a non-negative number");
+            // Jak QJsonValue::toInt(100): wartość niecałkowita daje domyślne 100.
+            m_row.delayAfterMs = m_integral && m_number <= INT_MAX ? qint32(m_number) : 100;
+        } else if (m_key == "stopOnError") {
+            if (kind != Bool) return failStep("\"stopOnError\" must be a boolean");
+            m_row.stopOnError = m_bool;
+        } else if (m_key == "successCommand" || m_key == "failureCommand") {
+            if (kind != String) return failStep(QString("\"%1\" must be a string").arg(QString::fromStdString(m_key)));
+            quint32 &slot = m_key == "successCommand" ? m_row.successCommand : m_row.failureCommand;
+            slot = m_string->empty() ? StringPool::None : m_table->strings.intern(m_string->data(), int(m_string->size()));
+        } else if (m_key == "id") {
+            // Bez dependsOn "id" nic nie wskazuje, ale plik ma przechodzić te same reguły co w pełnym kompilatorze.
+            if (kind != String || m_string->empty()) return failStep("\"id\" must be a non-empty string");
+            const int before = m_ids.size();
+            m_ids.intern(m_string->data(), int(m_string->size()));
+            if (m_ids.size() == before) return failStep(QString("duplicate \"id\" \"%1\"").arg(QString::fromStdString(*m_string)));
+        } else if (fullCompileKey(m_key)) {
+            needsFull = true;
+            return false;}
+        return true;}
+
+    StepTable *m_table;
+    StringPool m_ids;
+    StepTable::Row m_row;
+    std::string m_key;
+    const string_t *m_string = nullptr;
+    double m_number = 0;
+    bool m_integral = false;
+    bool m_bool = false;
+    bool m_hasCommand = false;
+    int m_depth = 0;
+    int m_skip = 0;
+    int m_index = 0;
+};
+
+}
+
+StepLoadResult loadStepTable(const QString &path) {
+    StepLoadResult result;
+    QElapsedTimer timer;
+    timer.start();
+    std::ifstream in(QFile::encodeName(path).constData(), std::ios::binary);
+    if (!in) {
+        result.error = QString("Cannot open file: %1").arg(path);
+        return result;}
+    QSharedPointer<StepTable> table(new StepTable);
+    StepSaxHandler handler(table.data());
+    const bool ok = json::sax_parse(in, &handler);
+    result.needsFullCompile = handler.needsFull;
+    if (!ok || handler.needsFull) {
+        result.error = handler.error;
+        return result;}
+    table->rows.squeeze();
+    table->strings.squeeze();
+    result.table = table;
+    result.loadMs = timer.elapsed();
+    return result;}
+
+void StepPager::reset(const QSharedPointer<const SequenceProgram> &program) {
+    m_program = program;
+    m_pages.clear();
+    m_recent.clear();}
+
+SeqInstr StepPager::at(int index) {
+    if (!m_program->paged()) return m_program->instrs.at(index);
+    // Warunkowe (za stepCount) są rzadkie - kompilowane bez stron.
+    if (index >= m_program->stepCount) return m_program->instrAt(index);
+    const int page = index / PageSteps;
+    auto it = m_pages.find(page);
+    if (it == m_pages.end()) {
+        if (m_pages.size() >= MaxPages) m_pages.remove(m_recent.takeFirst());
+        const int first = page * PageSteps;
+        const int last = qMin(first + PageSteps, m_program->stepCount);
+        QVector<SeqInstr> instrs;
+        instrs.reserve(last - first);
+        for (int i = first; i < last; ++i) instrs.append(m_program->instrAt(i));
+        it = m_pages.insert(page, instrs);
+    } else {
+        m_recent.removeOne(page);}
+    m_recent.append(page);
+    return it.value().at(index - page * PageSteps);}
+
+qint64 residentMemoryBytes() {
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) return -1;
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2) return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QSharedPointer>
+#include <QList>
+#include "sequence_program.h"
+
+// Napisy bez powtórzeń w jednym buforze UTF-8. Indeks wyszukiwania istnieje tylko
+// w trakcie ładowania - squeeze() go zwalnia.
+class StringPool {
+public:
+    static const quint32 None = 0xFFFFFFFFu;
+
+    quint32 intern(const char *data, int size);
+    QString at(quint32 index) const;
+    int size() const { return m_offsets.size() - 1; }
+    void squeeze();
+    qint64 memoryBytes() const;
+
+private:
+    QByteArray m_blob;
+    QVector<quint32> m_offsets = {0};
+    QHash<QByteArray, quint32> m_index;
+};
+
+// Kroki liniowej sekwencji wczytane strumieniowo: 20 B na krok plus pula napisów.
+// Instrukcje (argv, pakiety sterowania) powstają z wierszy dopiero przy wykonaniu.
+class StepTable {
+public:
+    struct Row {
+        quint32 command = StringPool::None;
+        quint32 successCommand = StringPool::None;
+        quint32 failureCommand = StringPool::None;
+        qint32 delayAfterMs = 100;
+        quint8 mode = 0;            // indeks w modeNames()
+        bool stopOnError = true;
+    };
+
+    QVector<Row> rows;
+    StringPool strings;
+
+    static const QStringList &modeNames();
+    qint64 memoryBytes() const { return rows.capacity() * qint64(sizeof(Row)) + strings.memoryBytes(); }
+};
+
+struct StepLoadResult {
+    QSharedPointer<StepTable> table;
+    QString error;
+    // Plik używa "parallel"/"dependsOn" - potrzebna pełna kompilacja z QJsonDocument.
+    bool needsFullCompile = false;
+    qint64 loadMs = 0;
+};
+
+// Parser SAX (nlohmann) czytający plik strumieniem - bez drzewa dokumentu w pamięci.
+// Walidacja i komunikaty "JSON index N: ..." jak w SequenceProgram::compile.
+StepLoadResult loadStepTable(const QString &path);
+
+// Pamięć rezydentna procesu (Linux: /proc/self/statm), -1 gdy niedostępna.
+qint64 residentMemoryBytes();
+
+// Okno skompilowanych kroków programu stronicowanego, prywatne dla jednego wykonawcy
+// (program jest współdzielony między wątkami, strony nie). Dla programu w pamięci
+// at() zwraca instrs bez kopiowania stron.
+class StepPager {
+public:
+    static const int PageSteps = 1024;
+    static const int MaxPages = 4;
+
+    void reset(const QSharedPointer<const SequenceProgram> &program);
+    SeqInstr at(int index);
+    int loadedPages() const { return m_pages.size(); }
+
+private:
+    QSharedPointer<const SequenceProgram> m_program;
+    QHash<int, QVector<SeqInstr>> m_pages;
+    QList<int> m_recent;    // od najdawniej użytej
+};
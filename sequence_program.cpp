@@ -0,0 +1,775 @@
+#include "sequence_program.h"
+#include "argsparser.h"
+#include "control_protocol.h"
+#include "sequence_loader.h"
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QCryptographicHash>
+#include <cmath>
+#include <QElapsedTimer>
+
+static const int PROGRAM_CACHE_MAX = 32;
+static const int SWIPE_DEFAULT_MS = 300;
+static const int SWIPE_STEP_MS = 16;
+static const int SWIPE_MAX_STEPS = 64;
+// Poniżej tej liczby kroków plik wczytany strumieniowo jest kompilowany w całości.
+static const int PAGED_MIN_STEPS = 20000;
+
+static QHash<QByteArray, QSharedPointer<const SequenceProgram>> &programCache() {
+    static QHash<QByteArray, QSharedPointer<const SequenceProgram>> cache;
+    return cache;}
+
+const char *SeqInstr::opName(Op op) {
+    switch (op) {
+    case Adb: return "adb";
+    case Shell: return "shell";
+    case Root: return "root";
+    case Capture: return "capture";
+    case Query: return "query";
+    case Tap: return "tap";
+    case Swipe: return "swipe";
+    case Key: return "key";
+    case Input: return "input";
+    case Jump: return "jump";
+    case Set: return "set";
+    case Add: return "add";
+    case LoopInit: return "loop-init";
+    case Repeat: return "repeat";
+    case While: return "while";}
+    return "?";}
+
+QString SequenceProgram::interpolate(const QString &text, const QHash<QString, QString> &vars) {
+    qsizetype at = text.indexOf(QLatin1String("${"));
+    if (at < 0) return text;
+    QString out;
+    out.reserve(text.size());
+    qsizetype from = 0;
+    while (at >= 0) {
+        const qsizetype close = text.indexOf(QLatin1Char('}'), at + 2);
+        if (close < 0) break;
+        out += QStringView(text).mid(from, at - from);
+        out += vars.value(text.mid(at + 2, close - at - 2).trimmed());
+        from = close + 1;
+        at = text.indexOf(QLatin1String("${"), from);}
+    out += QStringView(text).mid(from);
+    return out;}
+
+static bool isIdentifier(const QString &text) {
+    if (text.isEmpty() || !(text.at(0).isLetter() || text.at(0) == QLatin1Char('_'))) return false;
+    for (QChar c : text) {
+        if (!c.isLetterOrNumber() && c != QLatin1Char('_')) return false;}
+    return true;}
+
+// Operand warunku jako szablon: 'tekst'/"tekst" dosłownie, goły identyfikator to zmienna,
+// reszta (liczby, ${...}) bez zmian.
+static QString conditionOperand(const QString &raw) {
+    const QString text = raw.trimmed();
+    if (text.size() >= 2 && (text.front() == QLatin1Char('\'') || text.front() == QLatin1Char('"')) && text.back() == text.front()) {
+        return text.mid(1, text.size() - 2);}
+    if (isIdentifier(text) && text != QLatin1String("true") && text != QLatin1String("false")) {
+        return QString("${%1}").arg(text);}
+    return text;}
+
+bool SeqCond::parse(const QString &text, SeqCond *out, QString *error) {
+    SeqCond cond;
+    QString expr = text.trimmed();
+    if (expr.startsWith(QLatin1Char('!')) && !expr.startsWith(QLatin1String("!="))) {
+        cond.negate = true;
+        expr = expr.mid(1).trimmed();}
+    if (expr.isEmpty()) {
+        if (error) *error = "empty condition";
+        return false;}
+    static const struct { const char *token; Cmp cmp; } ops[] = {
+        {"==", Eq}, {"!=", Ne}, {"<=", Le}, {">=", Ge}, {"<", Lt}, {">", Gt}, {" contains ", Contains}};
+    QChar quote;
+    for (qsizetype i = 0; i < expr.size(); ++i) {
+        const QChar c = expr.at(i);
+        if (!quote.isNull()) {
+            if (c == quote) quote = QChar();
+            continue;}
+        if (c == QLatin1Char('\'') || c == QLatin1Char('"')) {
+            quote = c;
+            continue;}
+        for (const auto &op : ops) {
+            const QLatin1String token(op.token);
+            if (!QStringView(expr).mid(i).startsWith(token)) continue;
+            cond.cmp = op.cmp;
+            cond.lhs = conditionOperand(expr.left(i));
+            cond.rhs = conditionOperand(expr.mid(i + token.size()));
+            if (expr.left(i).trimmed().isEmpty() || expr.mid(i + token.size()).trimmed().isEmpty()) {
+                if (error) *error = QString("condition \"%1\": missing operand").arg(text);
+                return false;}
+            *out = cond;
+            return true;}}
+    cond.cmp = Truthy;
+    cond.lhs = conditionOperand(expr);
+    *out = cond;
+    return true;}
+
+bool SeqCond::evaluate(const QHash<QString, QString> &vars) const {
+    if (cmp == Always) return !negate;
+    const QString a = SequenceProgram::interpolate(lhs, vars);
+    bool result = false;
+    if (cmp == Truthy) {
+        result = !a.isEmpty() && a != QLatin1String("0") && a.compare(QLatin1String("false"), Qt::CaseInsensitive) != 0;
+    } else {
+        const QString b = SequenceProgram::interpolate(rhs, vars);
+        bool numA = false;
+        bool numB = false;
+        const double x = a.trimmed().toDouble(&numA);
+        const double y = b.trimmed().toDouble(&numB);
+        const int order = (numA && numB) ? (x < y ? -1 : (x > y ? 1 : 0)) : a.compare(b);
+        switch (cmp) {
+        case Eq: result = order == 0; break;
+        case Ne: result = order != 0; break;
+        case Lt: result = order < 0; break;
+        case Le: result = order <= 0; break;
+        case Gt: result = order > 0; break;
+        case Ge: result = order >= 0; break;
+        case Contains: result = a.contains(b); break;
+        default: break;}}
+    return result != negate;}
+
+static bool toCoord(const QString &text, int *out) {
+    bool ok = false;
+    const int v = text.toInt(&ok);
+    if (!ok || v < 0 || v > 0xFFFF) return false;
+    *out = v;
+    return true;}
+
+static void appendPacket(QByteArray *packets, ControlEventType type, int x, int y, int data = 0) {
+    packets->append(packetToByteArray(createTouchPacket(type, uint16_t(x), uint16_t(y), uint16_t(data))));}
+
+// "input tap|swipe|keyevent" z samymi liczbami - wszystko inne zostaje zwykłym krokiem shell.
+static bool encodeInput(const QStringList &argv, SeqInstr *in) {
+    if (argv.size() < 2 || argv.at(0) != QLatin1String("input")) return false;
+    const QString &verb = argv.at(1);
+    int v[5] = {0, 0, 0, 0, SWIPE_DEFAULT_MS};
+    if (verb == QLatin1String("tap") && argv.size() == 4) {
+        if (!toCoord(argv.at(2), &v[0]) || !toCoord(argv.at(3), &v[1])) return false;
+        in->op = SeqInstr::Tap;
+        appendPacket(&in->packets, EVENT_TYPE_TOUCH_DOWN, v[0], v[1]);
+        appendPacket(&in->packets, EVENT_TYPE_TOUCH_UP, v[0], v[1]);
+    } else if (verb == QLatin1String("swipe") && (argv.size() == 6 || argv.size() == 7)) {
+        for (int i = 0; i < argv.size() - 2; ++i) {
+            if (!toCoord(argv.at(i + 2), &v[i])) return false;}
+        in->op = SeqInstr::Swipe;
+        const int steps = qBound(1, v[4] / SWIPE_STEP_MS, SWIPE_MAX_STEPS);
+        in->packetIntervalMs = v[4] / steps;
+        appendPacket(&in->packets, EVENT_TYPE_TOUCH_DOWN, v[0], v[1]);
+        for (int s = 1; s <= steps; ++s) {
+            appendPacket(&in->packets, EVENT_TYPE_TOUCH_MOVE,
+                         v[0] + (v[2] - v[0]) * s / steps, v[1] + (v[3] - v[1]) * s / steps);}
+        appendPacket(&in->packets, EVENT_TYPE_TOUCH_UP, v[2], v[3]);
+    } else if (verb == QLatin1String("keyevent") && argv.size() == 3) {
+        if (!toCoord(argv.at(2), &v[0])) return false;
+        in->op = SeqInstr::Key;
+        in->packets = packetToByteArray(createKeyPacket(uint16_t(v[0])));
+    } else {
+        return false;}
+    in->argv = argv.mid(2);
+    return true;}
+
+bool SequenceProgram::checkStep(const QString &command, const QString &runMode, QString *error) {
+    const QString mode = runMode.isEmpty() ? QStringLiteral("adb") : runMode.toLower();
+    if (command.trimmed().isEmpty()) {
+        if (error) *error = "empty \"command\"";
+        return false;}
+    if (!StepTable::modeNames().contains(mode)) {
+        if (error) *error = QString("unknown runMode \"%1\" (adb, shell, root, capture, query)").arg(runMode);
+        return false;}
+    if (mode == QLatin1String("capture") && command.lastIndexOf(" > ") <= 0) {
+        if (error) *error = "capture expects \"<command> > <local file>\"";
+        return false;}
+    return true;}
+
+bool SequenceProgram::compileStep(const QString &command, const QString &runMode, SeqInstr *out, QString *error) {
+    if (!checkStep(command, runMode, error)) return false;
+    SeqInstr in;
+    in.command = command;
+    const QString mode = runMode.isEmpty() ? QStringLiteral("adb") : runMode.toLower();
+    if (mode == QLatin1String("adb")) {
+        in.op = SeqInstr::Adb;
+        in.argv = ArgsParser::parse(command);
+    } else if (mode == QLatin1String("shell")) {
+        in.op = SeqInstr::Shell;
+        const QStringList argv = ArgsParser::parse(command);
+        if (!encodeInput(argv, &in) && argv.value(0) == QLatin1String("input")) in.op = SeqInstr::Input;
+    } else if (mode == QLatin1String("root")) {
+        in.op = SeqInstr::Root;
+    } else if (mode == QLatin1String("capture")) {
+        in.op = SeqInstr::Capture;
+    } else {
+        in.op = SeqInstr::Query;}
+    in.templated = command.contains(QLatin1String("${"));
+    *out = in;
+    return true;}
+
+bool SequenceProgram::bind(const SeqInstr &in, const QHash<QString, QString> &vars, SeqInstr *out, QString *error) {
+    // Tap/Swipe/Key/Input powstają tylko z trybu shell.
+    const char *mode = "shell";
+    switch (in.op) {
+    case SeqInstr::Adb: mode = "adb"; break;
+    case SeqInstr::Root: mode = "root"; break;
+    case SeqInstr::Capture: mode = "capture"; break;
+    case SeqInstr::Query: mode = "query"; break;
+    default: break;}
+    SeqInstr step;
+    if (!compileStep(interpolate(in.command, vars), QLatin1String(mode), &step, error)) return false;
+    SeqInstr bound = in;
+    bound.op = step.op;
+    bound.command = step.command;
+    bound.argv = step.argv;
+    bound.packets = step.packets;
+    bound.packetIntervalMs = step.packetIntervalMs;
+    bound.templated = false;
+    *out = bound;
+    return true;}
+
+// Krok z pliku przed kompilacją - blok "parallel" rozwija się w swoje kroki.
+struct StepSource {
+    QJsonObject obj;
+    QString where;          // "3" albo "3.parallel[1]" - do komunikatów błędów
+    int top = 0;            // indeks elementu tablicy JSON
+    QJsonValue blockDeps;   // "dependsOn" bloku, dziedziczone przez kroki bez własnego
+};
+
+static QString addName(QHash<QString, QVector<int>> *names, const QJsonValue &id, const QVector<int> &steps) {
+    if (id.isUndefined()) return QString();
+    if (!id.isString() || id.toString().isEmpty()) return "\"id\" must be a non-empty string";
+    if (names->contains(id.toString())) return QString("duplicate \"id\" \"%1\"").arg(id.toString());
+    names->insert(id.toString(), steps);
+    return QString();}
+
+// Kroki bez "dependsOn" czekają na cały poprzedni element tablicy (krok albo blok),
+// więc plik bez bloków i zależności zachowuje się jak dotąd - liniowo.
+static QString resolveDeps(SequenceProgram *program, const QVector<StepSource> &sources,
+                           const QHash<QString, QVector<int>> &names, int *where) {
+    QVector<int> previous;
+    for (int k = 0; k < sources.size();) {
+        const int top = sources.at(k).top;
+        QVector<int> element;
+        for (; k < sources.size() && sources.at(k).top == top; ++k) {
+            *where = k;
+            QJsonValue dependsOn = sources.at(k).obj.value("dependsOn");
+            if (dependsOn.isUndefined()) dependsOn = sources.at(k).blockDeps;
+            QVector<int> deps;
+            if (dependsOn.isUndefined()) {
+                deps = previous;
+            } else {
+                if (!dependsOn.isString() && !dependsOn.isArray()) return "\"dependsOn\" must be a step id or an array of step ids";
+                const QJsonArray refs = dependsOn.isString() ? QJsonArray{dependsOn} : dependsOn.toArray();
+                for (const QJsonValue &ref : refs) {
+                    if (!ref.isString() || !names.contains(ref.toString())) {
+                        return QString("\"dependsOn\": unknown step id \"%1\"").arg(ref.toString());}
+                    for (int d : names.value(ref.toString())) {
+                        if (!deps.contains(d)) deps.append(d);}}}
+            program->instrs[k].deps = deps;
+            element.append(k);}
+        previous = element;}
+    QVector<int> pending(sources.size());
+    QVector<int> ready;
+    for (int k = 0; k < sources.size(); ++k) {
+        const QVector<int> deps = program->instrs.at(k).deps;
+        pending[k] = deps.size();
+        for (int d : deps) program->instrs[d].dependents.append(k);
+        if (deps.isEmpty()) ready.append(k);}
+    int visited = 0;
+    while (!ready.isEmpty()) {
+        const int k = ready.takeLast();
+        visited++;
+        for (int n : program->instrs.at(k).dependents) {
+            if (--pending[n] == 0) ready.append(n);}}
+    if (visited == sources.size()) return QString();
+    for (int k = 0; k < sources.size(); ++k) {
+        if (pending.at(k) > 0) {
+            *where = k;
+            return "dependency cycle through \"dependsOn\"";}}
+    return QString();}
+
+// Obiekt kroku z "command": instrukcja i jej successCommand/failureCommand (present[b]).
+// Zwraca komunikat błędu albo pusty napis.
+static QString compileCommandObject(const QJsonObject &obj, SeqInstr *in, SeqInstr branches[2], bool present[2],
+                                    int defaultDelayMs = 100, bool defaultStopOnError = true) {
+    const QJsonValue command = obj.value("command");
+    if (!command.isString()) return "missing or non-string \"command\"";
+    const QJsonValue runMode = obj.value("runMode");
+    if (!runMode.isUndefined() && !runMode.isString()) return "\"runMode\" must be a string";
+    QString message;
+    if (!SequenceProgram::compileStep(command.toString(), runMode.toString("adb"), in, &message)) return message;
+    const QJsonValue delay = obj.value("delayAfterMs");
+    if (!delay.isUndefined() && (!delay.isDouble() || delay.toDouble() < 0)) {
+        return "\"delayAfterMs\" must be a non-negative number";}
+    const QJsonValue stopOnError = obj.value("stopOnError");
+    if (!stopOnError.isUndefined() && !stopOnError.isBool()) return "\"stopOnError\" must be a boolean";
+    in->delayAfterMs = delay.toInt(defaultDelayMs);
+    in->stopOnError = stopOnError.toBool(defaultStopOnError);
+    in->name = obj.value("id").toString();
+    const QJsonValue captureAs = obj.value("captureAs");
+    const QJsonValue captureRegex = obj.value("captureRegex");
+    if (!captureAs.isUndefined()) {
+        if (!captureAs.isString() || !isIdentifier(captureAs.toString())) return "\"captureAs\" must be a variable name";
+        if (in->op == SeqInstr::Capture) return "\"captureAs\" cannot be used with runMode capture (output goes to a file)";
+        in->captureAs = captureAs.toString();}
+    if (!captureRegex.isUndefined()) {
+        if (captureAs.isUndefined()) return "\"captureRegex\" needs \"captureAs\"";
+        if (!captureRegex.isString()) return "\"captureRegex\" must be a string";
+        in->capture = QRegularExpression(captureRegex.toString(), QRegularExpression::MultilineOption);
+        if (!in->capture.isValid()) return QString("\"captureRegex\": %1").arg(in->capture.errorString());}
+    // successCommand/failureCommand: osobne instrukcje w tym samym trybie, wracające do następnego kroku.
+    const char *names[2] = {"successCommand", "failureCommand"};
+    for (int b = 0; b < 2; ++b) {
+        const QJsonValue branch = obj.value(names[b]);
+        if (branch.isUndefined() || (branch.isString() && branch.toString().isEmpty())) continue;
+        if (!branch.isString()) return QString("\"%1\" must be a string").arg(names[b]);
+        SeqInstr &cond = branches[b];
+        if (!SequenceProgram::compileStep(branch.toString(), runMode.toString("adb"), &cond, &message)) {
+            return QString("%1: %2").arg(names[b], message);}
+        cond.conditional = true;
+        cond.delayAfterMs = 0;
+        cond.stopOnError = true;
+        present[b] = true;}
+    return QString();}
+
+static const char *const FLOW_KEYS[] = {"if", "repeat", "while", "goto", "label", "set", "add"};
+
+static bool usesControlFlow(const QJsonArray &array) {
+    for (const QJsonValue &value : array) {
+        const QJsonObject obj = value.toObject();
+        for (const char *key : FLOW_KEYS) {
+            if (obj.contains(QLatin1String(key))) return true;}}
+    return false;}
+
+// Sekwencja ze sterowaniem. Kod jest emitowany w naturalnej kolejności (next = następna
+// emitowana instrukcja), a potem przenumerowany: kroki z poleceniem zajmują 0..stepCount-1
+// jak w programie liniowym, instrukcje sterujące i warunkowe - resztę.
+class FlowCompiler {
+public:
+    QVector<SeqInstr> code;
+    int loopSlots = 0;
+    QString error;
+
+    bool block(const QJsonArray &array, const QString &prefix);
+    bool resolveLabels();
+
+private:
+    struct Goto {
+        int at;
+        QString label;
+        QString where;
+    };
+
+    bool fail(const QString &where, const QString &message) {
+        error = QString("JSON index %1: %2").arg(where, message);
+        return false;}
+    int emitInstr(SeqInstr in) {
+        in.next = code.size() + 1;
+        code.append(in);
+        return code.size() - 1;}
+    int emitControl(SeqInstr::Op op) {
+        SeqInstr in;
+        in.op = op;
+        in.delayAfterMs = 0;
+        return emitInstr(in);}
+    bool element(const QJsonObject &obj, const QString &where);
+    bool commandStep(const QJsonObject &obj, const QString &where, int defaultDelayMs, bool defaultStopOnError);
+    bool condition(const QJsonValue &value, const QString &where, SeqCond *cond);
+    bool ifElse(const QJsonObject &obj, const QString &where);
+    bool loop(const QJsonObject &obj, const QString &where);
+    bool assign(const QJsonObject &obj, const QString &where);
+
+    QHash<QString, int> m_labels;
+    QVector<Goto> m_gotos;
+};
+
+bool FlowCompiler::block(const QJsonArray &array, const QString &prefix) {
+    for (int i = 0; i < array.size(); ++i) {
+        const QString where = prefix.isEmpty() ? QString::number(i) : QString("%1[%2]").arg(prefix).arg(i);
+        if (!array.at(i).isObject()) return fail(where, "expected an object");
+        if (!element(array.at(i).toObject(), where)) return false;}
+    return true;}
+
+bool FlowCompiler::resolveLabels() {
+    for (const Goto &g : std::as_const(m_gotos)) {
+        if (!m_labels.contains(g.label)) return fail(g.where, QString("unknown label \"%1\"").arg(g.label));
+        code[g.at].jump = m_labels.value(g.label);}
+    return true;}
+
+bool FlowCompiler::element(const QJsonObject &obj, const QString &where) {
+    if (obj.contains("parallel") || obj.contains("dependsOn")) {
+        return fail(where, "\"parallel\"/\"dependsOn\" cannot be combined with control flow (if, repeat, while, goto, label, set, add)");}
+    const QJsonValue label = obj.value("label");
+    if (!label.isUndefined()) {
+        if (!label.isString() || label.toString().isEmpty()) return fail(where, "\"label\" must be a non-empty string");
+        if (m_labels.contains(label.toString())) return fail(where, QString("duplicate label \"%1\"").arg(label.toString()));
+        m_labels.insert(label.toString(), code.size());
+        if (obj.size() == 1) return true;}
+    if (obj.contains("goto")) {
+        const QJsonValue target = obj.value("goto");
+        if (!target.isString() || target.toString().isEmpty()) return fail(where, "\"goto\" must be a label name");
+        SeqCond cond;
+        if (obj.contains("if") && !condition(obj.value("if"), where + ".if", &cond)) return false;
+        const int at = emitControl(SeqInstr::Jump);
+        code[at].cond = cond;
+        m_gotos.append({at, target.toString(), where});
+        return true;}
+    if (obj.contains("if")) return ifElse(obj, where);
+    if (obj.contains("repeat") || obj.contains("while")) return loop(obj, where);
+    if (obj.contains("set") || obj.contains("add")) return assign(obj, where);
+    if (obj.contains("command")) return commandStep(obj, where, 100, true);
+    return fail(where, "expected \"command\" or a control-flow element (if, repeat, while, goto, label, set, add)");}
+
+bool FlowCompiler::commandStep(const QJsonObject &obj, const QString &where, int defaultDelayMs, bool defaultStopOnError) {
+    SeqInstr in;
+    SeqInstr branches[2];
+    bool present[2] = {false, false};
+    const QString message = compileCommandObject(obj, &in, branches, present, defaultDelayMs, defaultStopOnError);
+    if (!message.isEmpty()) return fail(where, message);
+    const int at = emitInstr(in);
+    int ids[2] = {-1, -1};
+    for (int b = 0; b < 2; ++b) {
+        if (present[b]) ids[b] = emitInstr(branches[b]);}
+    // Krok i jego warunkowe wychodzą w to samo miejsce - za ostatnią z nich.
+    const int after = code.size();
+    code[at].next = after;
+    code[at].onSuccess = ids[0];
+    code[at].onFailure = ids[1];
+    for (int id : ids) {
+        if (id >= 0) code[id].next = after;}
+    return true;}
+
+bool FlowCompiler::condition(const QJsonValue &value, const QString &where, SeqCond *cond) {
+    QString message;
+    if (value.isString()) {
+        if (!SeqCond::parse(value.toString(), cond, &message)) return fail(where, message);
+        return true;}
+    if (value.isBool()) {
+        cond->cmp = SeqCond::Always;
+        cond->negate = !value.toBool();
+        return true;}
+    if (value.isObject() && value.toObject().contains("command")) {
+        // Warunkiem jest kod wyjścia kroku - porażka to gałąź "nie", nie błąd sekwencji.
+        if (!commandStep(value.toObject(), where, 0, false)) return false;
+        cond->cmp = SeqCond::Eq;
+        cond->lhs = "${lastExit}";
+        cond->rhs = "0";
+        return true;}
+    return fail(where, "condition must be an expression string, a boolean or a step with \"command\"");}
+
+bool FlowCompiler::ifElse(const QJsonObject &obj, const QString &where) {
+    QJsonArray thenSteps;
+    const QJsonValue thenValue = obj.value("then");
+    if (thenValue.isUndefined() && obj.contains("command")) {
+        // Krok z "if" to skrót dla {"if": ..., "then": [krok]}.
+        QJsonObject step = obj;
+        step.remove("if");
+        step.remove("label");
+        thenSteps.append(step);
+    } else if (thenValue.isArray()) {
+        thenSteps = thenValue.toArray();
+    } else {
+        return fail(where, "\"if\" needs a \"then\" array of steps");}
+    const QJsonValue elseValue = obj.value("else");
+    if (!elseValue.isUndefined() && !elseValue.isArray()) return fail(where, "\"else\" must be an array of steps");
+    SeqCond cond;
+    if (!condition(obj.value("if"), where + ".if", &cond)) return false;
+    // Skok przy fałszywym warunku - do "else" albo za blok.
+    cond.negate = !cond.negate;
+    const int skip = emitControl(SeqInstr::Jump);
+    code[skip].cond = cond;
+    if (!block(thenSteps, where + ".then")) return false;
+    if (elseValue.isArray()) {
+        const int end = emitControl(SeqInstr::Jump);
+        code[skip].jump = code.size();
+        if (!block(elseValue.toArray(), where + ".else")) return false;
+        code[end].jump = code.size();
+    } else {
+        code[skip].jump = code.size();}
+    return true;}
+
+bool FlowCompiler::loop(const QJsonObject &obj, const QString &where) {
+    const bool isRepeat = obj.contains("repeat");
+    const QJsonValue body = obj.value("do");
+    if (!body.isArray()) return fail(where, QString("\"%1\" needs a \"do\" array of steps").arg(isRepeat ? "repeat" : "while"));
+    const QJsonValue as = obj.value("as");
+    if (!as.isUndefined() && (!as.isString() || !isIdentifier(as.toString()))) return fail(where, "\"as\" must be a variable name");
+    const int slot = loopSlots++;
+    const int init = emitControl(SeqInstr::LoopInit);
+    code[init].loopSlot = slot;
+    const int top = code.size();
+    int test = -1;
+    if (isRepeat) {
+        // Liczba albo szablon ("${n}") - liczony przy każdym sprawdzeniu.
+        const QJsonValue count = obj.value("repeat");
+        QString limit;
+        if (count.isDouble() && count.toDouble() >= 0 && count.toDouble() == std::floor(count.toDouble())) {
+            limit = QString::number(qint64(count.toDouble()));
+        } else if (count.isString() && !count.toString().trimmed().isEmpty()) {
+            limit = count.toString();
+        } else {
+            return fail(where, "\"repeat\" must be a non-negative integer or a \"${variable}\" template");}
+        test = emitControl(SeqInstr::Repeat);
+        code[test].argv = QStringList{limit};
+    } else {
+        const QJsonValue max = obj.value("maxIterations");
+        if (!max.isUndefined() && (!max.isDouble() || max.toDouble() < 0)) return fail(where, "\"maxIterations\" must be a non-negative number");
+        SeqCond cond;
+        if (!condition(obj.value("while"), where + ".while", &cond)) return false;
+        test = emitControl(SeqInstr::While);
+        code[test].cond = cond;
+        code[test].limit = qint64(max.toDouble(0));}
+    code[test].loopSlot = slot;
+    code[test].name = as.toString();
+    if (!block(body.toArray(), where + ".do")) return false;
+    const int back = emitControl(SeqInstr::Jump);
+    code[back].jump = top;
+    code[test].jump = code.size();
+    return true;}
+
+bool FlowCompiler::assign(const QJsonObject &obj, const QString &where) {
+    if (obj.contains("command")) return fail(where, "\"set\"/\"add\" cannot share an object with \"command\"");
+    const char *keys[2] = {"set", "add"};
+    for (const char *key : keys) {
+        const QJsonValue value = obj.value(QLatin1String(key));
+        if (value.isUndefined()) continue;
+        const bool isAdd = key == keys[1];
+        if (!value.isObject() || value.toObject().isEmpty()) return fail(where, QString("\"%1\" must be an object of variable names").arg(QLatin1String(key)));
+        QStringList pairs;
+        const QJsonObject vars = value.toObject();
+        for (auto it = vars.begin(); it != vars.end(); ++it) {
+            if (!isIdentifier(it.key())) return fail(where, QString("\"%1\": invalid variable name \"%2\"").arg(key, it.key()));
+            const QJsonValue v = it.value();
+            QString text;
+            if (v.isString()) {
+                text = v.toString();
+            } else if (v.isDouble()) {
+                text = QString::number(v.toDouble(), 'g', 15);
+            } else if (v.isBool() && !isAdd) {
+                text = v.toBool() ? "true" : "false";
+            } else {
+                return fail(where, QString("\"%1\": value of \"%2\" must be a %3").arg(key, it.key(), isAdd ? "number or template" : "string, number or boolean"));}
+            pairs << it.key() << text;}
+        const int at = emitControl(isAdd ? SeqInstr::Add : SeqInstr::Set);
+        code[at].argv = pairs;}
+    return true;}
+
+static QSharedPointer<SequenceProgram> buildFlowProgram(const QJsonArray &array, QString *error) {
+    FlowCompiler compiler;
+    if (!compiler.block(array, QString()) || !compiler.resolveLabels()) {
+        if (error) *error = compiler.error;
+        return {};}
+    const QVector<SeqInstr> &code = compiler.code;
+    const int total = code.size();
+    // map[total] = -1: skok lub next za ostatnią instrukcję kończy sekwencję.
+    QVector<int> map(total + 1, -1);
+    int steps = 0;
+    for (int i = 0; i < total; ++i) {
+        if (!code.at(i).isControl() && !code.at(i).conditional) map[i] = steps++;}
+    int other = steps;
+    for (int i = 0; i < total; ++i) {
+        if (map.at(i) < 0) map[i] = other++;}
+    auto remap = [&map](int index) { return index < 0 ? -1 : map.at(index); };
+    QSharedPointer<SequenceProgram> program(new SequenceProgram);
+    program->stepCount = steps;
+    program->loopSlots = compiler.loopSlots;
+    program->instrs.resize(total);
+    for (int i = 0; i < total; ++i) {
+        SeqInstr in = code.at(i);
+        in.next = remap(in.next);
+        in.jump = remap(in.jump);
+        in.onSuccess = remap(in.onSuccess);
+        in.onFailure = remap(in.onFailure);
+        program->instrs[map.at(i)] = in;}
+    for (int i = 0; i < steps; ++i) {
+        SeqInstr &in = program->instrs[i];
+        in.sourceIndex = i;
+        if (in.onSuccess >= 0) program->instrs[in.onSuccess].sourceIndex = i;
+        if (in.onFailure >= 0) program->instrs[in.onFailure].sourceIndex = i;}
+    program->entry = total > 0 ? map.at(0) : -1;
+    return program;}
+
+static QSharedPointer<SequenceProgram> buildProgram(const QJsonArray &array, QString *error) {
+    QSharedPointer<SequenceProgram> program(new SequenceProgram);
+    auto fail = [error](const QString &where, const QString &message) {
+        if (error) *error = QString("JSON index %1: %2").arg(where, message);
+        return QSharedPointer<SequenceProgram>();};
+    if (usesControlFlow(array)) return buildFlowProgram(array, error);
+    QVector<StepSource> sources;
+    QHash<QString, QVector<int>> names;
+    for (int i = 0; i < array.size(); ++i) {
+        const QJsonValue value = array.at(i);
+        const QString where = QString::number(i);
+        if (!value.isObject()) return fail(where, "expected an object");
+        const QJsonObject obj = value.toObject();
+        const QJsonValue parallel = obj.value("parallel");
+        QString message;
+        if (parallel.isUndefined()) {
+            if (obj.contains("dependsOn")) program->dag = true;
+            message = addName(&names, obj.value("id"), {int(sources.size())});
+            if (!message.isEmpty()) return fail(where, message);
+            sources.append({obj, where, i, QJsonValue()});
+            continue;}
+        if (!parallel.isArray() || parallel.toArray().isEmpty()) return fail(where, "\"parallel\" must be a non-empty array of steps");
+        if (obj.contains("command")) return fail(where, "a \"parallel\" block cannot have its own \"command\"");
+        program->dag = true;
+        const QJsonArray members = parallel.toArray();
+        QVector<int> memberSteps;
+        for (int j = 0; j < members.size(); ++j) {
+            const QString memberWhere = QString("%1.parallel[%2]").arg(i).arg(j);
+            if (!members.at(j).isObject()) return fail(memberWhere, "expected an object");
+            const QJsonObject member = members.at(j).toObject();
+            if (member.contains("parallel")) return fail(memberWhere, "nested \"parallel\" blocks are not supported");
+            message = addName(&names, member.value("id"), {int(sources.size())});
+            if (!message.isEmpty()) return fail(memberWhere, message);
+            memberSteps.append(sources.size());
+            sources.append({member, memberWhere, i, obj.value("dependsOn")});}
+        // "id" bloku wskazuje wszystkie jego kroki naraz.
+        message = addName(&names, obj.value("id"), memberSteps);
+        if (!message.isEmpty()) return fail(where, message);}
+    program->stepCount = sources.size();
+    program->instrs.resize(sources.size());
+    for (int i = 0; i < sources.size(); ++i) {
+        SeqInstr branches[2];
+        bool present[2] = {false, false};
+        const QString message = compileCommandObject(sources.at(i).obj, &program->instrs[i], branches, present);
+        if (!message.isEmpty()) return fail(sources.at(i).where, message);
+        SeqInstr &in = program->instrs[i];
+        in.sourceIndex = i;
+        in.next = (i + 1 < sources.size()) ? i + 1 : -1;
+        for (int b = 0; b < 2; ++b) {
+            if (!present[b]) continue;
+            branches[b].sourceIndex = i;
+            branches[b].next = program->instrs.at(i).next;
+            program->instrs.append(branches[b]);
+            // append() mogło przenieść wektor - referencja "in" jest już nieważna.
+            SeqInstr &owner = program->instrs[i];
+            if (b == 0) {
+                owner.onSuccess = program->instrs.size() - 1;
+            } else {
+                owner.onFailure = program->instrs.size() - 1;}}}
+    if (program->dag) {
+        int at = 0;
+        const QString message = resolveDeps(program.data(), sources, names, &at);
+        if (!message.isEmpty()) return fail(sources.at(at).where, message);}
+    program->entry = program->stepCount > 0 ? 0 : -1;
+    return program;}
+
+// Wiersz tabeli jest już zwalidowany przy wczytaniu - compileStep tu nie zawiedzie.
+static SeqInstr rowInstr(const StepTable &table, int step, int stepCount) {
+    const StepTable::Row &row = table.rows.at(step);
+    SeqInstr in;
+    SequenceProgram::compileStep(table.strings.at(row.command), StepTable::modeNames().at(row.mode), &in, nullptr);
+    in.delayAfterMs = row.delayAfterMs;
+    in.stopOnError = row.stopOnError;
+    in.sourceIndex = step;
+    in.next = (step + 1 < stepCount) ? step + 1 : -1;
+    if (row.successCommand != StringPool::None) in.onSuccess = stepCount + 2 * step;
+    if (row.failureCommand != StringPool::None) in.onFailure = stepCount + 2 * step + 1;
+    return in;}
+
+static SeqInstr branchInstr(const StepTable &table, int step, bool failure, int stepCount) {
+    const StepTable::Row &row = table.rows.at(step);
+    SeqInstr cond;
+    SequenceProgram::compileStep(table.strings.at(failure ? row.failureCommand : row.successCommand),
+                                 StepTable::modeNames().at(row.mode), &cond, nullptr);
+    cond.conditional = true;
+    cond.delayAfterMs = 0;
+    cond.stopOnError = true;
+    cond.sourceIndex = step;
+    cond.next = (step + 1 < stepCount) ? step + 1 : -1;
+    return cond;}
+
+SeqInstr SequenceProgram::instrAt(int index) const {
+    if (!paged()) return instrs.at(index);
+    if (index < stepCount) return rowInstr(*table, index, stepCount);
+    return branchInstr(*table, (index - stepCount) / 2, (index - stepCount) % 2, stepCount);}
+
+QString SequenceProgram::commandAt(int index) const {
+    if (!paged()) return instrs.value(index).command;
+    if (index < 0 || index >= stepCount) return instrAt(index).command;
+    return table->strings.at(table->rows.at(index).command);}
+
+qint64 SequenceProgram::tableBytes() const {
+    return table ? table->memoryBytes() : 0;}
+
+// Mały plik: instrukcje w całości, w układzie buildProgram (warunkowe dopisane na końcu).
+static QSharedPointer<SequenceProgram> programFromTable(const QSharedPointer<StepTable> &table) {
+    QSharedPointer<SequenceProgram> program(new SequenceProgram);
+    const int count = table->rows.size();
+    program->stepCount = count;
+    program->entry = count > 0 ? 0 : -1;
+    if (count >= PAGED_MIN_STEPS) {
+        program->table = table;
+        return program;}
+    program->instrs.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        SeqInstr in = rowInstr(*table, i, count);
+        in.onSuccess = -1;
+        in.onFailure = -1;
+        program->instrs.append(in);}
+    for (int i = 0; i < count; ++i) {
+        const StepTable::Row &row = table->rows.at(i);
+        if (row.successCommand != StringPool::None) {
+            program->instrs.append(branchInstr(*table, i, false, count));
+            program->instrs[i].onSuccess = program->instrs.size() - 1;}
+        if (row.failureCommand != StringPool::None) {
+            program->instrs.append(branchInstr(*table, i, true, count));
+            program->instrs[i].onFailure = program->instrs.size() - 1;}}
+    return program;}
+
+QSharedPointer<const SequenceProgram> SequenceProgram::compile(const QJsonArray &array, QString *error) {
+    QSharedPointer<SequenceProgram> program = buildProgram(array, error);
+    // Bez pliku: skrót z kanonicznej postaci tablicy, żeby checkpoint dało się dopasować.
+    if (program) program->sourceHash = QCryptographicHash::hash(QJsonDocument(array).toJson(QJsonDocument::Compact),
+                                                                QCryptographicHash::Sha1);
+    return program;}
+
+QSharedPointer<const SequenceProgram> SequenceProgram::compileFile(const QString &path, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = QString("Cannot open file: %1").arg(file.errorString());
+        return {};}
+    QCryptographicHash hasher(QCryptographicHash::Sha1);
+    hasher.addData(&file);
+    const QByteArray hash = hasher.result();
+    auto &cache = programCache();
+    if (auto hit = cache.value(hash)) return hit;
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 rssBefore = residentMemoryBytes();
+    // Najpierw strumieniowo (SAX): bez drzewa QJsonDocument i bez kopii pliku w pamięci.
+    const StepLoadResult loaded = loadStepTable(path);
+    if (loaded.table) {
+        QSharedPointer<SequenceProgram> program = programFromTable(loaded.table);
+        program->sourceHash = hash;
+        program->loadMs = timer.elapsed();
+        if (rssBefore >= 0) program->rssDeltaBytes = residentMemoryBytes() - rssBefore;
+        if (cache.size() >= PROGRAM_CACHE_MAX) cache.clear();
+        cache.insert(hash, program);
+        return program;}
+    if (!loaded.needsFullCompile) {
+        if (error) *error = loaded.error;
+        return {};}
+    file.seek(0);
+    const QByteArray data = file.readAll();
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        if (error) *error = QString("Invalid JSON at offset %1: %2").arg(parseError.offset).arg(parseError.errorString());
+        return {};}
+    if (!doc.isArray()) {
+        if (error) *error = "File does not contain a valid JSON array.";
+        return {};}
+    QSharedPointer<SequenceProgram> program = buildProgram(doc.array(), error);
+    if (!program) return {};
+    program->sourceHash = hash;
+    program->loadMs = timer.elapsed();
+    if (cache.size() >= PROGRAM_CACHE_MAX) cache.clear();
+    cache.insert(hash, program);
+    return program;}
+
+void SequenceProgram::clearCache() {programCache().clear();}
+
+int SequenceProgram::cacheSize() {return programCache().size();}
@@ -0,0 +1,102 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QJsonArray>
+#include <QSharedPointer>
+#include <QHash>
+#include <QRegularExpression>
+
+class StepTable;
+
+// Warunek if/while/goto: "lhs op rhs", samo "lhs" (prawda, gdy niepuste i nie "0"/"false")
+// lub "!..." - operandy to szablony z ${zmienna}, gołe identyfikatory są nazwami zmiennych.
+// Gdy obie strony są liczbami, porównanie jest liczbowe.
+struct SeqCond {
+    enum Cmp : quint8 { Always, Truthy, Eq, Ne, Lt, Le, Gt, Ge, Contains };
+
+    Cmp cmp = Always;
+    bool negate = false;
+    QString lhs;
+    QString rhs;
+
+    bool evaluate(const QHash<QString, QString> &vars) const;
+    static bool parse(const QString &text, SeqCond *out, QString *error);
+};
+
+// Jedna instrukcja skompilowanej sekwencji. Tryb i rodzaj kroku są rozstrzygnięte przy
+// ładowaniu, argumenty adb pocięte, a tap/swipe/keyevent zakodowane w pakiety sterowania.
+struct SeqInstr {
+    // Input: "input ..." bez zakodowanych pakietów (text, keyevent z nazwą, --meta...).
+    // Jump..While: instrukcje sterujące (if/else, goto, set/add, repeat, while) - bez polecenia.
+    enum Op : quint8 { Adb, Shell, Root, Capture, Query, Tap, Swipe, Key, Input,
+                       Jump, Set, Add, LoopInit, Repeat, While };
+
+    Op op = Adb;
+    QString command;        // oryginalne polecenie - log i ścieżka adb/shell
+    QStringList argv;       // Adb: argumenty procesu; Tap/Swipe/Key: liczby z polecenia
+    QByteArray packets;     // Tap/Swipe/Key: ControlPacket-y w kolejności wysyłki
+    int packetIntervalMs = 0;
+    int delayAfterMs = 0;
+    bool stopOnError = true;
+    bool conditional = false;
+    bool templated = false; // polecenie zawiera ${zmienna} - wiązane przed wykonaniem (bind)
+    int next = -1;          // -1 = koniec sekwencji
+    int onSuccess = -1;     // instrukcje successCommand/failureCommand
+    int onFailure = -1;
+    int jump = -1;          // Jump: cel, gdy warunek prawdziwy; Repeat/While: wyjście z pętli
+    int loopSlot = -1;      // LoopInit/Repeat/While: licznik pętli w wykonawcy
+    qint64 limit = 0;       // While: maxIterations (0 = bez limitu)
+    SeqCond cond;           // Jump/While
+    int sourceIndex = -1;   // indeks kroku (kroki z bloków "parallel" spłaszczone w kolejności pliku)
+    QString name;           // "id" kroku, cel dla "dependsOn"; Repeat/While: zmienna "as"
+    QString captureAs;      // zmienna na wyjście kroku (stdout, przycięte)
+    QRegularExpression capture; // captureRegex: grupa 1 (albo całe dopasowanie) zamiast całego wyjścia
+    QVector<int> deps;      // kroki, które muszą się zakończyć przed tym (tylko program z dag)
+    QVector<int> dependents;
+
+    bool isInput() const { return op == Tap || op == Swipe || op == Key || op == Input; }
+    bool isControl() const { return op >= Jump; }
+    static const char *opName(Op op);
+};
+
+// Sekwencja po kompilacji: kroki z JSON leżą na początku w kolejności pliku (0..stepCount-1),
+// instrukcje warunkowe za nimi. Skoki są indeksami, więc wykonanie nie porównuje napisów.
+// Gdy plik używa bloków "parallel" lub "dependsOn", dag = true i kolejność wyznaczają
+// deps/dependents (sprawdzone pod kątem cykli), a nie next.
+// Sterowanie (if/else, repeat, while, goto, set/add) kompiluje się do instrukcji Jump..While
+// za krokami; wykonawca trzyma tylko licznik programu, zmienne i loopSlots liczników pętli.
+// Wynik compileFile() jest współdzielony i trzymany w cache według skrótu treści pliku.
+// Duże pliki liniowe są stronicowane: instrs jest puste, kroki leżą w zwartej tabeli, a
+// instrAt() kompiluje je na żądanie (warunkowe mają wtedy indeksy stepCount + 2*krok [+1]).
+class SequenceProgram {
+public:
+    QVector<SeqInstr> instrs;
+    int entry = -1;
+    int stepCount = 0;
+    bool dag = false;
+    int loopSlots = 0;
+    QByteArray sourceHash;      // SHA-1 pliku (compileFile) lub zwartego JSON tablicy (compile)
+    QSharedPointer<const StepTable> table;
+    qint64 loadMs = -1;         // compileFile: czas wczytania
+    qint64 rssDeltaBytes = 0;   // compileFile: przyrost pamięci rezydentnej w trakcie wczytania
+
+    bool paged() const { return instrs.isEmpty() && table; }
+    SeqInstr instrAt(int index) const;
+    QString commandAt(int index) const;
+    qint64 tableBytes() const;
+
+    static QSharedPointer<const SequenceProgram> compile(const QJsonArray &array, QString *error);
+    static QSharedPointer<const SequenceProgram> compileFile(const QString &path, QString *error);
+    // Pojedynczy krok poza sekwencją (np. executeSequenceCommand).
+    static bool compileStep(const QString &command, const QString &runMode, SeqInstr *out, QString *error);
+    // Tylko walidacja compileStep - bez parsowania argumentów i kodowania pakietów.
+    static bool checkStep(const QString &command, const QString &runMode, QString *error);
+    // ${nazwa} -> wartość zmiennej (nieznana = pusty napis).
+    static QString interpolate(const QString &text, const QHash<QString, QString> &vars);
+    // Krok z ${...} skompilowany ponownie z bieżącymi wartościami zmiennych (tryb z in.op).
+    static bool bind(const SeqInstr &in, const QHash<QString, QString> &vars, SeqInstr *out, QString *error);
+    static void clearCache();
+    static int cacheSize();
+};
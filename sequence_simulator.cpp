@@ -0,0 +1,286 @@
+#include "sequence_simulator.h"
+#include "sequencerunner.h"
+#include "sequence_loader.h"
+#include "step_scheduler.h"
+#include "control_protocol.h"
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QJsonArray>
+#include <algorithm>
+#include <cstddef>
+
+static const int TOP_STEPS = 10;
+static const int NOT_EXECUTED_LISTED = 20;
+
+static QString formatDuration(qint64 us) {
+    const qint64 s = us / 1000000;
+    return QString("%1:%2:%3.%4").arg(s / 3600).arg(s / 60 % 60, 2, 10, QLatin1Char('0'))
+        .arg(s % 60, 2, 10, QLatin1Char('0')).arg(us / 1000 % 1000, 3, 10, QLatin1Char('0'));}
+
+LatencyModel::LatencyModel() {
+    // Rzędy wielkości dla telefonu na USB; learn() nadpisuje je pomiarami.
+    m_us = {{"process", 150000}, {"shell,v2", 350000}, {"shell", 5000}, {"root", 8000}, {"query", 5000},
+            {"queryHit", 50}, {"capture", 800000}, {"control", 1000}};}
+
+QString LatencyModel::pathFor(const SeqInstr &instr) {
+    switch (instr.op) {
+    case SeqInstr::Shell: return QStringLiteral("shell");
+    case SeqInstr::Root: return QStringLiteral("root");
+    case SeqInstr::Query: return QStringLiteral("query");
+    case SeqInstr::Capture: return QStringLiteral("capture");
+    case SeqInstr::Tap:
+    case SeqInstr::Swipe:
+    case SeqInstr::Key:
+        return instr.packets.isEmpty() ? QStringLiteral("shell,v2") : QStringLiteral("control");
+    case SeqInstr::Input: return QStringLiteral("shell,v2");
+    default: return QStringLiteral("process");}}
+
+qint64 LatencyModel::latencyUs(const SeqInstr &instr, bool cachedQuery) const {
+    if (cachedQuery) return m_us.value(QStringLiteral("queryHit"));
+    qint64 us = m_us.value(pathFor(instr));
+    if (!instr.packets.isEmpty() && instr.packetIntervalMs > 0) {
+        // Jak sendControlChunk: każdy MOVE czeka packetIntervalMs.
+        int moves = 0;
+        for (int at = int(offsetof(ControlPacket, type)); at < instr.packets.size(); at += int(sizeof(ControlPacket))) {
+            if (quint8(instr.packets.at(at)) == EVENT_TYPE_TOUCH_MOVE) moves++;}
+        us += qint64(moves) * instr.packetIntervalMs * 1000;}
+    return us;}
+
+int LatencyModel::learn(const QJsonObject &json) {
+    QHash<QString, QPair<double, double>> sums;    // ścieżka -> (suma średnich * próbki, próbki)
+    int flat = 0;
+    for (auto it = json.begin(); it != json.end(); ++it) {
+        if (it.value().isDouble()) {
+            setLatencyUs(it.key(), qint64(it.value().toDouble() * 1000));
+            flat++;
+            continue;}
+        const qsizetype slash = it.key().lastIndexOf(QLatin1Char('/'));
+        const QJsonObject total = it.value().toObject().value("total").toObject();
+        const double count = total.value("count").toDouble();
+        if (slash < 0 || count <= 0) continue;
+        QPair<double, double> &sum = sums[it.key().mid(slash + 1)];
+        sum.first += total.value("meanUs").toDouble() * count;
+        sum.second += count;}
+    for (auto it = sums.cbegin(); it != sums.cend(); ++it) setLatencyUs(it.key(), qint64(it.value().first / it.value().second));
+    return flat + int(sums.size());}
+
+QJsonObject LatencyModel::toJson() const {
+    QJsonObject json;
+    for (auto it = m_us.cbegin(); it != m_us.cend(); ++it) json[it.key()] = it.value() / 1000.0;
+    return json;}
+
+SimulatedExecutor::SimulatedExecutor(VirtualClock *clock, const LatencyModel &model, QObject *parent)
+    : CommandExecutor(parent), m_clock(clock), m_model(model) {}
+
+SimulatedExecutor::~SimulatedExecutor() {
+    for (quint64 event : std::as_const(m_pending)) m_clock->cancel(event);}
+
+quint64 SimulatedExecutor::executeInstruction(const SeqInstr &instr, const QString &) {
+    const quint64 id = m_nextId++;
+    const bool cached = instr.op == SeqInstr::Query && m_queried.contains(instr.command);
+    Outcome outcome;
+    if (m_responder) m_responder(instr, &outcome);
+    if (outcome.latencyUs < 0) outcome.latencyUs = m_model.latencyUs(instr, cached);
+    // Jak DeviceQueryCache: zapamiętany jest tylko wynik z kodem 0.
+    if (instr.op == SeqInstr::Query && outcome.exitCode == 0) m_queried.insert(instr.command);
+    Record record;
+    record.sourceIndex = instr.sourceIndex;
+    record.conditional = instr.conditional;
+    record.command = instr.command;
+    record.path = cached ? QStringLiteral("queryHit") : LatencyModel::pathFor(instr);
+    record.startUs = m_clock->nowUs();
+    m_recordOf.insert(id, m_records.size());
+    m_records.append(record);
+    // Zakończenie zawsze przez zegar - wywołujący zdąży zapamiętać id, jak przy prawdziwym executorze.
+    m_pending.insert(id, m_clock->schedule(record.startUs + outcome.latencyUs, [this, id, outcome]() {
+        complete(id, outcome);}));
+    return id;}
+
+void SimulatedExecutor::cancel(quint64 id) {
+    const auto it = m_pending.find(id);
+    if (it == m_pending.end()) return;
+    m_clock->cancel(it.value());
+    m_pending.erase(it);
+    m_recordOf.remove(id);}
+
+void SimulatedExecutor::complete(quint64 id, const Outcome &outcome) {
+    m_pending.remove(id);
+    Record &record = m_records[m_recordOf.take(id)];
+    record.endUs = m_clock->nowUs();
+    record.exitCode = outcome.exitCode;
+    if (!outcome.output.isEmpty()) {
+        emit commandRawData(id, outcome.output);
+        emit commandOutput(id, QString::fromUtf8(outcome.output));}
+    emit commandFinished(id, outcome.exitCode, QProcess::NormalExit);}
+
+SequenceSimulator::SequenceSimulator(const Options &options, QObject *parent) : QObject(parent), m_options(options) {}
+
+QJsonObject SequenceSimulator::run(const QSharedPointer<const SequenceProgram> &program) {
+    QJsonObject report;
+    if (!program || program->entry < 0) {
+        report["error"] = "empty program";
+        return report;}
+    // Zegar zadeklarowany pierwszy - niszczony ostatni, po executorze i runnerze, które go używają.
+    VirtualClock clock;
+    SimulatedExecutor executor(&clock, m_options.model);
+    executor.setResponder(m_options.responder);
+    SequenceRunner runner(&executor);
+    runner.setVirtualClock(&clock);
+    runner.setMaxParallel(m_options.maxParallel);
+    runner.setCompensateExecutionTime(m_options.compensateTiming);
+    QEventLoop loop;
+    bool finished = false;
+    bool success = false;
+    qint64 endUs = 0;
+    QString aborted;
+    QJsonArray errors;
+    connect(&runner, &SequenceRunner::sequenceFinished, &loop, [&](bool ok) {
+        finished = true;
+        success = ok;
+        endUs = clock.nowUs();
+        loop.quit();});
+    connect(&runner, &SequenceRunner::logMessage, &loop, [&errors](const QString &text, const QString &color) {
+        if (color == QLatin1String("#F44336")) errors.append(text);});
+    // stopSequence() nie emituje sequenceFinished - pętla kończy się tutaj.
+    auto abort = [&](const QString &reason) {
+        if (finished) return;
+        aborted = reason;
+        runner.stopSequence();
+        finished = true;
+        endUs = clock.nowUs();
+        loop.quit();};
+    clock.schedule(m_options.virtualLimitMs * 1000, [&]() {
+        abort(QString("virtual time limit %1 reached").arg(formatDuration(m_options.virtualLimitMs * 1000)));});
+    QTimer::singleShot(m_options.wallLimitMs, &loop, [&]() {
+        abort(QString("wall-clock limit %1 ms reached").arg(m_options.wallLimitMs));});
+    QElapsedTimer wall;
+    wall.start();
+    if (!runner.loadProgram(program) || !runner.startSequence()) {
+        report["error"] = "runner rejected the program";
+        return report;}
+    if (!finished) loop.exec();
+
+    struct StepAgg {
+        int count = 0;
+        qint64 busyUs = 0;
+        qint64 firstStartUs = -1;
+        qint64 lastEndUs = -1;
+    };
+    QHash<int, StepAgg> steps;
+    QHash<QString, QPair<int, qint64>> byPath;
+    qint64 busyUs = 0;
+    QJsonArray timeline;
+    for (const SimulatedExecutor::Record &r : executor.records()) {
+        const qint64 end = r.endUs >= 0 ? r.endUs : endUs;
+        const qint64 took = end - r.startUs;
+        busyUs += took;
+        QPair<int, qint64> &path = byPath[r.path];
+        path.first++;
+        path.second += took;
+        StepAgg &step = steps[r.sourceIndex];
+        if (!r.conditional) step.count++;
+        step.busyUs += took;
+        if (step.firstStartUs < 0) step.firstStartUs = r.startUs;
+        step.lastEndUs = end;
+        if (timeline.size() >= m_options.timelineLimit) continue;
+        QJsonObject obj;
+        obj["index"] = r.sourceIndex;
+        obj["command"] = r.command;
+        obj["path"] = r.path;
+        obj["startMs"] = r.startUs / 1000.0;
+        obj["endMs"] = end / 1000.0;
+        obj["exitCode"] = r.endUs >= 0 ? r.exitCode : -1;
+        if (r.conditional) obj["conditional"] = true;
+        timeline.append(obj);}
+
+    // Stronicowany program ma delayAfterMs w tabeli - bez kompilowania kroków.
+    auto delayUs = [&program](int step) {
+        const int ms = program->paged() ? program->table->rows.at(step).delayAfterMs : program->instrs.at(step).delayAfterMs;
+        return qint64(ms) * 1000;};
+    auto stepJson = [&](int index, const StepAgg &s) {
+        QJsonObject obj;
+        obj["index"] = index;
+        obj["command"] = program->commandAt(index);
+        obj["count"] = s.count;
+        obj["busyMs"] = s.busyUs / 1000.0;
+        obj["delayMs"] = s.count * delayUs(index) / 1000.0;
+        return obj;};
+    QJsonObject critical;
+    if (program->dag) {
+        // Koniec kroku z perspektywy zależnych: ostatnia instrukcja (z warunkową) plus delayAfterMs.
+        QHash<int, qint64> finish;
+        int at = -1;
+        for (auto it = steps.cbegin(); it != steps.cend(); ++it) {
+            if (it.key() < 0 || it.key() >= program->stepCount) continue;
+            finish.insert(it.key(), it->lastEndUs + delayUs(it.key()));
+            if (at < 0 || finish.value(it.key()) > finish.value(at)) at = it.key();}
+        critical["lengthMs"] = at >= 0 ? finish.value(at) / 1000.0 : 0.0;
+        QJsonArray path;
+        while (at >= 0) {
+            QJsonObject obj = stepJson(at, steps.value(at));
+            obj["startMs"] = steps.value(at).firstStartUs / 1000.0;
+            obj["endMs"] = steps.value(at).lastEndUs / 1000.0;
+            path.prepend(obj);
+            int prev = -1;
+            for (int d : program->instrs.at(at).deps) {
+                if (finish.contains(d) && (prev < 0 || finish.value(d) > finish.value(prev))) prev = d;}
+            at = prev;}
+        critical["serial"] = false;
+        critical["steps"] = path;
+    } else {
+        // Bez dag (także z pętlami) każdy krok leży na ścieżce krytycznej - liczą się największe udziały.
+        QVector<QPair<qint64, int>> costs;
+        for (auto it = steps.cbegin(); it != steps.cend(); ++it) {
+            if (it.key() < 0 || it.key() >= program->stepCount) continue;
+            costs.append({it->busyUs + it->count * delayUs(it.key()), it.key()});}
+        std::sort(costs.begin(), costs.end(), [](const QPair<qint64, int> &a, const QPair<qint64, int> &b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;});
+        QJsonArray top;
+        for (int i = 0; i < costs.size() && i < TOP_STEPS; ++i) {
+            QJsonObject obj = stepJson(costs.at(i).second, steps.value(costs.at(i).second));
+            obj["share"] = endUs > 0 ? double(costs.at(i).first) / endUs : 0.0;
+            top.append(obj);}
+        critical["lengthMs"] = endUs / 1000.0;
+        critical["serial"] = true;
+        critical["topSteps"] = top;}
+
+    int notExecuted = 0;
+    QJsonArray notExecutedSteps;
+    for (int i = 0; i < program->stepCount; ++i) {
+        if (steps.value(i).count > 0) continue;
+        notExecuted++;
+        if (notExecutedSteps.size() < NOT_EXECUTED_LISTED) notExecutedSteps.append(i);}
+    QJsonObject paths;
+    for (auto it = byPath.cbegin(); it != byPath.cend(); ++it) {
+        QJsonObject obj;
+        obj["count"] = it->first;
+        obj["ms"] = it->second / 1000.0;
+        paths[it.key()] = obj;}
+    QJsonObject variables;
+    const QHash<QString, QString> &vars = runner.variables();
+    for (auto it = vars.cbegin(); it != vars.cend(); ++it) variables[it.key()] = it.value();
+    QJsonArray counters;
+    for (qint64 c : runner.loopCounters()) counters.append(c);
+
+    report["success"] = success;
+    if (!aborted.isEmpty()) report["aborted"] = aborted;
+    report["totalMs"] = endUs / 1000.0;
+    report["total"] = formatDuration(endUs);
+    report["commands"] = static_cast<qint64>(executor.records().size());
+    report["busyMs"] = busyUs / 1000.0;
+    report["byPath"] = paths;
+    report["criticalPath"] = critical;
+    report["notExecuted"] = notExecuted;
+    if (notExecuted > 0) report["notExecutedSteps"] = notExecutedSteps;
+    report["errors"] = errors;
+    report["variables"] = variables;
+    report["finalPc"] = runner.pc();
+    report["stepsDone"] = runner.stepsDone();
+    report["loopCounters"] = counters;
+    report["timeline"] = timeline;
+    report["timelineTruncated"] = executor.records().size() > timeline.size();
+    report["latencyModelMs"] = m_options.model.toJson();
+    report["simulationWallMs"] = wall.elapsed();
+    report["virtualEvents"] = static_cast<qint64>(clock.firedCount());
+    return report;}
@@ -0,0 +1,100 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <functional>
+#include "commandexecutor.h"
+#include "sequence_program.h"
+
+class VirtualClock;
+
+// Czas wykonania kroku w symulacji, per ścieżka jak w CommandMetrics (process, shell, root,
+// query, capture, control, shell,v2). Wartości domyślne albo nauczone z latencyStats().
+class LatencyModel {
+public:
+    LatencyModel();
+
+    // Ścieżka, którą CommandExecutor wykonałby krok (gniazdo sterowania zakładane jako połączone).
+    static QString pathFor(const SeqInstr &instr);
+    // Swipe: dodatkowo packetIntervalMs na każdy MOVE. Trafienie w cache zapytań - queryHit.
+    qint64 latencyUs(const SeqInstr &instr, bool cachedQuery) const;
+    void setLatencyUs(const QString &path, qint64 us) { m_us.insert(path, qMax<qint64>(0, us)); }
+    // CommandExecutor::latencyStats() ("serial/ścieżka" -> fazy) albo płaskie {"ścieżka": ms}.
+    // Faza "total" uśredniona po urządzeniach, ważona liczbą próbek. Zwraca liczbę ścieżek.
+    int learn(const QJsonObject &json);
+    QJsonObject toJson() const;
+
+private:
+    QHash<QString, qint64> m_us;
+};
+
+// Wykonawca bez urządzenia: każdy krok kończy się kodem 0 po czasie z modelu, na zegarze
+// wirtualnym. Responder podmienia wynik (scenariusze testowe: błąd, wyjście dla captureAs).
+class SimulatedExecutor : public CommandExecutor {
+    Q_OBJECT
+public:
+    struct Outcome {
+        int exitCode = 0;
+        QByteArray output;
+        qint64 latencyUs = -1;  // -1 = z modelu
+    };
+    using Responder = std::function<void(const SeqInstr &instr, Outcome *outcome)>;
+
+    struct Record {
+        int sourceIndex = -1;
+        bool conditional = false;
+        QString command;
+        QString path;
+        qint64 startUs = 0;
+        qint64 endUs = -1;      // -1 = przerwany
+        int exitCode = 0;
+    };
+
+    SimulatedExecutor(VirtualClock *clock, const LatencyModel &model, QObject *parent = nullptr);
+    ~SimulatedExecutor() override;
+
+    quint64 executeInstruction(const SeqInstr &instr, const QString &serial = QString()) override;
+    void cancel(quint64 id) override;
+    void setResponder(const Responder &responder) { m_responder = responder; }
+    const QVector<Record> &records() const { return m_records; }
+
+private:
+    void complete(quint64 id, const Outcome &outcome);
+
+    VirtualClock *m_clock;
+    LatencyModel m_model;
+    Responder m_responder;
+    QHash<quint64, quint64> m_pending;  // id polecenia -> zdarzenie zegara
+    QHash<quint64, int> m_recordOf;
+    QVector<Record> m_records;
+    QSet<QString> m_queried;
+    quint64 m_nextId = 1;
+};
+
+// Przebieg "na sucho": prawdziwy SequenceRunner na SimulatedExecutor i zegarze wirtualnym.
+// Raport: przewidywany czas, oś czasu, ścieżka krytyczna, kroki niewykonane i błędy.
+class SequenceSimulator : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        LatencyModel model;
+        int maxParallel = 4;
+        bool compensateTiming = false;
+        qint64 virtualLimitMs = 7LL * 24 * 3600 * 1000;    // pętla bez końca w czasie wirtualnym
+        int wallLimitMs = 60000;                            // pętla bez kroków (same set/goto)
+        int timelineLimit = 1000;
+        SimulatedExecutor::Responder responder;
+    };
+
+    explicit SequenceSimulator(const Options &options, QObject *parent = nullptr);
+
+    // Blokuje do końca symulacji (własna pętla zdarzeń).
+    QJsonObject run(const QSharedPointer<const SequenceProgram> &program);
+
+private:
+    Options m_options;
+};
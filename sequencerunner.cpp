@@ -7,139 +7,498 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
-#include <QTimer>
 #include <QDebug>
+#include <QMetaObject>
+#include <QSaveFile>
+#include <QDateTime>
+#include <algorithm>
+
+// Tyle instrukcji sterujących z rzędu, zanim pętla bez kroków odda sterowanie pętli zdarzeń.
+static const int CONTROL_BUDGET = 1000;
+// Górna granica wyjścia trzymanego dla captureAs.
+static const int CAPTURE_MAX_BYTES = 1024 * 1024;
+static const int CHECKPOINT_VERSION = 1;
 
 SequenceRunner::SequenceRunner(CommandExecutor *executor, QObject *parent)
     : QObject(parent), m_executor(executor) {
-    m_delayTimer.setSingleShot(true);
-    connect(&m_delayTimer, &QTimer::timeout, this, &SequenceRunner::onDelayTimeout);
-    connect(m_executor, &CommandExecutor::finished, this, &SequenceRunner::onCommandFinished);
+    connect(&m_scheduler, &StepScheduler::due, this, &SequenceRunner::onDeadline);
+    connect(m_executor, &CommandExecutor::commandFinished, this, &SequenceRunner::onCommandFinished);
+    connect(m_executor, &CommandExecutor::commandRawData, this, &SequenceRunner::onCommandData);
 }
 
 SequenceRunner::~SequenceRunner() {}
 
-SequenceCmd SequenceRunner::parseCommandFromJson(const QJsonObject &obj) {
-    SequenceCmd cmd;
-    cmd.command = obj.value("command").toString();
-    cmd.delayAfterMs = obj.value("delayAfterMs").toInt(100);
-    cmd.runMode = obj.value("runMode").toString("adb").toLower(); 
-    cmd.stopOnError = obj.value("stopOnError").toBool(true);
-    cmd.successCommand = obj.value("successCommand").toString();
-    cmd.failureCommand = obj.value("failureCommand").toString();
-    return cmd;}
-
 void SequenceRunner::clearSequence() {
-    m_commands.clear();
+    m_program.reset();
     emit logMessage("Sequence queue cleared.", "#BDBDBD");}
 
 bool SequenceRunner::appendSequence(const QString &filePath) {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        emit logMessage(QString("Cannot open file: %1").arg(file.errorString()), "#F44336");
-        return false;}
-    QByteArray jsonData = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(jsonData);
-    if (!doc.isArray()) {
-        emit logMessage("File does not contain a valid JSON array.", "#F44336");
+    if (m_isRunning) {
+        emit logMessage("Cannot load sequence while one is running.", "#F44336");
         return false;}
-    return loadSequenceFromJsonArray(doc.array());}
+    // Ten sam plik (po skrócie treści) nie jest parsowany ani kompilowany ponownie.
+    QString error;
+    return setProgram(SequenceProgram::compileFile(filePath, &error), error);}
 
 bool SequenceRunner::loadSequenceFromJsonArray(const QJsonArray &array) {
     if (m_isRunning) {
         emit logMessage("Cannot load sequence while one is running.", "#F44336");
         return false;}
-    m_commands.clear();
-    for (const QJsonValue &value : array) {
-        if (value.isObject()) {
-            m_commands.append(parseCommandFromJson(value.toObject()));
-        } else {
-            emit logMessage("Invalid command format in JSON array.", "#F44336");
-            return false;}}
-    emit logMessage(QString("Loaded %1 commands.").arg(m_commands.count()), "#4CAF50");
+    QString error;
+    return setProgram(SequenceProgram::compile(array, &error), error);}
+
+bool SequenceRunner::loadProgram(const QSharedPointer<const SequenceProgram> &program) {
+    if (m_isRunning) {
+        emit logMessage("Cannot load sequence while one is running.", "#F44336");
+        return false;}
+    return setProgram(program, "empty program");}
+
+bool SequenceRunner::setProgram(const QSharedPointer<const SequenceProgram> &program, const QString &error) {
+    if (!program) {
+        emit logMessage(QString("Sequence rejected: %1").arg(error), "#F44336");
+        return false;}
+    m_program = program;
+    m_pager.reset(program);
+    emit logMessage(QString("Loaded %1 commands.").arg(m_program->stepCount), "#4CAF50");
+    if (m_program->loadMs >= 0 && m_program->stepCount > 0) {
+        // Koszt na 100 tys. kroków - porównywalny między plikami różnej długości.
+        const double per100k = 100000.0 / m_program->stepCount;
+        emit logMessage(QString("Wczytano w %1 ms (%2 ms / 100k kroków); tabela %3 MB, RSS +%4 MB / 100k kroków%5.")
+                            .arg(m_program->loadMs).arg(m_program->loadMs * per100k, 0, 'f', 0)
+                            .arg(m_program->tableBytes() / 1048576.0, 0, 'f', 1)
+                            .arg(qMax<qint64>(0, m_program->rssDeltaBytes) * per100k / 1048576.0, 0, 'f', 1)
+                            .arg(m_program->paged() ? ", kroki stronicowane" : ""), "#BDBDBD");}
     return true;}
 
 QStringList SequenceRunner::getCommandsAsText() const {
     QStringList list;
-    for (const auto &cmd : m_commands) {
+    if (!m_program) return list;
+    if (m_program->paged()) {
+        // Bez kompilowania kroków - same napisy z tabeli.
+        for (int i = 0; i < m_program->stepCount; ++i) {
+            const StepTable::Row &row = m_program->table->rows.at(i);
+            QString text = m_program->commandAt(i);
+            if (row.successCommand != StringPool::None) {
+                text += QString(" (Sukces: '%1')").arg(m_program->table->strings.at(row.successCommand));}
+            if (row.failureCommand != StringPool::None) {
+                text += QString(" (Błąd: '%1')").arg(m_program->table->strings.at(row.failureCommand));}
+            list.append(text);}
+        return list;}
+    for (int i = 0; i < m_program->stepCount; ++i) {
+        const SeqInstr &cmd = m_program->instrs.at(i);
         QString text = cmd.command;
-        if (!cmd.successCommand.isEmpty()) {
-            text += QString(" (Sukces: '%1')").arg(cmd.successCommand);}
-        if (!cmd.failureCommand.isEmpty()) {
-            text += QString(" (Błąd: '%1')").arg(cmd.failureCommand);}
+        if (cmd.onSuccess >= 0) {
+            text += QString(" (Sukces: '%1')").arg(m_program->instrs.at(cmd.onSuccess).command);}
+        if (cmd.onFailure >= 0) {
+            text += QString(" (Błąd: '%1')").arg(m_program->instrs.at(cmd.onFailure).command);}
+        if (!cmd.captureAs.isEmpty()) text += QString(" (Zmienna: %1)").arg(cmd.captureAs);
+        if (m_program->dag && !cmd.deps.isEmpty()) {
+            QStringList after;
+            for (int d : cmd.deps) {
+                const QString &name = m_program->instrs.at(d).name;
+                after.append(name.isEmpty() ? QString("#%1").arg(d + 1) : name);}
+            text += QString(" (Po: %1)").arg(after.join(", "));}
         list.append(text);}
     return list;}
 
 bool SequenceRunner::startSequence() {
-    if (m_commands.isEmpty()) {
+    if (!m_program || m_program->entry < 0) {
         emit logMessage("Sequence is empty. Nothing to start.", "#FFC107");
         return false;}
     if (m_isRunning) {
         emit logMessage("Sequence is already running.", "#FFC107");
         return true;}
-    m_currentIndex = 0;
+    m_pc = m_program->entry;
     m_isRunning = true;
+    m_scheduler.restart();
+    m_jitter.clear();
+    m_stepStartUs = 0;
+    m_vars.clear();
+    m_counters = QVector<qint64>(m_program->loopSlots, 0);
+    m_runId++;
+    m_stepsDone = 0;
+    m_elapsedBaseUs = 0;
+    m_resumes = 0;
+    m_lastCheckpointUs = m_scheduler.nowUs();
+    if (m_resume.pending) {
+        m_pc = m_resume.pc;
+        m_vars = m_resume.vars;
+        for (int i = 0; i < m_counters.size() && i < m_resume.counters.size(); ++i) m_counters[i] = m_resume.counters.at(i);
+        m_stepsDone = m_resume.stepsDone;
+        m_elapsedBaseUs = m_resume.elapsedUs;
+        m_resumes = m_resume.resumes + 1;}
+    snapshotSafePoint(m_pc);
     emit sequenceStarted();
     emit logMessage("--- SEQUENCE STARTED ---", "#009688");
-    executeNextCommand();
+    if (m_resume.pending) {
+        emit logMessage(QString("Wznowienie z checkpointu: %1 kroków wykonanych, %2 s wcześniejszego przebiegu.")
+                            .arg(m_stepsDone).arg(m_elapsedBaseUs / 1000000), "#009688");}
+    const QVector<int> done = m_resume.pending ? m_resume.done : QVector<int>();
+    m_resume = Resume();
+    if (m_program->dag) {
+        startDag();
+        for (int step : done) {
+            if (step < 0 || step >= m_program->stepCount || m_dagDone.at(step)) continue;
+            m_ready.removeOne(step);
+            completeDagStep(step);}
+        pumpDag();
+    } else {
+        executeNextCommand();}
     return true;}
 
+bool SequenceRunner::resumeSequence(const QString &checkpointPath) {
+    if (m_isRunning || !m_program) return startSequence();
+    QFile file(checkpointPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit logMessage(QString("Brak checkpointu %1 - start od początku.").arg(checkpointPath), "#FFC107");
+        return startSequence();}
+    const QJsonObject json = QJsonDocument::fromJson(file.readAll()).object();
+    const QByteArray hash = QByteArray::fromHex(json.value("sequenceHash").toString().toLatin1());
+    const int instrCount = m_program->paged() ? m_program->stepCount * 3 : m_program->instrs.size();
+    const int pc = json.value("pc").toInt(-2);
+    if (json.value("version").toInt() != CHECKPOINT_VERSION || pc < -1 || pc >= instrCount) {
+        emit logMessage(QString("Checkpoint %1 jest uszkodzony lub z innej wersji.").arg(checkpointPath), "#F44336");
+        return false;}
+    if (m_program->sourceHash.isEmpty()) {
+        emit logMessage(QString("Sekwencja nie ma skrótu źródła - checkpoint %1 pominięty.").arg(checkpointPath), "#F44336");
+        return false;}
+    if (hash != m_program->sourceHash) {
+        emit logMessage(QString("Checkpoint %1 dotyczy innej sekwencji - zmieniony plik?").arg(checkpointPath), "#F44336");
+        return false;}
+    Resume resume;
+    resume.pending = true;
+    resume.pc = pc;
+    for (const QJsonValue &step : json.value("done").toArray()) resume.done.append(step.toInt());
+    const QJsonObject vars = json.value("vars").toObject();
+    for (auto it = vars.begin(); it != vars.end(); ++it) resume.vars.insert(it.key(), it.value().toString());
+    for (const QJsonValue &counter : json.value("counters").toArray()) resume.counters.append(counter.toInteger());
+    resume.elapsedUs = json.value("elapsedMs").toInteger() * 1000;
+    resume.stepsDone = json.value("stepsDone").toInt();
+    resume.resumes = json.value("resumes").toInt();
+    m_resume = resume;
+    return startSequence();}
+
+void SequenceRunner::setCheckpoint(const QString &path, int intervalMs) {
+    m_checkpointPath = path;
+    m_checkpointIntervalMs = qMax(0, intervalMs);}
+
+void SequenceRunner::snapshotSafePoint(int pc) {
+    // Kopie współdzielone (implicit sharing) - koszt dopiero przy następnej zmianie zmiennej.
+    m_safe.pc = pc;
+    m_safe.vars = m_vars;
+    m_safe.counters = m_counters;
+    m_safe.stepsDone = m_stepsDone;}
+
+void SequenceRunner::markSafePoint(int pc) {
+    snapshotSafePoint(pc);
+    if (m_checkpointPath.isEmpty()) return;
+    const qint64 now = m_scheduler.nowUs();
+    if (now - m_lastCheckpointUs < qint64(m_checkpointIntervalMs) * 1000) return;
+    m_lastCheckpointUs = now;
+    writeCheckpoint();}
+
+void SequenceRunner::writeCheckpoint() {
+    QJsonObject json;
+    json["version"] = CHECKPOINT_VERSION;
+    json["sequenceHash"] = QString::fromLatin1(m_program->sourceHash.toHex());
+    json["pc"] = m_safe.pc;
+    // m_dagDone zmienia się tylko tuż przed markSafePoint - bieżący stan jest stanem punktu.
+    if (m_program->dag) {
+        QJsonArray done;
+        for (int i = 0; i < m_dagDone.size(); ++i) {
+            if (m_dagDone.at(i)) done.append(i);}
+        json["done"] = done;}
+    QJsonObject vars;
+    for (auto it = m_safe.vars.cbegin(); it != m_safe.vars.cend(); ++it) vars[it.key()] = it.value();
+    json["vars"] = vars;
+    QJsonArray counters;
+    for (qint64 counter : std::as_const(m_safe.counters)) counters.append(counter);
+    json["counters"] = counters;
+    json["elapsedMs"] = (m_elapsedBaseUs + m_scheduler.nowUs()) / 1000;
+    json["stepsDone"] = m_safe.stepsDone;
+    json["resumes"] = m_resumes;
+    json["savedAt"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    // Zapis przez plik tymczasowy i rename - przerwany zapis nie niszczy poprzedniego checkpointu.
+    QSaveFile file(m_checkpointPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(json).toJson(QJsonDocument::Compact)) < 0 || !file.commit()) {
+        emit logMessage(QString("Nie udało się zapisać checkpointu %1: %2").arg(m_checkpointPath, file.errorString()), "#FFC107");}}
+
 void SequenceRunner::stopSequence() {
     if (!m_isRunning) return;    
     m_isRunning = false;
-    m_delayTimer.stop();
-    m_executor->cancelCurrentCommand(); 
+    cancelInFlight();
+    if (!m_checkpointPath.isEmpty()) writeCheckpoint();
     finishSequence(false);}
 
+void SequenceRunner::cancelInFlight() {
+    m_scheduler.cancelAll();
+    if (m_currentRequest) {
+        const quint64 id = m_currentRequest;
+        m_currentRequest = 0;
+        m_executor->cancel(id);}
+    if (!m_running.isEmpty()) {
+        const QList<quint64> running = m_running.keys();
+        m_running.clear();
+        for (quint64 id : running) m_executor->cancel(id);}
+    m_ready.clear();
+    m_delaying = 0;}
+
 void SequenceRunner::executeNextCommand() {
-    if (!m_isRunning || m_currentIndex >= m_commands.count()) {
+    if (!m_isRunning || m_pc < 0) {
         finishSequence(true);
         return;}
-    const SequenceCmd &cmd = m_commands.at(m_currentIndex);
-    if (cmd.isConditionalExecution) {
+    SeqInstr cmd = m_pager.at(m_pc);
+    int budget = CONTROL_BUDGET;
+    while (cmd.isControl()) {
+        if (!runControl(cmd)) return;
+        if (m_pc < 0) {
+            finishSequence(true);
+            return;}
+        if (--budget == 0) {
+            const quint64 run = m_runId;
+            QMetaObject::invokeMethod(this, [this, run]() {
+                if (m_isRunning && run == m_runId) executeNextCommand();}, Qt::QueuedConnection);
+            return;}
+        cmd = m_pager.at(m_pc);}
+    if (cmd.templated && !bindStep(cmd, &cmd)) return;
+    if (cmd.conditional) {
         emit logMessage(QString("Wykonywanie komendy warunkowej: %1").arg(cmd.command), "#FF9800");
     } else {
-        emit commandExecuting(cmd.command, m_currentIndex + 1, m_commands.count());}
-    m_executor->executeSequenceCommand(cmd.command, cmd.runMode);}
+        emit commandExecuting(cmd.command, cmd.sourceIndex + 1, m_program->stepCount);}
+    m_stepBeganUs = m_scheduler.nowUs();
+    m_capturing = !cmd.captureAs.isEmpty();
+    m_captured.clear();
+    m_currentRequest = m_executor->executeInstruction(cmd);}
 
-void SequenceRunner::onDelayTimeout() {
-    executeNextCommand();}
+bool SequenceRunner::bindStep(const SeqInstr &in, SeqInstr *out) {
+    QString error;
+    if (SequenceProgram::bind(in, m_vars, out, &error)) return true;
+    emit logMessage(QString("Sekwencja zatrzymana: '%1' po podstawieniu zmiennych: %2").arg(in.command, error), "#F44336");
+    finishSequence(false);
+    return false;}
 
-void SequenceRunner::executeConditionalCommand(const QString& cmd, const QString& runMode, bool isSuccess) {
-    if (cmd.isEmpty()) return;
-    SequenceCmd conditionalCmd;
-    conditionalCmd.command = cmd;
-    conditionalCmd.runMode = runMode;
-    conditionalCmd.delayAfterMs = 0;
-    conditionalCmd.stopOnError = true;
-    conditionalCmd.isConditionalExecution = true;
-    m_commands.insert(m_currentIndex + 1, conditionalCmd);
-    emit logMessage(QString("Wstrzyknięto komendę warunkową (ExitCode: %1): '%2'").arg(isSuccess ? "0 (Sukces)" : "!=0 (Błąd)", cmd), "#2196F3");}
-
-void SequenceRunner::onCommandFinished(int exitCode, QProcess::ExitStatus) {
+void SequenceRunner::storeCapture(const SeqInstr &in, const QByteArray &output) {
+    QString value = QString::fromUtf8(output);
+    if (!in.capture.pattern().isEmpty()) {
+        const QRegularExpressionMatch match = in.capture.match(value);
+        if (!match.hasMatch()) {
+            emit logMessage(QString("captureAs %1: wzorzec nie pasuje do wyjścia, zmienna pusta.").arg(in.captureAs), "#FFC107");}
+        value = match.captured(in.capture.captureCount() > 0 ? 1 : 0);
+    } else {
+        value = value.trimmed();}
+    m_vars.insert(in.captureAs, value);
+    emit logMessage(QString("%1 = '%2'").arg(in.captureAs, value.size() > 80 ? value.left(77) + "..." : value), "#BDBDBD");}
+
+void SequenceRunner::onCommandData(quint64 id, const QByteArray &data) {
     if (!m_isRunning) return;
-    const SequenceCmd &currentCmd = m_commands.at(m_currentIndex);
-    if (!currentCmd.isConditionalExecution) {
-        if (exitCode == 0) {
-            executeConditionalCommand(currentCmd.successCommand, currentCmd.runMode, true);
-        } else {
-            executeConditionalCommand(currentCmd.failureCommand, currentCmd.runMode, false);}}
+    QByteArray *buffer = nullptr;
+    if (id == m_currentRequest) {
+        if (m_capturing) buffer = &m_captured;
+    } else {
+        const auto it = m_running.find(id);
+        if (it != m_running.end() && it->capture) buffer = &it->output;}
+    if (buffer && buffer->size() < CAPTURE_MAX_BYTES) buffer->append(data.left(CAPTURE_MAX_BYTES - buffer->size()));}
+
+// Jedna instrukcja sterująca: ustawia m_pc. false = sekwencja zakończona błędem.
+bool SequenceRunner::runControl(const SeqInstr &in) {
+    auto fail = [this](const QString &message) {
+        emit logMessage(QString("Sekwencja zatrzymana: %1").arg(message), "#F44336");
+        finishSequence(false);
+        return false;};
+    switch (in.op) {
+    case SeqInstr::Jump:
+        m_pc = in.cond.evaluate(m_vars) ? in.jump : in.next;
+        return true;
+    case SeqInstr::Set:
+        for (int i = 0; i + 1 < in.argv.size(); i += 2) {
+            m_vars.insert(in.argv.at(i), SequenceProgram::interpolate(in.argv.at(i + 1), m_vars));}
+        break;
+    case SeqInstr::Add:
+        for (int i = 0; i + 1 < in.argv.size(); i += 2) {
+            const QString &name = in.argv.at(i);
+            const QString current = m_vars.value(name).trimmed();
+            const QString delta = SequenceProgram::interpolate(in.argv.at(i + 1), m_vars).trimmed();
+            bool okCurrent = true;
+            bool okDelta = false;
+            const double value = current.isEmpty() ? 0 : current.toDouble(&okCurrent);
+            const double step = delta.toDouble(&okDelta);
+            if (!okCurrent || !okDelta) return fail(QString("add: \"%1\" = \"%2\" + \"%3\" to nie liczby").arg(name, current, delta));
+            m_vars.insert(name, QString::number(value + step, 'g', 15));}
+        break;
+    case SeqInstr::LoopInit:
+        m_counters[in.loopSlot] = 0;
+        break;
+    case SeqInstr::Repeat: {
+        bool ok = false;
+        const QString text = SequenceProgram::interpolate(in.argv.value(0), m_vars).trimmed();
+        const qint64 limit = text.toLongLong(&ok);
+        if (!ok) return fail(QString("repeat: liczba powtórzeń \"%1\" nie jest liczbą całkowitą").arg(text));
+        if (m_counters.at(in.loopSlot) >= limit) {
+            m_pc = in.jump;
+            return true;}
+        break;}
+    case SeqInstr::While:
+        if (!in.cond.evaluate(m_vars)) {
+            m_pc = in.jump;
+            return true;}
+        if (in.limit > 0 && m_counters.at(in.loopSlot) >= in.limit) {
+            return fail(QString("while: przekroczono maxIterations (%1)").arg(in.limit));}
+        break;
+    default:
+        break;}
+    if (in.op == SeqInstr::Repeat || in.op == SeqInstr::While) {
+        if (!in.name.isEmpty()) m_vars.insert(in.name, QString::number(m_counters.at(in.loopSlot)));
+        m_counters[in.loopSlot]++;}
+    m_pc = in.next;
+    return true;}
+
+void SequenceRunner::scheduleDelay(int step, qint64 fromUs, int delayMs) {
+    // Termin bezwzględny: spóźnienie jednego odliczenia nie przesuwa kolejnych.
+    m_scheduler.scheduleAt(fromUs + qint64(delayMs) * 1000, step);}
+
+void SequenceRunner::onDeadline(quint64, int tag, qint64 scheduledUs, qint64 actualUs) {
+    if (!m_isRunning) return;
+    m_jitter[tag].record(actualUs - scheduledUs);
+    if (m_program->dag) {
+        m_delaying--;
+        completeDagStep(tag);
+        pumpDag();
+        return;}
+    // Planowany, nie faktyczny start - w trybie kompensacji kolejny termin liczy się od niego.
+    m_stepStartUs = scheduledUs;
+    executeNextCommand();}
+
+QJsonObject SequenceRunner::timingStats() const {
+    QJsonObject json;
+    json["compensate"] = m_compensate;
+    json["overall"] = m_scheduler.lateness().toJson();
+    QList<int> indices = m_jitter.keys();
+    std::sort(indices.begin(), indices.end());
+    QJsonArray steps;
+    for (int index : std::as_const(indices)) {
+        QJsonObject obj = m_jitter.value(index).toJson();
+        obj["index"] = index;
+        if (m_program && index >= 0 && index < m_program->stepCount) {
+            obj["command"] = m_program->commandAt(index);
+            obj["delayAfterMs"] = m_program->instrAt(index).delayAfterMs;}
+        steps.append(obj);}
+    json["steps"] = steps;
+    return json;}
+
+void SequenceRunner::startDag() {
+    // Program z dag nigdy nie jest stronicowany (loader SAX oddaje go pełnej kompilacji).
+    m_pendingDeps.resize(m_program->stepCount);
+    m_dagDone = QVector<bool>(m_program->stepCount, false);
+    m_ready.clear();
+    m_running.clear();
+    m_stepsDone = 0;
+    m_delaying = 0;
+    for (int i = 0; i < m_program->stepCount; ++i) {
+        m_pendingDeps[i] = m_program->instrs.at(i).deps.size();
+        if (m_pendingDeps.at(i) == 0) m_ready.append(i);}}
+
+void SequenceRunner::pumpDag() {
+    // Kroki gotowe startują w kolejności pliku, do limitu m_maxParallel; resztę
+    // i tak ogranicza limit per urządzenie w CommandExecutor.
+    while (m_isRunning && !m_ready.isEmpty() && m_running.size() < m_maxParallel) {
+        const int step = m_ready.takeFirst();
+        // Krok ukończony przed wznowieniem nie startuje drugi raz.
+        if (m_dagDone.at(step)) continue;
+        const SeqInstr &cmd = m_program->instrs.at(step);
+        emit commandExecuting(cmd.command, step + 1, m_program->stepCount);
+        launchDagInstr(step, step, m_scheduler.nowUs());}
+    if (m_isRunning && m_running.isEmpty() && m_delaying == 0 && m_ready.isEmpty()) {
+        if (m_stepsDone < m_program->stepCount) {
+            emit logMessage("Sekwencja zatrzymana: kroki czekają na zależności, które się nie wykonają.", "#F44336");}
+        finishSequence(m_stepsDone == m_program->stepCount);}}
+
+void SequenceRunner::launchDagInstr(int step, int instr, qint64 startUs) {
+    SeqInstr cmd = m_program->instrs.at(instr);
+    if (cmd.templated && !bindStep(cmd, &cmd)) return;
+    RunningStep run;
+    run.step = step;
+    run.instr = instr;
+    run.startUs = startUs;
+    run.capture = !cmd.captureAs.isEmpty();
+    const quint64 id = m_executor->executeInstruction(cmd);
+    m_running.insert(id, run);}
+
+void SequenceRunner::onDagCommandFinished(quint64 id, int exitCode) {
+    const auto it = m_running.constFind(id);
+    if (it == m_running.cend()) return;
+    const RunningStep run = it.value();
+    m_running.erase(it);
+    const SeqInstr &cmd = m_program->instrs.at(run.instr);
+    if (!cmd.conditional) {
+        m_vars.insert(QStringLiteral("lastExit"), QString::number(exitCode));
+        if (run.capture) storeCapture(cmd, run.output);
+        emit stepFinished(run.step, exitCode, m_scheduler.nowUs() - run.startUs);
+        const int branch = exitCode == 0 ? cmd.onSuccess : cmd.onFailure;
+        if (branch >= 0) {
+            emit logMessage(QString("Wstrzyknięto komendę warunkową (ExitCode: %1): '%2'")
+                                .arg(exitCode == 0 ? "0 (Sukces)" : "!=0 (Błąd)", m_program->instrs.at(branch).command), "#2196F3");}
+        if (exitCode != 0 && cmd.stopOnError) {
+            emit logMessage(QString("Sekwencja zatrzymana: Komenda '%1' nie powiodła się (kod %2).").arg(cmd.command).arg(exitCode), "#F44336");
+            finishSequence(false);
+            return;}
+        if (branch >= 0) {
+            // Warunkowa zajmuje miejsce kroku - zależni czekają na nią.
+            launchDagInstr(run.step, branch, run.startUs);
+            return;}
+    } else if (exitCode != 0) {
+        emit logMessage(QString("Sekwencja zatrzymana: Komenda nie powiodła się (kod %1).").arg(exitCode), "#F44336");
+        finishSequence(false);
+        return;}
+    const int delay = m_program->instrs.at(run.step).delayAfterMs;
+    if (delay <= 0) {
+        completeDagStep(run.step);
+        pumpDag();
+        return;}
+    // Opóźnienie po kroku nie zajmuje miejsca - w tym czasie mogą biec inne gałęzie.
+    m_delaying++;
+    scheduleDelay(run.step, m_compensate ? run.startUs : m_scheduler.nowUs(), delay);
+    pumpDag();}
+
+void SequenceRunner::completeDagStep(int step) {
+    m_stepsDone++;
+    m_dagDone[step] = true;
+    for (int n : m_program->instrs.at(step).dependents) {
+        if (--m_pendingDeps[n] == 0) m_ready.append(n);}
+    markSafePoint(-1);}
+
+void SequenceRunner::onCommandFinished(quint64 id, int exitCode, QProcess::ExitStatus) {
+    if (m_isRunning && m_program && m_program->dag) {
+        onDagCommandFinished(id, exitCode);
+        return;}
+    // Inne polecenia z puli (ręczne, rozdzielczość) nie przesuwają sekwencji.
+    if (!m_isRunning || id != m_currentRequest) return;
+    m_currentRequest = 0;
+    const SeqInstr currentCmd = m_pager.at(m_pc);
+    if (!currentCmd.conditional) {
+        m_vars.insert(QStringLiteral("lastExit"), QString::number(exitCode));
+        if (m_capturing) storeCapture(currentCmd, m_captured);
+        m_stepsDone++;
+        emit stepFinished(currentCmd.sourceIndex, exitCode, m_scheduler.nowUs() - m_stepBeganUs);}
+    int next = currentCmd.next;
+    if (!currentCmd.conditional) {
+        const int branch = exitCode == 0 ? currentCmd.onSuccess : currentCmd.onFailure;
+        if (branch >= 0) {
+            next = branch;
+            emit logMessage(QString("Wstrzyknięto komendę warunkową (ExitCode: %1): '%2'")
+                                .arg(exitCode == 0 ? "0 (Sukces)" : "!=0 (Błąd)", m_program->commandAt(branch)), "#2196F3");}}
     if (exitCode != 0) {
         if (currentCmd.stopOnError) {
             emit logMessage(QString("Sekwencja zatrzymana: Komenda nie powiodła się (kod %1).").arg(exitCode), "#F44336");
             finishSequence(false);
             return;}}
-    m_currentIndex++;
-    if (currentCmd.isConditionalExecution) {
-        m_commands.removeAt(m_currentIndex - 1);
-        m_currentIndex--;
-    }
-    if (m_currentIndex < m_commands.count()) {
+    m_pc = next;
+    markSafePoint(m_pc);
+    if (m_pc >= 0) {
         if (currentCmd.delayAfterMs > 0) {
             emit logMessage(QString("Oczekiwanie %1 ms...").arg(currentCmd.delayAfterMs), "#FFC107");
-            m_delayTimer.setInterval(currentCmd.delayAfterMs);
-            m_delayTimer.start();
+            scheduleDelay(currentCmd.sourceIndex, m_compensate ? m_stepStartUs : m_scheduler.nowUs(), currentCmd.delayAfterMs);
         } else {
+            m_stepStartUs = m_scheduler.nowUs();
             executeNextCommand();}
     } else {
         finishSequence(true);}}
@@ -147,8 +506,20 @@ void SequenceRunner::onCommandFinished(int exitCode, QProcess::ExitStatus) {
 void SequenceRunner::finishSequence(bool success) {
     if (!m_isRunning) return;
     m_isRunning = false;
-    m_delayTimer.stop();
-    m_executor->cancelCurrentCommand(); 
+    cancelInFlight();
+    if (!m_checkpointPath.isEmpty()) {
+        if (success) {
+            QFile::remove(m_checkpointPath);
+        } else {
+            writeCheckpoint();}}
+    if (m_resumes > 0) {
+        emit logMessage(QString("Łączny czas z %1 wznowieniami: %2 s.").arg(m_resumes)
+                            .arg((m_elapsedBaseUs + m_scheduler.nowUs()) / 1000000), "#BDBDBD");}
+    const LatencyHistogram &lateness = m_scheduler.lateness();
+    if (lateness.count() > 0) {
+        emit logMessage(QString("Dokładność opóźnień: p50 %1 µs, p99 %2 µs, max %3 µs (%4 odliczeń%5).")
+                            .arg(lateness.percentileUs(0.50)).arg(lateness.percentileUs(0.99)).arg(lateness.maxUs())
+                            .arg(lateness.count()).arg(m_compensate ? ", z kompensacją" : ""), "#BDBDBD");}
     emit sequenceFinished(success);
     if (m_isInterval) {
         if (success) {
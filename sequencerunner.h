@@ -4,23 +4,17 @@
 #include <QProcess>
 #include <QObject>
 #include <QList>
-#include <QTimer>
+#include <QHash>
+#include <QVector>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QSharedPointer>
+#include "sequence_program.h"
+#include "step_scheduler.h"
+#include "sequence_loader.h"
 
 class CommandExecutor;
 
-struct SequenceCmd {
-    QString command;
-    int delayAfterMs = 0;
-    QString runMode = "adb"; // "adb", "shell", "root"
-    bool stopOnError = true;
-
-    QString successCommand;
-    QString failureCommand;
-    bool isConditionalExecution = false;
-};
-
 class SequenceRunner : public QObject {
     Q_OBJECT
 public:
@@ -29,37 +23,126 @@ public:
     bool appendSequence(const QString &filePath);
     void clearSequence();
     bool startSequence();
+    // Start od stanu z checkpointu (pc, zmienne, liczniki pętli, ukończone kroki dag, czas).
+    // Brak pliku = start od początku; plik innej sekwencji (skrót treści) jest odrzucany.
+    bool resumeSequence(const QString &checkpointPath);
+    // Po zakończonym kroku, nie częściej niż co intervalMs (0 = po każdym), stan trafia do pliku;
+    // przy błędzie lub zatrzymaniu zawsze, po sukcesie plik jest usuwany. Pusta ścieżka wyłącza.
+    void setCheckpoint(const QString &path, int intervalMs);
+    QString checkpointPath() const { return m_checkpointPath; }
     void stopSequence();
     void setIntervalToggle(bool toggle);
     void setIntervalValue(int seconds);
     bool isRunning() const { return m_isRunning; }
     QStringList getCommandsAsText() const;
-    int commandCount() const { return m_commands.count(); }
+    int commandCount() const { return m_program ? m_program->stepCount : 0; }
+    QSharedPointer<const SequenceProgram> program() const { return m_program; }
     bool loadSequenceFromJsonArray(const QJsonArray &array);
+    // Program skompilowany wcześniej (np. jeden dla wielu urządzeń) - bez ponownej kompilacji.
+    bool loadProgram(const QSharedPointer<const SequenceProgram> &program);
+    // Ile kroków programu z "parallel"/"dependsOn" może naraz działać na urządzeniu.
+    void setMaxParallel(int steps) { m_maxParallel = qMax(1, steps); }
+    int maxParallel() const { return m_maxParallel; }
+    // Wyłączone: delayAfterMs liczone od końca kroku (jak dotąd). Włączone: od planowanego
+    // startu kroku, więc czas wykonania jest wliczony, a terminy kolejnych kroków nie dryfują.
+    void setCompensateExecutionTime(bool on) { m_compensate = on; }
+    bool compensateExecutionTime() const { return m_compensate; }
+    // Symulacja (SequenceSimulator): opóźnienia na zegarze wirtualnym zamiast rzeczywistego.
+    void setVirtualClock(VirtualClock *clock) { m_scheduler.setVirtualClock(clock); }
+    // Spóźnienie końca delayAfterMs względem terminu, per krok i łącznie (ostatnie uruchomienie).
+    QJsonObject timingStats() const;
+    // Zmienne sekwencji (set/add, "as" pętli, lastExit, captureAs) z bieżącego lub ostatniego uruchomienia.
+    const QHash<QString, QString> &variables() const { return m_vars; }
+    // Stan wykonania po ostatnim uruchomieniu: pc (-1 = koniec programu), ukończone kroki, liczniki pętli.
+    int pc() const { return m_pc; }
+    int stepsDone() const { return m_stepsDone; }
+    const QVector<qint64> &loopCounters() const { return m_counters; }
 
 signals:
     void sequenceStarted();
     void sequenceFinished(bool success);
     void scheduleRestart(int intervalSeconds);
     void commandExecuting(const QString &cmd, int index, int total);
+    // Czas wykonania kroku (bez delayAfterMs); index to indeks w tablicy JSON.
+    void stepFinished(int index, int exitCode, qint64 elapsedUs);
     void logMessage(const QString &text, const QString &color);
 
 private slots:
-    void onCommandFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onDelayTimeout();
+    void onCommandFinished(quint64 id, int exitCode, QProcess::ExitStatus exitStatus);
+    void onCommandData(quint64 id, const QByteArray &data);
+    void onDeadline(quint64 token, int tag, qint64 scheduledUs, qint64 actualUs);
 
 private:
     CommandExecutor *m_executor;
-    QList<SequenceCmd> m_commands;
-    QTimer m_delayTimer;
-    int m_currentIndex = 0;
+    QSharedPointer<const SequenceProgram> m_program;
+    StepPager m_pager;
+    StepScheduler m_scheduler;
+    qint64 m_stepBeganUs = 0;       // faktyczny start bieżącej instrukcji (liniowo)
+    qint64 m_stepStartUs = 0;       // planowany start bieżącego kroku (liniowo)
+    bool m_compensate = false;
+    QHash<int, LatencyHistogram> m_jitter;
+    int m_pc = -1;
+    QHash<QString, QString> m_vars;
+    QVector<qint64> m_counters;     // liczniki pętli (SeqInstr::loopSlot)
+    quint64 m_runId = 0;            // odróżnia odroczone wywołania poprzedniego uruchomienia
+    bool m_capturing = false;       // bieżący krok ma captureAs
+    // Checkpoint: ostatni bezpieczny punkt (krok zakończony, następny niezaczęty).
+    struct Resume {
+        bool pending = false;
+        int pc = -1;
+        QVector<int> done;
+        QHash<QString, QString> vars;
+        QVector<qint64> counters;
+        qint64 elapsedUs = 0;
+        int stepsDone = 0;
+        int resumes = 0;
+    };
+    Resume m_resume;
+    QString m_checkpointPath;
+    int m_checkpointIntervalMs = 30000;
+    qint64 m_lastCheckpointUs = -1;
+    // Stan z ostatniego bezpiecznego punktu - to trafia do checkpointu, nie bieżące zmienne,
+    // które set/add/captureAs mogły już zmienić po tym punkcie.
+    Resume m_safe;
+    qint64 m_elapsedBaseUs = 0;     // czas poprzednich przebiegów (wznowienia)
+    int m_resumes = 0;
+    QVector<bool> m_dagDone;
+    QByteArray m_captured;
+    quint64 m_currentRequest = 0;
     bool m_isRunning = false;
     bool m_isInterval = false;
     int m_intervalValueS = 60;
+    // Wykonanie programu z dag: krok startuje, gdy wszystkie jego deps się zakończyły
+    // (razem z instrukcją warunkową i delayAfterMs).
+    struct RunningStep {
+        int step = -1;
+        int instr = -1;
+        qint64 startUs = 0;
+        bool capture = false;
+        QByteArray output;
+    };
+    QVector<int> m_pendingDeps;
+    QList<int> m_ready;
+    QHash<quint64, RunningStep> m_running;
+    int m_stepsDone = 0;
+    int m_delaying = 0;
+    int m_maxParallel = 4;
+    void startDag();
+    void pumpDag();
+    void launchDagInstr(int step, int instr, qint64 startUs);
+    void onDagCommandFinished(quint64 id, int exitCode);
+    void completeDagStep(int step);
+    void snapshotSafePoint(int pc);
+    void markSafePoint(int pc);
+    void writeCheckpoint();
+    void cancelInFlight();
+    void scheduleDelay(int step, qint64 fromUs, int delayMs);
     void finishSequence(bool success);
     void executeNextCommand();
-    SequenceCmd parseCommandFromJson(const QJsonObject &obj);
-    void executeConditionalCommand(const QString& cmd, const QString& runMode, bool isSuccess);
+    bool runControl(const SeqInstr &in);
+    bool bindStep(const SeqInstr &in, SeqInstr *out);
+    void storeCapture(const SeqInstr &in, const QByteArray &output);
+    bool setProgram(const QSharedPointer<const SequenceProgram> &program, const QString &error);
 };
 
 #endif // SEQUENCERUNNER_H
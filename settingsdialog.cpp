@@ -6,6 +6,7 @@
 #include <QPushButton>
 #include <QCheckBox>
 #include <QFileDialog>
+#include <QSpinBox>
 
 SettingsDialog::SettingsDialog(QWidget *parent):QDialog(parent){
     setWindowTitle("Application settings");
@@ -22,6 +23,19 @@ SettingsDialog::SettingsDialog(QWidget *parent):QDialog(parent){
     main->addLayout(row1);
     m_safeCheck = new QCheckBox("Safe mode (block destructive commands)");
     main->addWidget(m_safeCheck);
+    auto row2 = new QHBoxLayout();
+    row2->addWidget(new QLabel("ADB transport pool size:"));
+    m_poolSizeSpin = new QSpinBox();
+    m_poolSizeSpin->setRange(0, 16);
+    row2->addWidget(m_poolSizeSpin);
+    row2->addWidget(new QLabel("idle timeout (ms):"));
+    m_poolIdleSpin = new QSpinBox();
+    m_poolIdleSpin->setRange(1000, 600000);
+    m_poolIdleSpin->setSingleStep(1000);
+    row2->addWidget(m_poolIdleSpin);
+    main->addLayout(row2);
+    m_directCheck = new QCheckBox("Connect to TCP devices (host:port) directly, bypassing the adb server");
+    main->addWidget(m_directCheck);
     auto btnRow = new QHBoxLayout();
     btnRow->addStretch(1);
     auto ok = new QPushButton("OK");
@@ -37,3 +51,9 @@ void SettingsDialog::setAdbPath(const QString &p) { m_adbEdit->setText(p); }
 QString SettingsDialog::adbPath() const { return m_adbEdit->text().trimmed(); }
 void SettingsDialog::setSafeMode(bool v) { m_safeCheck->setChecked(v); }
 bool SettingsDialog::safeMode() const { return m_safeCheck->isChecked(); }
+void SettingsDialog::setAdbPoolSize(int size) { m_poolSizeSpin->setValue(size); }
+int SettingsDialog::adbPoolSize() const { return m_poolSizeSpin->value(); }
+void SettingsDialog::setAdbPoolIdleMs(int ms) { m_poolIdleSpin->setValue(ms); }
+int SettingsDialog::adbPoolIdleMs() const { return m_poolIdleSpin->value(); }
+void SettingsDialog::setAdbDirect(bool v) { m_directCheck->setChecked(v); }
+bool SettingsDialog::adbDirect() const { return m_directCheck->isChecked(); }
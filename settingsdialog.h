@@ -4,6 +4,7 @@
 
 class QLineEdit;
 class QCheckBox;
+class QSpinBox;
 class SettingsDialog : public QDialog {
     Q_OBJECT
 public:
@@ -13,6 +14,15 @@ public:
     QString adbPath() const;
     void setSafeMode(bool v);
     bool safeMode() const;
+    void setAdbPoolSize(int size);
+    int adbPoolSize() const;
+    void setAdbPoolIdleMs(int ms);
+    int adbPoolIdleMs() const;
+    void setAdbDirect(bool v);
+    bool adbDirect() const;
 private:
     QLineEdit *m_adbEdit = nullptr;
-    QCheckBox *m_safeCheck = nullptr;};
+    QCheckBox *m_safeCheck = nullptr;
+    QSpinBox *m_poolSizeSpin = nullptr;
+    QSpinBox *m_poolIdleSpin = nullptr;
+    QCheckBox *m_directCheck = nullptr;};
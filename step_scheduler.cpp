@@ -0,0 +1,123 @@
+#include "step_scheduler.h"
+#include <QThread>
+#include <QMetaObject>
+
+quint64 VirtualClock::schedule(qint64 atUs, std::function<void()> fn) {
+    const quint64 id = m_nextId++;
+    const qint64 at = qMax(atUs, m_nowUs);
+    m_events.insert(qMakePair(at, id), std::move(fn));
+    m_times.insert(id, at);
+    arm();
+    return id;}
+
+void VirtualClock::cancel(quint64 id) {
+    const auto it = m_times.constFind(id);
+    if (it == m_times.cend()) return;
+    m_events.remove(qMakePair(it.value(), id));
+    m_times.erase(it);}
+
+void VirtualClock::reset() {
+    m_events.clear();
+    m_times.clear();
+    m_nowUs = 0;
+    m_fired = 0;}
+
+void VirtualClock::arm() {
+    if (m_pumpQueued || m_events.isEmpty()) return;
+    m_pumpQueued = true;
+    QMetaObject::invokeMethod(this, &VirtualClock::pump, Qt::QueuedConnection);}
+
+void VirtualClock::pump() {
+    m_pumpQueued = false;
+    if (m_events.isEmpty()) return;
+    const auto it = m_events.begin();
+    const qint64 at = it.key().first;
+    const std::function<void()> fn = it.value();
+    m_times.remove(it.key().second);
+    m_events.erase(it);
+    m_nowUs = qMax(m_nowUs, at);
+    m_fired++;
+    arm();
+    fn();}
+
+StepScheduler::StepScheduler(QObject *parent) : QObject(parent) {
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &StepScheduler::onTimeout);
+    m_clock.start();}
+
+StepScheduler::~StepScheduler() {cancelAll();}
+
+void StepScheduler::restart() {
+    cancelAll();
+    m_lateness.reset();
+    m_clock.restart();
+    if (m_virtual) m_originUs = m_virtual->nowUs();}
+
+void StepScheduler::setVirtualClock(VirtualClock *clock) {
+    cancelAll();
+    m_virtual = clock;
+    m_originUs = clock ? clock->nowUs() : 0;}
+
+quint64 StepScheduler::scheduleAt(qint64 deadlineUs, int tag) {
+    if (m_virtual) {
+        const quint64 token = m_nextToken++;
+        const quint64 event = m_virtual->schedule(m_originUs + deadlineUs, [this, token, tag, deadlineUs]() {
+            m_virtualEvents.remove(token);
+            // Spóźnienie jest tu możliwe tylko dla terminu już minionego przy planowaniu.
+            const qint64 actual = nowUs();
+            m_lateness.record(actual - deadlineUs);
+            emit due(token, tag, deadlineUs, actual);});
+        m_virtualEvents.insert(token, event);
+        return token;}
+    Entry entry;
+    entry.token = m_nextToken++;
+    entry.tag = tag;
+    m_deadlines.insert(deadlineUs, entry);
+    arm();
+    return entry.token;}
+
+void StepScheduler::cancel(quint64 token) {
+    if (m_virtual) {
+        const quint64 event = m_virtualEvents.take(token);
+        if (event) m_virtual->cancel(event);
+        return;}
+    for (auto it = m_deadlines.begin(); it != m_deadlines.end(); ++it) {
+        if (it.value().token == token) {
+            m_deadlines.erase(it);
+            break;}}
+    arm();}
+
+void StepScheduler::cancelAll() {
+    if (m_virtual) {
+        for (quint64 event : std::as_const(m_virtualEvents)) m_virtual->cancel(event);}
+    m_virtualEvents.clear();
+    m_deadlines.clear();
+    m_timer.stop();}
+
+void StepScheduler::arm() {
+    if (m_deadlines.isEmpty()) {
+        m_timer.stop();
+        return;}
+    const qint64 remaining = m_deadlines.firstKey() - nowUs();
+    if (m_spinUs <= 0) {
+        // W górę do pełnej ms - timer nie odpala przed terminem, więc bez ponownego uzbrajania co obrót pętli.
+        m_timer.start(remaining > 0 ? int((remaining + 999) / 1000) : 0);
+        return;}
+    // Pobudka spinUs przed terminem (w dół do pełnej ms), żeby timer nie spóźnił odpalenia.
+    m_timer.start(remaining > m_spinUs ? int((remaining - m_spinUs) / 1000) : 0);}
+
+void StepScheduler::onTimeout() {
+    while (!m_deadlines.isEmpty()) {
+        auto it = m_deadlines.begin();
+        const qint64 deadline = it.key();
+        if (deadline - nowUs() > m_spinUs) break;
+        if (m_spinUs > 0) {
+            while (nowUs() < deadline) QThread::yieldCurrentThread();}
+        const Entry entry = it.value();
+        m_deadlines.erase(it);
+        const qint64 actual = nowUs();
+        m_lateness.record(actual - deadline);
+        // Odbiorca może planować i odwoływać terminy - iteracja zaczyna się od nowa.
+        emit due(entry.token, entry.tag, deadline, actual);}
+    arm();}
@@ -0,0 +1,88 @@
+#pragma once
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMultiMap>
+#include <QMap>
+#include <QHash>
+#include <QPair>
+#include <QJsonObject>
+#include <functional>
+#include "command_metrics.h"
+
+// Zegar symulacji: zdarzenia w kolejności czasu (równe terminy w kolejności planowania),
+// jedno na obrót pętli zdarzeń - po tym, co już czeka w kolejce. Czas przeskakuje do
+// terminu zdarzenia, więc godziny opóźnień mijają natychmiast.
+class VirtualClock : public QObject {
+    Q_OBJECT
+public:
+    explicit VirtualClock(QObject *parent = nullptr) : QObject(parent) {}
+
+    qint64 nowUs() const { return m_nowUs; }
+    // Termin w przeszłości odpala jako najbliższe zdarzenie.
+    quint64 schedule(qint64 atUs, std::function<void()> fn);
+    void cancel(quint64 id);
+    // Czas 0, bez zdarzeń.
+    void reset();
+    int pendingCount() const { return m_events.size(); }
+    quint64 firedCount() const { return m_fired; }
+
+private:
+    void arm();
+    void pump();
+
+    QMap<QPair<qint64, quint64>, std::function<void()>> m_events;
+    QHash<quint64, qint64> m_times;
+    qint64 m_nowUs = 0;
+    quint64 m_nextId = 1;
+    quint64 m_fired = 0;
+    bool m_pumpQueued = false;
+};
+
+// Odliczanie do bezwzględnych terminów na zegarze monotonicznym. QTimer (PreciseTimer)
+// budzi w terminie albo do ~1 ms po nim. Spóźnienie każdego odpalenia trafia do histogramu.
+class StepScheduler : public QObject {
+    Q_OBJECT
+public:
+    explicit StepScheduler(QObject *parent = nullptr);
+    ~StepScheduler() override;
+
+    // Zeruje zegar, terminy i statystyki.
+    void restart();
+    qint64 nowUs() const { return m_virtual ? m_virtual->nowUs() - m_originUs : m_clock.nsecsElapsed() / 1000; }
+    // Symulacja: terminy na zegarze wirtualnym, bez timera i aktywnego czekania. nullptr = zegar rzeczywisty.
+    void setVirtualClock(VirtualClock *clock);
+    // Termin w przeszłości odpala w najbliższym obrocie pętli.
+    quint64 scheduleAt(qint64 deadlineUs, int tag);
+    void cancel(quint64 token);
+    void cancelAll();
+    int pendingCount() const { return m_deadlines.size() + m_virtualEvents.size(); }
+    // Opcjonalnie: pobudka spinUs przed terminem i aktywne czekanie na resztę. Blokuje wątek
+    // właściciela (GUI, pętla demona, worker fan-out) - tylko dla pomiarów. 0 = wyłączone.
+    void setSpinUs(int us) { m_spinUs = qBound(0, us, 5000); }
+    const LatencyHistogram &lateness() const { return m_lateness; }
+
+signals:
+    void due(quint64 token, int tag, qint64 scheduledUs, qint64 actualUs);
+
+private slots:
+    void onTimeout();
+
+private:
+    struct Entry {
+        quint64 token = 0;
+        int tag = -1;
+    };
+
+    void arm();
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    QMultiMap<qint64, Entry> m_deadlines;
+    quint64 m_nextToken = 1;
+    int m_spinUs = 0;
+    LatencyHistogram m_lateness;
+    VirtualClock *m_virtual = nullptr;
+    qint64 m_originUs = 0;
+    QHash<quint64, quint64> m_virtualEvents;    // token -> zdarzenie zegara wirtualnego
+};
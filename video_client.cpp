@@ -3,6 +3,9 @@
 #include "video_worker.h"
 #include "control_socket.h"
 #include "swipecanvas.h"
+#include "adb_client.h"
+#include "adb_sync.h"
+#include "adb_forward_manager.h"
 
 #include <iostream>
 #include <QDebug>
@@ -20,7 +23,20 @@ VideoClient::VideoClient(QObject *parent)
       m_localPort(7373),
       m_devicePort(7373),
       m_worker(new VideoWorker(nullptr, nullptr)),
-      m_controlSocket(new ControlSocket(this)) {
+      m_controlSocket(new ControlSocket(this)),
+      m_adbClient(new AdbClient(this)),
+      m_adbSync(new AdbSync(m_adbClient, this)),
+      m_forwards(new AdbForwardManager(m_adbClient, this)) {
+    connect(m_adbSync, &AdbSync::finished, this, &VideoClient::onAgentDeployed);
+    connect(m_forwards, &AdbForwardManager::forwardReady, this, &VideoClient::onForwardReady);
+    connect(m_adbClient, &AdbClient::shellStderr, this, [this](quint64 id, const QByteArray &data) {
+        if (id == m_agentRequest) std::cerr << "SERVER ERROR: " << data.toStdString() << std::endl;});
+    connect(m_adbClient, &AdbClient::requestFinished, this, [this](quint64 id) {
+        if (id == m_agentRequest) m_agentRequest = 0;});
+    connect(m_adbClient, &AdbClient::requestFailed, this, [this](quint64 id, const QString &message) {
+        if (id != m_agentRequest) return;
+        m_agentRequest = 0;
+        emit statusUpdate(QString("Błąd uruchamiania serwera Android: %1").arg(message), true);});
     
     m_adbPath = "adb";
     m_worker->moveToThread(&m_workerThread);
@@ -54,21 +70,25 @@ void VideoClient::startStream(const QString &deviceSerial, int localPort, int de
 
 void VideoClient::stopStream() {
     if (!m_isStreaming) return;
+    if (m_deployOp) {
+        const quint64 op = m_deployOp;
+        m_deployOp = 0;
+        m_adbSync->cancel(op);}
     emit stopWorker();
     
     if (m_controlSocket) {
         m_controlSocket->disconnectFromAgent();
     }
 
-    if (m_agentProcess) {
-        m_agentProcess->kill();
-        m_agentProcess->waitForFinished(500);
-        m_agentProcess->deleteLater();
-        m_agentProcess = nullptr;
+    // Zamknięcie strumienia shell kończy app_process po stronie adbd.
+    if (m_agentRequest) {
+        m_adbClient->cancel(m_agentRequest);
+        m_agentRequest = 0;
     }
     
-    if (!m_deviceSerial.isEmpty()) {
-        executeAdbCommand(QStringList() << "-s" << m_deviceSerial << "forward" << "--remove" << QString("tcp:%1").arg(m_localPort), false);
+    if (m_forwardHeld) {
+        m_forwards->release(m_deviceSerial, m_localPort);
+        m_forwardHeld = false;
     }
     
     m_isStreaming = false;
@@ -86,34 +106,60 @@ void VideoClient::deployAndStartAgent() {
         return;
     }
 
-    if (!executeAdbCommand(QStringList() << "-s" << m_deviceSerial << "push" << jarPath << deviceJarPath)) return;
-    executeAdbCommand(QStringList() << "-s" << m_deviceSerial << "forward" << QString("tcp:%1").arg(m_localPort) << QString("tcp:%1").arg(m_devicePort));
+    // Push tylko gdy jar na urządzeniu różni się rozmiarem, mtime lub SHA-256.
+    m_deployOp = m_adbSync->deploy(m_deviceSerial, jarPath, deviceJarPath);
+}
 
-    if (m_agentProcess) {
-        m_agentProcess->disconnect();
-        m_agentProcess->kill();
-        m_agentProcess->waitForFinished(1000);
-        delete m_agentProcess;
-        m_agentProcess = nullptr;
+void VideoClient::onAgentDeployed(quint64 op, bool ok, bool skipped, const QString &message) {
+    if (op != m_deployOp) return;
+    m_deployOp = 0;
+    if (!ok) {
+        qDebug() << "BŁĄD: wysyłanie sequence.jar nie powiodło się:" << message;
+        emit statusUpdate(QString("Błąd wysyłania sequence.jar: %1").arg(message), true);
+        m_isStreaming = false;
+        return;
     }
+    emit statusUpdate(skipped ? QString("sequence.jar aktualny - pominięto push.") : message, false);
+    startAgent();
+}
 
-    m_agentProcess = new QProcess(this);
-    QString shellCmd = QString("CLASSPATH=%1 app_process / dev.headless.sequence.Server").arg(deviceJarPath);
-    QStringList args;
-    args << "-s" << m_deviceSerial << "shell" << shellCmd;
+void VideoClient::startAgent() {
+    // Przekierowanie jest współdzielone i liczone referencjami - ponowny start nie zakłada go od nowa.
+    if (!m_forwardHeld) {
+        m_forwardHeld = true;
+        m_forwards->acquire(m_deviceSerial, m_localPort, m_devicePort);
+    } else {
+        launchAgent();
+    }
+}
 
-    connect(m_agentProcess, &QProcess::readyReadStandardError, [this](){
-        std::cerr << "SERVER ERROR: " << m_agentProcess->readAllStandardError().toStdString() << std::endl;
-    });
+void VideoClient::onForwardReady(const QString &serial, quint16 localPort, bool ok, const QString &message) {
+    if (!m_isStreaming || serial != m_deviceSerial || localPort != m_localPort) return;
+    if (!ok) {
+        m_forwardHeld = false;
+        emit statusUpdate(QString("Błąd przekierowania portu %1: %2").arg(localPort).arg(message), true);
+        m_isStreaming = false;
+        return;
+    }
+    launchAgent();
+}
+
+void VideoClient::launchAgent() {
+    QString deviceJarPath = "/data/local/tmp/sequence.jar";
+    if (m_agentRequest) {
+        m_adbClient->cancel(m_agentRequest);
+        m_agentRequest = 0;
+    }
 
-    QString program = m_adbPath.isEmpty() ? "adb" : m_adbPath;
-    m_agentProcess->start(program, args);
+    QString shellCmd = QString("CLASSPATH=%1 app_process / dev.headless.sequence.Server").arg(deviceJarPath);
+    m_agentRequest = m_adbClient->sendShellV2(m_deviceSerial, shellCmd);
     
     emit statusUpdate("Serwer Android uruchomiony. Łączenie...", false);
 
     QTimer::singleShot(1200, this, [this](){
         emit startWorker(m_deviceSerial, m_localPort, m_devicePort, m_adbPath);
         if (m_controlSocket) {
+            m_controlSocket->setDeviceSerial(m_deviceSerial);
             m_controlSocket->connectToLocalhost(m_localPort);
         }
     });
@@ -140,15 +186,6 @@ void VideoClient::onWorkerFinished() {
     emit finished();
 }
 
-bool VideoClient::executeAdbCommand(const QStringList &args, bool wait) {
-    QProcess adb;
-    QString program = m_adbPath.isEmpty() ? "adb" : m_adbPath;
-    adb.start(program, args);
-    if (!wait) return adb.waitForStarted();
-    if (!adb.waitForFinished(5000)) return false;
-    return (adb.exitStatus() != QProcess::CrashExit && adb.exitCode() == 0);
-}
-
 void VideoClient::setAdbPath(const QString &path) { m_adbPath = path; }
 void VideoClient::setDeviceSerial(const QString &serial) { m_deviceSerial = serial; }
 void VideoClient::setSwipeCanvas(SwipeCanvas *canvas) { m_swipeCanvas = canvas; }
@@ -9,6 +9,9 @@
 class VideoWorker;
 class ControlSocket;
 class SwipeCanvas;
+class AdbClient;
+class AdbSync;
+class AdbForwardManager;
 
 class VideoClient : public QObject {
     Q_OBJECT
@@ -35,9 +38,12 @@ private slots:
     void onFrameReady(AVFramePtr frame);
     void onWorkerFinished();
     void deployAndStartAgent();
+    void onAgentDeployed(quint64 op, bool ok, bool skipped, const QString &message);
+    void onForwardReady(const QString &serial, quint16 localPort, bool ok, const QString &message);
 
 private:
-    bool executeAdbCommand(const QStringList &args, bool wait = true);
+    void startAgent();
+    void launchAgent();
 
     bool m_isStreaming;
     QString m_deviceSerial;
@@ -47,9 +53,14 @@ private:
 
     QThread m_workerThread;
     VideoWorker *m_worker;
-    QProcess *m_agentProcess = nullptr;
+    quint64 m_agentRequest = 0;
+    bool m_forwardHeld = false;
     ControlSocket *m_controlSocket;
     SwipeCanvas *m_swipeCanvas = nullptr;
+    AdbClient *m_adbClient;
+    AdbSync *m_adbSync;
+    AdbForwardManager *m_forwards;
+    quint64 m_deployOp = 0;
 };
 
 #endif